@@ -160,6 +160,7 @@ HEADERS += src/qt/abcmintgui.h \
     src/pqcrypto/blas_config.h \
     src/pqcrypto/blas.h \
     src/pqcrypto/blas_u64.h \
+    src/pqcrypto/blas_simd.h \
     src/pqcrypto/gf16.h \
     src/pqcrypto/hash_len_config.h \
     src/pqcrypto/hash_utils.h \
@@ -270,12 +271,14 @@ SOURCES += src/qt/abcmint.cpp \
     src/pqcrypto/rijndael.cpp \
     src/pqcrypto/rijndael_tab.cpp \
     src/pqcrypto/fortuna.cpp \
+    src/pqcrypto/blas_simd.cpp \
     src/pqcrypto/hash_utils.cpp \
     src/pqcrypto/pqcrypt_argchk.cpp \
     src/pqcrypto/rainbow_16.cpp \
     src/pqcrypto/random.cpp \
     src/pqcrypto/rng.cpp \
     src/pqcrypto/sha256.cpp \
+    src/pqcrypto/sha256_simd.cpp \
     src/pqcrypto/sha512.cpp \
     src/pqcrypto/sign.cpp \
     src/alert.cpp \
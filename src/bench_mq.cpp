@@ -0,0 +1,269 @@
+// Copyright (c) 2018 The Abcmint developers
+
+// Benchmark of the MQ proof of work solver.
+//
+// Solves fixed-seed equation systems, built with the coefficient rule of the
+// current chain (NewGenCoeffMatrix), with the exfes sub-problems split between
+// -threads threads like the miner does, and prints the throughput and the
+// time to the first solution of each nBits as JSON. The first solution cancels
+// the work of the other threads, as a new tip does in the miner.
+//
+// Each -minersolver (enum, fft or auto) and -minerwordsize given (16, 32 or 64,
+// or 0 for the miner default) is measured on the same instances, and the fastest
+// one of each nBits is reported under "bestwordsize", which is how the defaults
+// of MQWordSize() were chosen. The FFT always packs 64 equations per word.
+//
+// Usage: bench_mq [-minbits=20] [-maxbits=32] [-step=4] [-instances=8] [-threads=<cores>] [-seed=0]
+//                 [-minercancelinterval=1] [-minersolver=auto [-minersolver=...]]
+//                 [-minerwordsize=0 [-minerwordsize=...]]
+
+#include "miner.h"
+#include "util.h"
+#include "json/json_spirit_writer_template.h"
+#include "json/json_spirit_utils.h"
+
+#include <boost/thread.hpp>
+
+using namespace json_spirit;
+
+// first height using NewGenCoeffMatrix
+static const int nBenchHeight = 25217;
+
+// One instance, searched by all the threads until the first solution.
+struct CBenchInstance
+{
+    boost::shared_ptr<const CMQSolverContext> pcontext;
+    uint64_t startPoint[4];
+    exfes_packed_eqs_t *eqs;
+
+    std::atomic<uint64_t> nEpoch;       // advanced by the first solution
+    std::atomic<uint64_t> nNextSubProblem;
+    std::atomic<uint64_t> nCandidates;
+    std::atomic<uint64_t> nCycles;
+
+    CCriticalSection cs;
+    bool fSolved;
+    uint256 nNonce;
+    int64 nSolvedMicros;
+    int64 nStoppedMicros;               // when the last thread stopped
+};
+
+static void BenchThread(CBenchInstance* pinstance, int64 nStartMicros)
+{
+    const CMQSolverContext& context = *pinstance->pcontext;
+    packed_system_t *sys = context.PackedSystem();
+    std::vector<pck_vector_t> vF(sys->scratch_words);
+    uint64_t **SolArray = CreateArray(1);
+    CMQCancelToken cancel(pinstance->nEpoch);
+    uint64_t nCandidatesStart = mqSolverStats.nCandidates;
+    uint64_t nCyclesStart = mqSolverStats.nCycles;
+
+    uint64_t nSubProblems = (uint64_t)1 << context.nSearchVariables;
+    uint64_t solm;
+    while ((solm = pinstance->nNextSubProblem++) < nSubProblems) {
+        int nResult = exfes_subproblem(context.nSearchVariables, context.nUnknowns, pinstance->startPoint,
+                                       solm, pinstance->eqs, sys, &vF[0], SolArray, &cancel);
+        if (nResult == 1) {
+            uint256 nNonce = 0;
+            ReportSolution(1, SolArray, nNonce);
+            LOCK(pinstance->cs);
+            if (!pinstance->fSolved) {
+                pinstance->fSolved = true;
+                pinstance->nNonce = nNonce;
+                pinstance->nSolvedMicros = GetTimeMicros() - nStartMicros;
+                pinstance->nEpoch++;
+            }
+        }
+        if (nResult != 0)
+            break;
+    }
+
+    {
+        LOCK(pinstance->cs);
+        pinstance->nStoppedMicros = std::max(pinstance->nStoppedMicros, GetTimeMicros() - nStartMicros);
+    }
+    pinstance->nCandidates += mqSolverStats.nCandidates - nCandidatesStart;
+    pinstance->nCycles += mqSolverStats.nCycles - nCyclesStart;
+    FreeArray(1, SolArray);
+}
+
+// Deterministic seed hash of instance nInstance of size nBits
+static uint256 BenchSeedHash(int64 nSeed, unsigned int nBits, int nInstance)
+{
+    int64 data[3] = { nSeed, nBits, nInstance };
+    return Hash(BEGIN(data), END(data));
+}
+
+static Object BenchBits(unsigned int nBits, int nInstances, int nThreads, int64 nSeed, int nSolver, int nWordSize)
+{
+    SetMQSolver(nSolver);
+    SetMQWordSize(nWordSize);
+    int nUnknowns = nBits + 8;
+    int nSearchVariables = MQSearchVariables(nUnknowns, (uint64_t)nThreads * 8);
+    // the automatic choice of the solver, measured before the timed runs
+    MQTuneSolver(nUnknowns - nSearchVariables, nBits);
+
+    uint64_t nCandidates = 0, nCycles = 0;
+    int64 nTotalMicros = 0;
+    int nSolved = 0, nInvalid = 0;
+    std::vector<int64> vSolvedMicros;
+    int64 nCancelMicros = 0;
+    int nAlgorithm = ALGO_AUTO, nWordSizeUsed = 0;
+    for (int i = 0; i < nInstances; i++) {
+        uint256 seedHash = BenchSeedHash(nSeed, nBits, i);
+        uint256 startHash = Hash(BEGIN(seedHash), END(seedHash));
+
+        CBenchInstance instance;
+        instance.pcontext = GetMQSolverContext(seedHash, nBits, nBenchHeight, nSearchVariables);
+        if (!instance.pcontext)
+            throw std::runtime_error("cannot build the equation system");
+        nAlgorithm = instance.pcontext->PackedSystem()->settings.algorithm;
+        nWordSizeUsed = instance.pcontext->PackedSystem()->settings.word_size;
+        for (int width = 0; width < 4; width++)
+            instance.startPoint[width] = startHash.Get64(width);
+        instance.eqs = instance.pcontext->PackedMaskedEquations(instance.startPoint);
+        if (!instance.eqs)
+            throw std::runtime_error("cannot pack the equation system");
+        instance.nEpoch = 0;
+        instance.nNextSubProblem = 0;
+        instance.nCandidates = 0;
+        instance.nCycles = 0;
+        instance.fSolved = false;
+        instance.nSolvedMicros = 0;
+        instance.nStoppedMicros = 0;
+
+        int64 nStartMicros = GetTimeMicros();
+        boost::thread_group threads;
+        for (int j = 0; j < nThreads; j++)
+            threads.create_thread(boost::bind(&BenchThread, &instance, nStartMicros));
+        threads.join_all();
+        nTotalMicros += GetTimeMicros() - nStartMicros;
+
+        nCandidates += instance.nCandidates;
+        nCycles += instance.nCycles;
+        if (instance.fSolved) {
+            if (CheckSolution(seedHash, nBits, true, instance.nNonce)) {
+                nSolved++;
+                vSolvedMicros.push_back(instance.nSolvedMicros);
+                nCancelMicros += instance.nStoppedMicros - instance.nSolvedMicros;
+            } else {
+                nInvalid++;
+            }
+        }
+        free_exfes_packed_eqs(instance.eqs);
+    }
+
+    Object result;
+    result.push_back(Pair("nbits", (int)nBits));
+    result.push_back(Pair("unknowns", nUnknowns));
+    result.push_back(Pair("searchvariables", nSearchVariables));
+    result.push_back(Pair("solver", nAlgorithm == ALGO_FFT ? "fft" : "enum"));
+    result.push_back(Pair("wordsize", nWordSizeUsed));
+    result.push_back(Pair("instances", nInstances));
+    result.push_back(Pair("solved", nSolved));
+    result.push_back(Pair("invalid", nInvalid));
+    result.push_back(Pair("candidates", (boost::uint64_t)nCandidates));
+    result.push_back(Pair("seconds", nTotalMicros / 1e6));
+    result.push_back(Pair("candidatespersec", nTotalMicros > 0 ? nCandidates * 1e6 / nTotalMicros : 0.0));
+    result.push_back(Pair("cyclespercandidate", nCandidates > 0 ? (double)nCycles / nCandidates : 0.0));
+    // from the first solution until all the threads stopped
+    result.push_back(Pair("cancelms", nSolved > 0 ? nCancelMicros / 1e3 / nSolved : 0.0));
+
+    // time to the first solution, with a histogram in power of two milliseconds
+    Object first;
+    if (!vSolvedMicros.empty()) {
+        std::sort(vSolvedMicros.begin(), vSolvedMicros.end());
+        int64 nSum = 0;
+        BOOST_FOREACH(int64 nMicros, vSolvedMicros)
+            nSum += nMicros;
+        first.push_back(Pair("mean_ms", nSum / 1e3 / vSolvedMicros.size()));
+        first.push_back(Pair("median_ms", vSolvedMicros[vSolvedMicros.size() / 2] / 1e3));
+        first.push_back(Pair("min_ms", vSolvedMicros.front() / 1e3));
+        first.push_back(Pair("max_ms", vSolvedMicros.back() / 1e3));
+    }
+    Array histogram;
+    int64 nBucket = 1000;
+    for (std::vector<int64>::iterator it = vSolvedMicros.begin(); it != vSolvedMicros.end(); nBucket *= 2) {
+        std::vector<int64>::iterator end = std::upper_bound(it, vSolvedMicros.end(), nBucket);
+        if (end != it) {
+            Object bucket;
+            bucket.push_back(Pair("upto_ms", (boost::int64_t)(nBucket / 1000)));
+            bucket.push_back(Pair("count", (int)(end - it)));
+            histogram.push_back(bucket);
+        }
+        it = end;
+    }
+    first.push_back(Pair("histogram", histogram));
+    result.push_back(Pair("firstsolution", first));
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    ParseParameters(argc, argv);
+    int nMinBits = GetArg("-minbits", 20);
+    int nMaxBits = GetArg("-maxbits", 32);
+    int nStep = std::max((int)GetArg("-step", 4), 1);
+    int nInstances = std::max((int)GetArg("-instances", 8), 1);
+    int nThreads = GetArg("-threads", boost::thread::hardware_concurrency());
+    int64 nSeed = GetArg("-seed", 0);
+    SetMQCancelInterval(GetArg("-minercancelinterval", 1));
+    if (nThreads < 1)
+        nThreads = 1;
+    if (nMinBits < 1 || nMaxBits > 256 || nMinBits > nMaxBits) {
+        fprintf(stderr, "bench_mq: nBits range must be within [1, 256]\n");
+        return 1;
+    }
+
+    std::vector<int> vSolvers;
+    BOOST_FOREACH(const std::string& strSolver, mapMultiArgs["-minersolver"])
+        vSolvers.push_back(strSolver == "enum" ? ALGO_ENUMERATION : strSolver == "fft" ? ALGO_FFT : ALGO_AUTO);
+    if (vSolvers.empty())
+        vSolvers.push_back(ALGO_AUTO);
+
+    std::vector<int> vWordSizes;
+    BOOST_FOREACH(const std::string& strWordSize, mapMultiArgs["-minerwordsize"])
+        vWordSizes.push_back(atoi(strWordSize));
+    if (vWordSizes.empty())
+        vWordSizes.push_back(0);
+
+    Array results, best;
+    try {
+        for (int nBits = nMinBits; nBits <= nMaxBits; nBits += nStep) {
+            int nBestWordSize = 0;
+            std::string strBestSolver;
+            double dBestRate = -1;
+            BOOST_FOREACH(int nSolver, vSolvers) {
+                BOOST_FOREACH(int nWordSize, vWordSizes) {
+                    // the word size does not change the FFT
+                    if (nSolver == ALGO_FFT && nWordSize != vWordSizes[0])
+                        continue;
+                    Object result = BenchBits(nBits, nInstances, nThreads, nSeed, nSolver, nWordSize);
+                    double dRate = find_value(result, "candidatespersec").get_real();
+                    if (dRate > dBestRate) {
+                        dBestRate = dRate;
+                        strBestSolver = find_value(result, "solver").get_str();
+                        nBestWordSize = find_value(result, "wordsize").get_int();
+                    }
+                    results.push_back(result);
+                }
+            }
+            Object fastest;
+            fastest.push_back(Pair("nbits", nBits));
+            fastest.push_back(Pair("solver", strBestSolver));
+            fastest.push_back(Pair("wordsize", nBestWordSize));
+            best.push_back(fastest);
+        }
+    } catch (std::exception& e) {
+        fprintf(stderr, "bench_mq: %s\n", e.what());
+        return 1;
+    }
+
+    Object report;
+    report.push_back(Pair("threads", nThreads));
+    report.push_back(Pair("seed", (boost::int64_t)nSeed));
+    report.push_back(Pair("results", results));
+    report.push_back(Pair("bestwordsize", best));
+    fprintf(stdout, "%s\n", write_string(Value(report), true).c_str());
+    return 0;
+}
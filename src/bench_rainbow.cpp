@@ -0,0 +1,112 @@
+// Copyright (c) 2018 The Abcmint developers
+
+// Benchmark of Rainbow signing.
+//
+// Signs -signatures random digests with a fresh key, one rainbow_sign() call
+// per digest and with rainbow_sign_batch(), at each GF(16) instruction set
+// level of the cpu (0 is the u64 library, 1 SSSE3, 2 AVX2), and prints the
+// signing throughput of each as JSON, with the speedup over rainbow_sign() on
+// the u64 library. Every signature is verified after the timing.
+//
+// Usage: bench_rainbow [-signatures=1000]
+
+// malloc.h of pqcrypto/blas.h must come before the malloc of pqcrypt_cfg.h,
+// and rainbow_config.h after the boost headers
+#if defined(__APPLE__) && defined(__MACH__)
+#include <sys/malloc.h>
+#else
+#include <malloc.h>
+#endif
+
+#include "util.h"
+#include "json/json_spirit_writer_template.h"
+#include "json/json_spirit_utils.h"
+
+#include "pqcrypto/rainbow_16.h"
+#include "pqcrypto/hash_len_config.h"
+
+using namespace json_spirit;
+
+struct CBenchSigner
+{
+    std::vector<unsigned char> vchPubKey;
+    std::vector<unsigned char> vchSecKey;
+    std::vector<unsigned char> vchDigests;
+    std::vector<const unsigned char*> vDigests;
+    std::vector<unsigned char> vchSigs;
+};
+
+// signatures per second, -1 if one of them is not valid
+static double BenchSign(CBenchSigner& signer, bool fBatch)
+{
+    unsigned int nSignatures = signer.vDigests.size();
+    int64 nStartMicros = GetTimeMicros();
+    if (fBatch) {
+        if (rainbow_sign_batch(&signer.vchSigs[0], &signer.vchSecKey[0], &signer.vDigests[0], nSignatures) != 0)
+            return -1;
+    } else {
+        for (unsigned int i = 0; i < nSignatures; i++)
+            if (rainbow_sign(&signer.vchSigs[i * _SIGNATURE_BYTE], &signer.vchSecKey[0], signer.vDigests[i]) != 0)
+                return -1;
+    }
+    int64 nMicros = std::max(GetTimeMicros() - nStartMicros, (int64)1);
+
+    for (unsigned int i = 0; i < nSignatures; i++)
+        if (rainbow_verify(signer.vDigests[i], &signer.vchSigs[i * _SIGNATURE_BYTE], &signer.vchPubKey[0]) != 0)
+            return -1;
+    return nSignatures * 1e6 / nMicros;
+}
+
+int main(int argc, char* argv[])
+{
+    ParseParameters(argc, argv);
+    int nSignatures = std::max((int)GetArg("-signatures", 1000), 1);
+
+    CBenchSigner signer;
+    signer.vchPubKey.resize(_PUB_KEY_LEN);
+    signer.vchSecKey.resize(_SEC_KEY_LEN);
+    rainbow_genkey(&signer.vchPubKey[0], &signer.vchSecKey[0]);
+    signer.vchDigests.resize(nSignatures * _HASH_LEN);
+    for (int i = 0; i < nSignatures; i++) {
+        uint256 hash = GetRandHash();
+        memcpy(&signer.vchDigests[i * _HASH_LEN], &hash, std::min(sizeof(hash), (size_t)_HASH_LEN));
+        signer.vDigests.push_back(&signer.vchDigests[i * _HASH_LEN]);
+    }
+    signer.vchSigs.resize(nSignatures * _SIGNATURE_BYTE);
+
+    Array results;
+    double dBaseRate = 0;
+#ifdef _BLAS_SIMD_
+    unsigned int nSupported = gf16_simd_supported();
+#else
+    unsigned int nSupported = 0;
+#endif
+    for (unsigned int nLevel = 0; nLevel <= nSupported; nLevel++) {
+#ifdef _BLAS_SIMD_
+        gf16_simd_set_level(nLevel);
+#endif
+        for (int nBatch = 0; nBatch < 2; nBatch++) {
+            double dRate = BenchSign(signer, nBatch);
+            if (dRate < 0) {
+                fprintf(stderr, "bench_rainbow: invalid signature at level %u\n", nLevel);
+                return 1;
+            }
+            if (nLevel == 0 && !nBatch)
+                dBaseRate = dRate;
+
+            Object result;
+            result.push_back(Pair("level", (int)nLevel));
+            result.push_back(Pair("batch", nBatch != 0));
+            result.push_back(Pair("signaturespersec", dRate));
+            result.push_back(Pair("microspersignature", 1e6 / dRate));
+            result.push_back(Pair("speedup", dRate / dBaseRate));
+            results.push_back(result);
+        }
+    }
+
+    Object report;
+    report.push_back(Pair("signatures", nSignatures));
+    report.push_back(Pair("results", results));
+    fprintf(stdout, "%s\n", write_string(Value(report), true).c_str());
+    return 0;
+}
@@ -147,6 +147,163 @@ bool GetPubKeyByPos(CDiskPubKeyPos pos, CPubKey& pubKey)
     return true;
 }
 
+// crafted keys sharing their first bytes cannot make a lookup compare more keys
+static const unsigned int MAX_PUBKEY_CACHE_PREFIX_ENTRIES = 4;
+
+CPubKeyCache pubKeyCache;
+
+static uint256 PubKeyPrefix(const unsigned char* pch)
+{
+    uint256 prefix;
+    memcpy(prefix.begin(), pch, sizeof(prefix));
+    return prefix;
+}
+
+CPubKeyCache::CPubKeyCache() : nMaxEntries(0)
+{
+}
+
+void CPubKeyCache::SetMaxSize(uint64 nMaxBytes)
+{
+    LOCK(cs);
+    nMaxEntries = nMaxBytes / RAINBOW_PUBLIC_KEY_SIZE;
+    while (listEntries.size() > nMaxEntries)
+        Erase(--listEntries.end());
+}
+
+CPubKeyCache::entries_type::iterator CPubKeyCache::FindEntry(const std::vector<unsigned char>& vchPubKey)
+{
+    if (vchPubKey.size() != RAINBOW_PUBLIC_KEY_SIZE)
+        return listEntries.end();
+
+    typedef std::multimap<uint256, entries_type::iterator>::iterator prefix_iterator;
+    std::pair<prefix_iterator, prefix_iterator> range = mapByPrefix.equal_range(PubKeyPrefix(&vchPubKey[0]));
+    for (prefix_iterator mi = range.first; mi != range.second; ++mi) {
+        entries_type::iterator it = mi->second;
+        if (memcmp(it->pubkey->begin(), &vchPubKey[0], RAINBOW_PUBLIC_KEY_SIZE) == 0) {
+            listEntries.splice(listEntries.begin(), listEntries, it);
+            return it;
+        }
+    }
+    return listEntries.end();
+}
+
+void CPubKeyCache::Insert(const CSharedPubKeyRef& pubkey)
+{
+    uint256 prefix = PubKeyPrefix(pubkey->begin());
+    if (mapByPrefix.count(prefix) >= MAX_PUBKEY_CACHE_PREFIX_ENTRIES)
+        Erase(mapByPrefix.find(prefix)->second);
+    while (!listEntries.empty() && listEntries.size() >= nMaxEntries)
+        Erase(--listEntries.end());
+
+    CEntry entry;
+    entry.pubkey = pubkey;
+    listEntries.push_front(entry);
+    mapByPrefix.insert(std::make_pair(prefix, listEntries.begin()));
+}
+
+void CPubKeyCache::Erase(entries_type::iterator it)
+{
+    typedef std::multimap<uint256, entries_type::iterator>::iterator prefix_iterator;
+    std::pair<prefix_iterator, prefix_iterator> range = mapByPrefix.equal_range(PubKeyPrefix(it->pubkey->begin()));
+    for (prefix_iterator mi = range.first; mi != range.second; ++mi) {
+        if (mi->second == it) {
+            mapByPrefix.erase(mi);
+            break;
+        }
+    }
+    BOOST_FOREACH(const CDiskPubKeyPos& pos, it->vPos)
+        mapByPos.erase(pos);
+    listEntries.erase(it);
+}
+
+CSharedPubKeyRef CPubKeyCache::Find(const std::vector<unsigned char>& vchPubKey)
+{
+    LOCK(cs);
+    entries_type::iterator it = FindEntry(vchPubKey);
+    if (it == listEntries.end())
+        return CSharedPubKeyRef();
+    return it->pubkey;
+}
+
+CSharedPubKeyRef CPubKeyCache::Add(const std::vector<unsigned char>& vchPubKey)
+{
+    if (vchPubKey.size() != RAINBOW_PUBLIC_KEY_SIZE)
+        return CSharedPubKeyRef();
+
+    {
+        LOCK(cs);
+        entries_type::iterator it = FindEntry(vchPubKey);
+        if (it != listEntries.end())
+            return it->pubkey;
+    }
+
+    // hash and copy the key outside of the lock
+    CSharedPubKeyRef pubkey(new CSharedPubKey(vchPubKey, CKeyID(Hash(vchPubKey.begin(), vchPubKey.end()))));
+
+    LOCK(cs);
+    if (nMaxEntries == 0)
+        return pubkey;
+    // another thread may have added it meanwhile
+    entries_type::iterator it = FindEntry(vchPubKey);
+    if (it != listEntries.end())
+        return it->pubkey;
+    Insert(pubkey);
+    return pubkey;
+}
+
+CSharedPubKeyRef CPubKeyCache::GetByPos(const CDiskPubKeyPos& pos)
+{
+    {
+        LOCK(cs);
+        std::map<CDiskPubKeyPos, entries_type::iterator>::iterator mi = mapByPos.find(pos);
+        if (mi != mapByPos.end()) {
+            listEntries.splice(listEntries.begin(), listEntries, mi->second);
+            return mi->second->pubkey;
+        }
+    }
+
+    CPubKey pubKey;
+    if (!GetPubKeyByPos(pos, pubKey))
+        return CSharedPubKeyRef();
+    CSharedPubKeyRef pubkey = Add(pubKey.vchPubKey);
+
+    LOCK(cs);
+    entries_type::iterator it = FindEntry(pubKey.vchPubKey);
+    if (it != listEntries.end() && !mapByPos.count(pos)) {
+        it->vPos.push_back(pos);
+        mapByPos.insert(std::make_pair(pos, it));
+    }
+    return pubkey;
+}
+
+CSharedPubKeyRef CPubKeyCache::FindByPos(const CDiskPubKeyPos& pos)
+{
+    LOCK(cs);
+    std::map<CDiskPubKeyPos, entries_type::iterator>::iterator mi = mapByPos.find(pos);
+    if (mi == mapByPos.end())
+        return CSharedPubKeyRef();
+    listEntries.splice(listEntries.begin(), listEntries, mi->second);
+    return mi->second->pubkey;
+}
+
+void CPubKeyCache::ErasePositions(unsigned int nHeight)
+{
+    LOCK(cs);
+    std::map<CDiskPubKeyPos, entries_type::iterator>::iterator mi = mapByPos.lower_bound(CDiskPubKeyPos(nHeight, 0));
+    while (mi != mapByPos.end()) {
+        std::vector<CDiskPubKeyPos>& vPos = mi->second->vPos;
+        vPos.erase(std::remove(vPos.begin(), vPos.end(), mi->first), vPos.end());
+        mapByPos.erase(mi++);
+    }
+}
+
+unsigned int CPubKeyCache::size()
+{
+    LOCK(cs);
+    return listEntries.size();
+}
+
 bool UpdatePubKeyPos(CPubKey& pubKey, const std::string& address)
 {
     CDiskPubKeyPos pos;
@@ -3,10 +3,13 @@
 #ifndef ABCMINT_DISKPUBKEYPOS_H
 #define ABCMINT_DISKPUBKEYPOS_H
 
+#include <list>
+#include <map>
 #include <vector>
 #include <boost/thread.hpp>
 #include "key.h"
 #include "serialize.h"
+#include "sync.h"
 
 
 
@@ -48,6 +51,10 @@ public:
         return !(a == b);
     }
 
+    friend bool operator<(const CDiskPubKeyPos &a, const CDiskPubKeyPos &b) {
+        return (a.nHeight < b.nHeight || (a.nHeight == b.nHeight && a.nPubKeyOffset < b.nPubKeyOffset));
+    }
+
     CDiskPubKeyPos& operator<<(const std::vector<unsigned char>& v)
     {
         if (v.size() < RAINBOW_PUBLIC_KEY_POS_SIZE) {
@@ -97,6 +104,61 @@ public:
 
 bool GetPubKeyByPos(CDiskPubKeyPos pos, CPubKey& pubKey);
 
+/** Least recently used public keys of the scripts, shared by the script
+ *  checks instead of a copy of the key per input. A key is found by its
+ *  content or by its position in the block chain, and is hashed only once,
+ *  when it is added.
+ */
+class CPubKeyCache
+{
+private:
+    struct CEntry
+    {
+        CSharedPubKeyRef pubkey;
+        std::vector<CDiskPubKeyPos> vPos;
+    };
+    typedef std::list<CEntry> entries_type;
+
+    // most recently used first
+    entries_type listEntries;
+    // by the first bytes of the key, checked against the whole key
+    std::multimap<uint256, entries_type::iterator> mapByPrefix;
+    std::map<CDiskPubKeyPos, entries_type::iterator> mapByPos;
+    unsigned int nMaxEntries;
+    CCriticalSection cs;
+
+    entries_type::iterator FindEntry(const std::vector<unsigned char>& vchPubKey);
+    void Insert(const CSharedPubKeyRef& pubkey);
+    void Erase(entries_type::iterator it);
+
+public:
+    CPubKeyCache();
+
+    // The cache holds nMaxBytes of keys at most, 0 disables it
+    void SetMaxSize(uint64 nMaxBytes);
+
+    // The cached key equal to vchPubKey, NULL if not cached
+    CSharedPubKeyRef Find(const std::vector<unsigned char>& vchPubKey);
+
+    // The key equal to vchPubKey with its id, cached if it was not.
+    // NULL if vchPubKey has not the size of a public key
+    CSharedPubKeyRef Add(const std::vector<unsigned char>& vchPubKey);
+
+    // The key at pos, read from the block files if not cached. NULL if it
+    // cannot be read
+    CSharedPubKeyRef GetByPos(const CDiskPubKeyPos& pos);
+
+    // The cached key at pos, NULL if not cached
+    CSharedPubKeyRef FindByPos(const CDiskPubKeyPos& pos);
+
+    // Forget the positions from nHeight up, when the block is disconnected
+    void ErasePositions(unsigned int nHeight);
+
+    unsigned int size();
+};
+
+extern CPubKeyCache pubKeyCache;
+
 bool UpdatePubKeyPos(CPubKey& pubKey, const std::string& address);
 
 void SearchPubKeyPos(bool fScan);
@@ -21,41 +21,6 @@ static const char*        BALANCE_BUSINESS      = "deposit";
 static MYSQL mysql;
 static std::map<unsigned int, CKeyID> depositKeyIdMap;
 
-void KeyPoolFiller()
-{
-    printf("exchange, KeyPoolFiller started\n");
-    RenameThread("KeyPoolFiller");
-    SetThreadPriority(THREAD_PRIORITY_NORMAL);
-
-    unsigned int nTargetSize = GetArg("-keypool", KEY_POOL_SIZE);
-    try {
-        while (true) {
-            if (pwalletMain->setKeyPool.size() < nTargetSize/2) {
-                if (pwalletMain->IsLocked()) {
-                    //getnewaddress will return new address, but maybe timeout
-                    //consider how to handle this error
-                    printf("error: please unlock the wallet for key pool filling!\n");
-                }
-                pwalletMain->TopUpKeyPool(true);
-
-            } else
-                MilliSleep(10*1000);//sleep a loog while if the key pool still have a lot, 10 minutes
-        }
-    }
-    catch (boost::thread_interrupted)
-    {
-        printf("exchange, FillKeyPool terminated\n");
-        throw;
-    }
-}
-
-void FillKeyPool(boost::thread_group& threadGroup)
-{
-    //use boost thread group, so that this thread can exit together with other thread when press ctrl+c
-    threadGroup.create_thread(boost::bind(&KeyPoolFiller));
-}
-
-
 MYSQL *ConnectMysql()
 {
     MYSQL *conn = mysql_init(&mysql);
@@ -38,7 +38,6 @@ static std::map<uint256, value_type> chargeMap;
 MYSQL *ConnectMysql();
 bool LoadDepositAddress();
 bool UpdateMysqlBalance(CBlock *block, bool add);
-void FillKeyPool(boost::thread_group& threadGroup);
 void UpdateBalance(boost::thread_group& threadGroup);
 void ScanAddress(boost::thread_group& threadGroup);
 
@@ -97,6 +97,11 @@ void Shutdown()
 
     RenameThread("abcmint-shutoff");
     nTransactionsUpdated++;
+    {
+        // wake up the long-polling RPC calls
+        boost::lock_guard<boost::mutex> lock(csBestBlock);
+        cvBlockChange.notify_all();
+    }
     StopRPCThreads();
     bitdb.Flush(false);
     StopNode();
@@ -298,9 +303,16 @@ std::string HelpMessage()
         "  -conf=<file>           " + _("Specify configuration file (default: abcmint.conf)") + "\n" +
         "  -pid=<file>            " + _("Specify pid file (default: abcmint.pid)") + "\n" +
         "  -gen                   " + _("Generate coins (default: 0)") + "\n" +
+        "  -minercancelinterval=<n> " + _("Check for new work every <n> chunks of 512 candidates while generating, rounded up to a power of two (default: 1)") + "\n" +
+        "  -minerwordsize=<n>     " + _("Enumerate <n> equations at once while generating: 16, 32 or 64 (default: chosen from the difficulty)") + "\n" +
+        "  -minerthreadaffinity   " + _("Pin the generating threads to cpus, spread over the NUMA nodes (default: 0)") + "\n" +
+        "  -minerhugepages        " + _("Back the memory of the generating threads with huge pages when available (default: 0)") + "\n" +
+        "  -minersolver=<solver>  " + _("Solve the equations by enum (enumeration) or fft (Moebius transform, up to 24 variables per thread) while generating (default: auto, the faster one on this machine)") + "\n" +
         "  -search                " + _("Search public key position (default: 1)") + "\n" +
         "  -datadir=<dir>         " + _("Specify data directory") + "\n" +
         "  -dbcache=<n>           " + _("Set database cache size in megabytes (default: 25)") + "\n" +
+        "  -maxsigcachesize=<n>   " + _("Keep up to <n> verified signatures in memory (default: 500000)") + "\n" +
+        "  -pubkeycachesize=<n>   " + _("Keep up to <n> megabytes of public keys used by the scripts in memory (default: 32)") + "\n" +
         "  -timeout=<n>           " + _("Specify connection timeout in milliseconds (default: 5000)") + "\n" +
         "  -proxy=<ip:port>       " + _("Connect through socks proxy") + "\n" +
         "  -socks=<n>             " + _("Select the version of socks proxy to use (4-5, default: 5)") + "\n" +
@@ -357,14 +369,18 @@ std::string HelpMessage()
         "  -walletnotify=<cmd>    " + _("Execute command when a wallet transaction changes (%s in cmd is replaced by TxID)") + "\n" +
         "  -alertnotify=<cmd>     " + _("Execute command when a relevant alert is received (%s in cmd is replaced by message)") + "\n" +
         "  -upgradewallet         " + _("Upgrade wallet to latest format") + "\n" +
+        "  -keypool=<n>           " + _("Set key pool size to <n> (default: 100)") + "\n" +
+        "  -keypoolmin=<n>        " + _("Refill the key pool in the background when it has less than <n> keys (default: half of -keypool)") + "\n" +
         "  -rescan                " + _("Rescan the block chain for missing wallet transactions") + "\n" +
         "  -salvagewallet         " + _("Attempt to recover private keys from a corrupt wallet.dat") + "\n" +
         "  -checkblocks=<n>       " + _("How many blocks to check at startup (default: 288, 0 = all)") + "\n" +
         "  -checklevel=<n>        " + _("How thorough the block verification is (0-4, default: 3)") + "\n" +
+        "  -checkindexpow         " + _("Check the proof of work of block index entries already verified (default: 1)") + "\n" +
         "  -txindex               " + _("Maintain a full transaction index (default: 0)") + "\n" +
         "  -loadblock=<file>      " + _("Imports blocks from external blk000??.dat file") + "\n" +
         "  -reindex               " + _("Rebuild block chain index from current blk000??.dat files") + "\n" +
         "  -par=<n>               " + _("Set the number of script verification threads (up to 16, 0 = auto, <0 = leave that many cores free, default: 0)") + "\n" +
+        "  -maxpowcachesize=<n>   " + _("Keep at most <n> verified block proofs of work in memory (default: 100000)") + "\n" +
 
         "\n" + _("Block creation options:") + "\n" +
         "  -blockminsize=<n>      "   + _("Set minimum block size in bytes (default: 0)") + "\n" +
@@ -895,6 +911,7 @@ bool AppInit2(boost::thread_group& threadGroup)
     size_t nCoinDBCache = nTotalCache / 2; // use half of the remaining cache for coindb cache
     nTotalCache -= nCoinDBCache;
     nCoinCacheSize = nTotalCache / 300; // coins in memory require around 300 bytes
+    pubKeyCache.SetMaxSize((uint64)std::max(GetArg("-pubkeycachesize", 32), (int64)0) << 20);
 
     bool fLoaded = false;
     while (!fLoaded) {
@@ -1082,8 +1099,8 @@ bool AppInit2(boost::thread_group& threadGroup)
     //seach block position for public key  in the background
     //SearchPubKeyPos(GetBoolArg("-search", true));
 
-    //refill key pool
-    FillKeyPool(threadGroup);
+    //refill key pool, for every wallet
+    threadGroup.create_thread(boost::bind(&ThreadKeyPoolFiller, pwalletMain));
 
     UpdateBalance(threadGroup);
 
@@ -52,17 +52,73 @@ bool CKey::SetPrivKey(const CPrivKey& vchPrivKey)
     return true;
 }
 
-bool CPubKey::Verify(uint256 hash, const std::vector<unsigned char>& vchSig)
+static bool VerifyRainbow(const unsigned char* pk, uint256 hash, const std::vector<unsigned char>& vchSig)
 {
     if (vchSig.empty()) return false;
     int status = -1;
-    status = rainbow_verify((unsigned char*)&hash, &vchSig[0], vchPubKey.data());
+    status = rainbow_verify((unsigned char*)&hash, &vchSig[0], pk);
     if (status != 0) {
         return false;
     }
     return true;
 }
 
+static bool VerifyRainbowBatch(const unsigned char* pk, const std::vector<uint256>& vHash, const std::vector<std::vector<unsigned char> >& vvchSig)
+{
+    if (vHash.size() != vvchSig.size()) return false;
+    std::vector<const unsigned char*> vDigest, vSig;
+    vDigest.reserve(vHash.size());
+    vSig.reserve(vvchSig.size());
+    for (unsigned int i = 0; i < vHash.size(); i++) {
+        if (vvchSig[i].size() < RAINBOW_SIGNATURE_SIZE) return false;
+        vDigest.push_back((const unsigned char*)&vHash[i]);
+        vSig.push_back(&vvchSig[i][0]);
+    }
+    if (vSig.empty()) return true;
+    int status = rainbow_verify_batch(pk, &vDigest[0], &vSig[0], vSig.size());
+    if (status != 0) {
+        return false;
+    }
+    return true;
+}
+
+bool CPubKey::Verify(uint256 hash, const std::vector<unsigned char>& vchSig)
+{
+    return VerifyRainbow(vchPubKey.data(), hash, vchSig);
+}
+
+bool CPubKey::VerifyBatch(const std::vector<uint256>& vHash, const std::vector<std::vector<unsigned char> >& vvchSig)
+{
+    return VerifyRainbowBatch(vchPubKey.data(), vHash, vvchSig);
+}
+
+CSharedPubKey::CSharedPubKey(const std::vector<unsigned char>& vchPubKey, const CKeyID& idIn) : pchAlloc(NULL), pch(NULL), fValid(false), id(idIn)
+{
+    if (vchPubKey.size() != RAINBOW_PUBLIC_KEY_SIZE)
+        return;
+
+    pchAlloc = new unsigned char[RAINBOW_PUBLIC_KEY_SIZE + 63];
+    pch = pchAlloc + ((64 - ((size_t)pchAlloc & 63)) & 63);
+    memcpy(pch, &vchPubKey[0], RAINBOW_PUBLIC_KEY_SIZE);
+    for (size_t i = 0; i < RAINBOW_PUBLIC_KEY_SIZE && !fValid; i++)
+        fValid = (pch[i] != '\0');
+}
+
+CSharedPubKey::~CSharedPubKey()
+{
+    delete[] pchAlloc;
+}
+
+bool CSharedPubKey::Verify(uint256 hash, const std::vector<unsigned char>& vchSig) const
+{
+    return fValid && VerifyRainbow(pch, hash, vchSig);
+}
+
+bool CSharedPubKey::VerifyBatch(const std::vector<uint256>& vHash, const std::vector<std::vector<unsigned char> >& vvchSig) const
+{
+    return fValid && VerifyRainbowBatch(pch, vHash, vvchSig);
+}
+
 bool CKey::SetPubKey(const CPubKey& vchPubKey)
 {
     const unsigned char* pbegin = &vchPubKey.vchPubKey[0];
@@ -6,6 +6,8 @@
 #include <stdexcept>
 #include <vector>
 
+#include <boost/shared_ptr.hpp>
+
 #include "allocators.h"
 #include "serialize.h"
 #include "uint256.h"
@@ -130,11 +132,49 @@ public:
 
     bool Verify(uint256 hash, const std::vector<unsigned char>& vchSig);
 
+    // Verify the signatures of several hashes with one pass over the key, true if all are valid
+    bool VerifyBatch(const std::vector<uint256>& vHash, const std::vector<std::vector<unsigned char> >& vvchSig);
+
     std::vector<unsigned char> Raw() const {
         return vchPubKey;
     }
 };
 
+/** A validated public key, immutable and shared between the scripts and
+ *  threads using it (see CPubKeyCache). The key is 64-byte aligned for the
+ *  verification kernels.
+ */
+class CSharedPubKey
+{
+private:
+    unsigned char *pchAlloc;
+    unsigned char *pch;
+    bool fValid;
+    CKeyID id;
+
+    CSharedPubKey(const CSharedPubKey&);
+    CSharedPubKey& operator=(const CSharedPubKey&);
+
+public:
+    // idIn is Hash() of the key when known, the id stays zero otherwise
+    explicit CSharedPubKey(const std::vector<unsigned char>& vchPubKey, const CKeyID& idIn = CKeyID());
+    ~CSharedPubKey();
+
+    // true when the key has not the size of a public key
+    bool IsNull() const { return pch == NULL; }
+    // false when the key is not a valid public key, as in CPubKey::IsValid
+    bool IsValid() const { return fValid; }
+
+    const unsigned char* begin() const { return pch; }
+    const unsigned char* end() const { return pch + RAINBOW_PUBLIC_KEY_SIZE; }
+    const CKeyID& GetID() const { return id; }
+
+    bool Verify(uint256 hash, const std::vector<unsigned char>& vchSig) const;
+    bool VerifyBatch(const std::vector<uint256>& vHash, const std::vector<std::vector<unsigned char> >& vvchSig) const;
+};
+
+typedef boost::shared_ptr<const CSharedPubKey> CSharedPubKeyRef;
+
 
 // secure_allocator is defined in allocators.h
 // CPrivKey is a serialized private key, with all parameters included
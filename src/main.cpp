@@ -44,6 +44,8 @@ uint64 nBestInvalidWork = 0;
 uint256 hashBestChain = 0;
 uint256 gInitHash = 0;
 CBlockIndex* pindexBest = NULL;
+boost::mutex csBestBlock;
+boost::condition_variable cvBlockChange; // notified with csBestBlock when pindexBest changes, for long-polling
 set<CBlockIndex*, CBlockIndexWorkComparator> setBlockIndexValid; // may contain all CBlockIndex*'s that have validness >=BLOCK_VALID_TRANSACTIONS, and must contain those who aren't failed
 int64 nTimeBestReceived = 0;
 int nScriptCheckThreads = 0;
@@ -830,6 +832,7 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTransaction &tx)
         for (unsigned int i = 0; i < tx.vin.size(); i++)
             mapNextTx[tx.vin[i].prevout] = CInPoint(&mapTx[hash], i);
         nTransactionsUpdated++;
+        MinerTransactionsUpdated();
     }
     return true;
 }
@@ -1049,14 +1052,15 @@ CBlockIndex* FindBlockByHeight(int nHeight)
 
 bool CBlock::ReadFromDisk(const CBlockIndex* pindex)
 {
-    if (!ReadFromDisk(pindex->GetBlockPos()))
+    // the header of a block index entry with a verified PoW only needs to match it
+    if (!ReadFromDisk(pindex->GetBlockPos(), !(pindex->nStatus & BLOCK_POW_VERIFIED)))
         return false;
     if (GetHash() != pindex->GetBlockHash())
         return error("CBlock::ReadFromDisk() : GetHash() doesn't match index");
     return true;
 }
 
-bool CBlock::ReadFromDisk(const CDiskBlockPos &pos)
+bool CBlock::ReadFromDisk(const CDiskBlockPos &pos, bool fCheckPOW)
 {
     SetNull();
 
@@ -1074,10 +1078,12 @@ bool CBlock::ReadFromDisk(const CDiskBlockPos &pos)
     }
 
     // Check the header
-    uint256 tempHash = hashPrevBlock ^ hashMerkleRoot;
-    uint256 seedHash = Hash(BEGIN(tempHash), END(tempHash));
-    if (!CheckProofOfWork(seedHash, nBits, hashPrevBlock, nVersion, nNonce))
-        return error("CBlock::ReadFromDisk() : errors in block header");
+    if (fCheckPOW) {
+        uint256 tempHash = hashPrevBlock ^ hashMerkleRoot;
+        uint256 seedHash = Hash(BEGIN(tempHash), END(tempHash));
+        if (!CheckProofOfWork(seedHash, nBits, hashPrevBlock, nVersion, nNonce))
+            return error("CBlock::ReadFromDisk() : errors in block header");
+    }
 
     return true;
 }
@@ -1085,17 +1091,17 @@ bool CBlock::ReadFromDisk(const CDiskBlockPos &pos)
 
 bool CBlockIndex::CheckIndex() const
 {
-    if (pprev) {
-        uint256 tempHash = pprev->GetBlockHash() ^ hashMerkleRoot;
-        uint256 seedHash = Hash(BEGIN(tempHash), END(tempHash));
-        return CheckProofOfWork(seedHash, nBits, pprev->GetBlockHash(), nVersion, nNonce);
-    }
-    else {
-        uint256 initHash = 0;
-        uint256 tempHash = initHash ^ hashMerkleRoot;
-        uint256 seedHash = Hash(BEGIN(tempHash), END(tempHash));
-        return CheckProofOfWork(seedHash, nBits, initHash, nVersion, nNonce);
-    }
+    return CheckIndex(UseNewCoeffMatrix(pprev ? pprev->nHeight+1 : 0));
+}
+
+// Same as CheckIndex(), with the coefficient rule given instead of found from
+// the height of pprev, so that it does not depend on the rest of the index.
+bool CBlockIndex::CheckIndex(bool fNewCoeffMatrix) const
+{
+    uint256 prevHash = pprev ? pprev->GetBlockHash() : 0;
+    uint256 tempHash = prevHash ^ hashMerkleRoot;
+    uint256 seedHash = Hash(BEGIN(tempHash), END(tempHash));
+    return CheckProofOfWork(seedHash, nBits, fNewCoeffMatrix, nVersion, nNonce);
 }
 
 uint256 GetOrphanRoot(const CBlockHeader* pblock)
@@ -1293,10 +1299,44 @@ bool CTransaction::HaveInputs(CCoinsViewCache &inputs) const
     return true;
 }
 
-bool CScriptCheck::operator()() const {
+bool CScriptCheck::operator()(CSignatureBatch *pbatch) const {
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
-    if (!VerifyScript(scriptSig, scriptPubKey, *ptxTo, nIn, nFlags, nHashType))
+    if (!VerifyScript(scriptSig, scriptPubKey, *ptxTo, nIn, nFlags, nHashType, false, pbatch)) {
+        if (pbatch)
+            return false;
         return error("CScriptCheck() : %s VerifyScript failed", ptxTo->GetHash().ToString().c_str());
+    }
+    return true;
+}
+
+// Evaluate vChecks with their signatures deferred into batch and verified
+// together, so that the signatures of one public key take a single pass over
+// the key. True if all of them passed
+static bool RunScriptChecksBatched(const std::vector<CScriptCheck> &vChecks, CSignatureBatch &batch)
+{
+    bool fScriptsOk = true;
+    for (unsigned int i = 0; i < vChecks.size() && fScriptsOk; i++)
+        fScriptsOk = vChecks[i](&batch);
+    // verified even after a failed script, for RunScriptChecks() to reuse
+    bool fSigsOk = batch.Verify();
+    return fScriptsOk && fSigsOk;
+}
+
+// Evaluate vChecks one at a time and find the first one to fail. The
+// signatures already verified by batch are not verified again
+static bool RunScriptChecks(CValidationState &state, const std::vector<CScriptCheck> &vChecks, CSignatureBatch *pbatch)
+{
+    BOOST_FOREACH(const CScriptCheck &check, vChecks) {
+        if (check(pbatch))
+            continue;
+        if (check.GetFlags() & SCRIPT_VERIFY_STRICTENC) {
+            // For now, check whether the failure was caused by non-canonical
+            // encodings or not; if so, don't trigger DoS protection.
+            if (check.WithFlags(check.GetFlags() & ~SCRIPT_VERIFY_STRICTENC)(pbatch))
+                return state.Invalid();
+        }
+        return state.DoS(100,false);
+    }
     return true;
 }
 
@@ -1354,25 +1394,28 @@ bool CTransaction::CheckInputs(CValidationState &state, CCoinsViewCache &inputs,
         // before the last block chain checkpoint. This is safe because block merkle hashes are
         // still computed and checked, and any change will be caught at the next checkpoint.
         if (fScriptChecks) {
+            std::vector<CScriptCheck> vChecks;
+            std::vector<CScriptCheck> &vChecksOut = pvChecks ? *pvChecks : vChecks;
             for (unsigned int i = 0; i < vin.size(); i++) {
                 const COutPoint &prevout = vin[i].prevout;
                 const CCoins &coins = inputs.GetCoins(prevout.hash);
 
                 // Verify signature
                 CScriptCheck check(coins, (CTransaction *)this, i, flags, 0);
-                if (pvChecks) {
-                    pvChecks->push_back(CScriptCheck());
-                    check.swap(pvChecks->back());
-                } else if (!check()) {
-                    if (flags & SCRIPT_VERIFY_STRICTENC) {
-                        // For now, check whether the failure was caused by non-canonical
-                        // encodings or not; if so, don't trigger DoS protection.
-                        CScriptCheck check(coins, (CTransaction *)this, i, flags & (~SCRIPT_VERIFY_STRICTENC), 0);
-                        if (check())
-                            return state.Invalid();
-                    }
-                    return state.DoS(100,false);
-                }
+                vChecksOut.push_back(CScriptCheck());
+                check.swap(vChecksOut.back());
+            }
+
+            // Without pvChecks, the inputs sharing a public key are verified with one
+            // pass over the key. A failure is found by evaluating the scripts again, one
+            // at a time, with the results of the batch; vPubKeys is filled again by them.
+            if (!pvChecks) {
+                CSignatureBatch batch;
+                size_t nPubKeys = vPubKeys.size();
+                if (RunScriptChecksBatched(vChecks, batch))
+                    return true;
+                ((CTransaction *)this)->vPubKeys.resize(nPubKeys);
+                return RunScriptChecks(state, vChecks, &batch);
             }
         }
     }
@@ -1462,6 +1505,9 @@ bool CBlock::DisconnectBlock(CValidationState &state, CBlockIndex *pindex, CCoin
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev);
 
+    // the public keys of this block may be at other positions on the new chain
+    pubKeyCache.ErasePositions(pindex->nHeight);
+
     //minus balance in mysql, , don't care the return value, if failed, will re-do in charge thread
     UpdateMysqlBalance(this, false);
 
@@ -1554,6 +1600,9 @@ bool CBlock::ConnectBlock(CValidationState &state, CBlockIndex* pindex, CCoinsVi
     CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(vtx.size()));
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(vtx.size());
+    // The scripts of the whole block, evaluated once all transactions are connected
+    // so that the signatures of a public key are verified together across them
+    std::vector<CScriptCheck> vChecks;
     for (unsigned int i=0; i<vtx.size(); i++)
     {
         CTransaction &tx = vtx[i];
@@ -1578,7 +1627,7 @@ bool CBlock::ConnectBlock(CValidationState &state, CBlockIndex* pindex, CCoinsVi
 
             nFees += tx.GetValueIn(view)-tx.GetValueOut();
 
-            if (!tx.CheckInputs(state, view, fScriptChecks, flags, NULL))
+            if (!tx.CheckInputs(state, view, fScriptChecks, flags, fScriptChecks ? &vChecks : NULL))
                 return false;
         }
 
@@ -1597,6 +1646,15 @@ bool CBlock::ConnectBlock(CValidationState &state, CBlockIndex* pindex, CCoinsVi
     if (vtx[0].GetValueOut() > GetBlockValue(pindex->nHeight, nFees) && GetHash() != hashGenesisBlock)
         return state.DoS(100, error("ConnectBlock() : coinbase pays too much (actual=%" PRI64d " vs limit=%" PRI64d ")", vtx[0].GetValueOut(), GetBlockValue(pindex->nHeight, nFees)));
 
+    CSignatureBatch batch;
+    if (!RunScriptChecksBatched(vChecks, batch)) {
+        // vPubKeys of every transaction is filled again while finding the failed script
+        for (unsigned int i=0; i<vtx.size(); i++)
+            vtx[i].vPubKeys.clear();
+        if (!RunScriptChecks(state, vChecks, &batch))
+            return error("ConnectBlock() : script check failed");
+    }
+
     int64 nTime2 = GetTimeMicros() - nStart;
     if (fBenchmark)
         printf("- Verify %u txins: %.2fms (%.3fms/txin)\n", nInputs - 1, 0.001 * nTime2, nInputs <= 1 ? 0 : 0.001 * nTime2 / (nInputs-1));
@@ -1788,6 +1846,11 @@ bool SetBestChain(CValidationState &state, CBlockIndex* pindexNew)
     nBestChainWork = pindexNew->nChainWork;
     nTimeBestReceived = GetTime();
     nTransactionsUpdated++;
+    AdvanceMinerEpoch(true);
+    {
+        boost::lock_guard<boost::mutex> lock(csBestBlock);
+        cvBlockChange.notify_all();
+    }
     printf("SetBestChain: new best=%s  height=%d  work=%llu  tx=%lu  date=%s progress=%f\n",
       hashBestChain.ToString().c_str(), nBestHeight, nBestChainWork, (unsigned long)pindexNew->nChainTx,
       DateTimeStrFormat("%Y-%m-%d %H:%M:%S", pindexBest->GetBlockTime()).c_str(),
@@ -1847,7 +1910,7 @@ bool CBlock::AddToBlockIndex(CValidationState &state, const CDiskBlockPos &pos)
     pindexNew->nFile = pos.nFile;
     pindexNew->nDataPos = pos.nPos;
     pindexNew->nUndoPos = 0;
-    pindexNew->nStatus = BLOCK_VALID_TRANSACTIONS | BLOCK_HAVE_DATA;
+    pindexNew->nStatus = BLOCK_VALID_TRANSACTIONS | BLOCK_HAVE_DATA | BLOCK_POW_VERIFIED;
     setBlockIndexValid.insert(pindexNew);
 
     if (!pblocktree->WriteBlockIndex(CDiskBlockIndex(pindexNew)))
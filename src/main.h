@@ -76,6 +76,8 @@ extern uint64 nBestInvalidWork;
 extern uint256 hashBestChain;
 extern CBlockIndex* pindexBest;
 extern unsigned int nTransactionsUpdated;
+extern boost::mutex csBestBlock;
+extern boost::condition_variable cvBlockChange;
 extern const std::string strMessageMagic;
 extern double dHashesPerSec;
 extern int64 nHPSTimerStart;
@@ -1066,7 +1068,17 @@ public:
         scriptPubKey(txFromIn.vout[txToIn->vin[nInIn].prevout.n].scriptPubKey),
         ptxTo(txToIn), nIn(nInIn), nFlags(nFlagsIn), nHashType(nHashTypeIn) { }
 
-    bool operator()() const;
+    // With pbatch, OP_CHECKSIG signatures are deferred to pbatch->Verify()
+    bool operator()(CSignatureBatch *pbatch = NULL) const;
+
+    unsigned int GetFlags() const { return nFlags; }
+
+    // The same check under other flags
+    CScriptCheck WithFlags(unsigned int nFlagsIn) const {
+        CScriptCheck check(*this);
+        check.nFlags = nFlagsIn;
+        return check;
+    }
 
     void swap(CScriptCheck &check) {
         scriptPubKey.swap(check.scriptPubKey);
@@ -1341,11 +1353,15 @@ public:
         int j = 0;
         for (int nSize = vtx.size(); nSize > 1; nSize = (nSize + 1) / 2)
         {
-            for (int i = 0; i < nSize; i += 2)
+            // The pairs of a level are adjacent 64 byte blocks, hash them all in one batch
+            int nPairs = nSize / 2;
+            vMerkleTree.resize(j + nSize + (nSize + 1) / 2);
+            sha256D64((unsigned char*)&vMerkleTree[j+nSize], (const unsigned char*)&vMerkleTree[j], nPairs);
+            if (nSize & 1)
             {
-                int i2 = std::min(i+1, nSize-1);
-                vMerkleTree.push_back(Hash(BEGIN(vMerkleTree[j+i]),  END(vMerkleTree[j+i]),
-                                           BEGIN(vMerkleTree[j+i2]), END(vMerkleTree[j+i2])));
+                int i = nSize - 1;
+                vMerkleTree[j+nSize+nPairs] = Hash(BEGIN(vMerkleTree[j+i]), END(vMerkleTree[j+i]),
+                                                   BEGIN(vMerkleTree[j+i]), END(vMerkleTree[j+i]));
             }
             j += nSize;
         }
@@ -1447,7 +1463,7 @@ public:
 
     // Read a block from disk
     bool ReadFromDisk(const CBlockIndex* pindex);
-    bool ReadFromDisk(const CDiskBlockPos &pos);
+    bool ReadFromDisk(const CDiskBlockPos &pos, bool fCheckPOW=true);
 
     // Add this block to the block index, and if necessary, switch the active block chain to this
     bool AddToBlockIndex(CValidationState &state, const CDiskBlockPos &pos);
@@ -1536,7 +1552,9 @@ enum BlockStatus {
 
     BLOCK_FAILED_VALID       =   32, // stage after last reached validness failed
     BLOCK_FAILED_CHILD       =   64, // descends from failed block
-    BLOCK_FAILED_MASK        =   96
+    BLOCK_FAILED_MASK        =   96,
+
+    BLOCK_POW_VERIFIED       =  128, // claimed PoW checked, the header on disk needs no new check
 };
 
 /** The block chain is a tree shaped structure starting with the
@@ -1699,6 +1717,7 @@ public:
     }
 
     bool CheckIndex() const;
+    bool CheckIndex(bool fNewCoeffMatrix) const;
 
     enum { nMedianTimeSpan=11 };
 
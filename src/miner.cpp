@@ -5,6 +5,9 @@
 #include "miner.h"
 #include "wallet.h"
 
+#include <atomic>
+#include <boost/tuple/tuple.hpp>
+
 
 using namespace std;
 using namespace boost;
@@ -15,7 +18,6 @@ typedef union {
     uint16_t e[8];
 } Vec4;
 
-#define THRESHOLD 9
 vector_t init_vector(int n_rows) {
     return (vector_t)calloc(n_rows, sizeof(int));
 }
@@ -49,6 +51,99 @@ uint64_t rdtsc() {
 }
 #endif
 
+// Work epoch of the miner threads, and the time of the last new tip which
+// no miner job picked up yet.
+static std::atomic<uint64_t> nMinerEpoch(0);
+static std::atomic<int64> nMinerNewTipMicros(0);
+
+// Checking a cancel token every 2^k chunks, see -minercancelinterval
+static uint64_t nMQCancelCheckMask = 0;
+
+CMQCancelToken::CMQCancelToken() :
+    pepoch(&nMinerEpoch), nEpoch(nMinerEpoch.load()), nCheckMask(nMQCancelCheckMask)
+{
+}
+
+CMQCancelToken::CMQCancelToken(const std::atomic<uint64_t>& epochIn) :
+    pepoch(&epochIn), nEpoch(epochIn.load()), nCheckMask(nMQCancelCheckMask)
+{
+}
+
+void SetMQCancelInterval(int64 nChunks)
+{
+    nMQCancelCheckMask = 0;
+    while ((int64)nMQCancelCheckMask + 1 < nChunks && nMQCancelCheckMask < (1u << 30))
+        nMQCancelCheckMask = nMQCancelCheckMask * 2 + 1;
+}
+
+// Equations per word of the enumeration kernels, see -minerwordsize
+static int nMQWordSize = 0;
+
+void SetMQWordSize(int nWordSize)
+{
+    nMQWordSize = (nWordSize == 16 || nWordSize == 32 || nWordSize == 64) ? nWordSize : 0;
+}
+
+int MQWordSize(int nEquations)
+{
+    if (nMQWordSize != 0)
+        return nMQWordSize;
+#ifdef HAVE_SSE2
+    // measured with bench_mq from nBits 20 to 32: the 16-bit lanes are always
+    // the fastest, wider lanes halve the candidates per instruction while the
+    // batched solution tester already makes the remaining equations cheap
+    (void)nEquations;
+    return 16;
+#else
+    // the scalar kernel costs the same for any word size up to 64
+    return nEquations <= 16 ? 16 : nEquations <= 32 ? 32 : 64;
+#endif
+}
+
+// Solver of the sub-problems, see -minersolver and MQSolver()
+static int nMQSolver = ALGO_AUTO;
+
+void SetMQSolver(int nAlgorithm)
+{
+    nMQSolver = (nAlgorithm == ALGO_ENUMERATION || nAlgorithm == ALGO_FFT) ? nAlgorithm : ALGO_AUTO;
+}
+
+void AdvanceMinerEpoch(bool fNewTip)
+{
+    if (fNewTip)
+        nMinerNewTipMicros = GetTimeMicros();
+    nMinerEpoch++;
+}
+
+thread_local CMQSolverStats mqSolverStats;
+
+// Count the candidates enumerated and the cycles spent by this thread since
+// MQStartCandidates(), and start a new period.
+static void MQFlushCandidates() {
+    CMQSolverStats& stats = mqSolverStats;
+    uint64_t now = rdtsc();
+    if (stats.nPendingStart != 0) {
+        CMQSolverStats::Add(stats.nCandidates, stats.nPending);
+        CMQSolverStats::Add(stats.nCycles, now - stats.nPendingStart);
+    }
+    stats.nPending = 0;
+    stats.nPendingStart = now;
+}
+
+static void MQStartCandidates() {
+    mqSolverStats.nPending = 0;
+    mqSolverStats.nPendingStart = rdtsc();
+}
+
+// Called by the enumeration kernels. The counters are only updated once every
+// 2^20 candidates, to keep rdtsc out of the kernels.
+static inline void MQCountCandidates(uint64_t n) {
+    CMQSolverStats& stats = mqSolverStats;
+    stats.nPending += n;
+    if (unlikely(stats.nPending >= (1 << 20)))
+        MQFlushCandidates();
+}
+
 pck_vector_t packed_eval(LUT_t LUT, int n, int d, pck_vector_t F[], uint64_t i) {
     if (d == 2) {
         return packed_eval_deg_2(LUT, n, F, i);
@@ -59,55 +154,236 @@ pck_vector_t packed_eval(LUT_t LUT, int n, int d, pck_vector_t F[], uint64_t i)
     }
 }
 
-// this ought to be optimized, unrolled, etc.
-void BFS(pck_vector_t *A, int start, int n,CBlockIndex* pindexPrev) {
-    for(int i=0; i<n; i++) {
-        if (pindexPrev != pindexBest) {
-            return;
-        }
-        int Sz = 1 << i;
-        int Pos = start;
-
-        while(Pos < start + (1 << n)) {
-            for(int j=0; j<Sz; j++)
-            A[Pos + Sz + j] ^= A[Pos + j];
-            Pos += 2*Sz;
-            if (pindexPrev != pindexBest) {
-                return;
+// The Moebius transform turns the algebraic normal form of the equations in
+// A[0..2^n), the word of the monomial prod_{k in i} x_k at index i, into
+// their values: A[i] becomes the equations evaluated at x_k = bit k of i.
+//
+// Its n levels of butterflies are done in passes that each stay in the cache:
+// the first one does the lowest MOEBIUS_BLOCK_LEVELS levels on blocks of
+// contiguous words, the next ones do MOEBIUS_TILE_LEVELS levels at a time on
+// tiles of 2^MOEBIUS_TILE_LEVELS rows of MOEBIUS_TILE_WORDS words. The units
+// (blocks or tiles) of a pass are independent and are split between the
+// threads, and the last pass looks for the zero words of a unit as soon as it
+// is done, while it is still in the cache.
+#define MOEBIUS_BLOCK_LEVELS 12     // blocks of 32 KB
+#define MOEBIUS_TILE_LEVELS 4
+#define MOEBIUS_TILE_WORDS 256      // tiles of 16 rows of 2 KB
+
+typedef uint64_t moebius_v2u64_t __attribute__ ((vector_size (16)));
+typedef uint64_t moebius_v4u64_t __attribute__ ((vector_size (32)));
+
+typedef struct {
+    pck_vector_t *A;
+    int level;          // first level of the pass
+    int levels;         // number of levels of the pass
+    bool scan;          // last pass: collect the indices of the zero words
+    uint64_t units;
+} moebius_pass_t;
+
+// the rows of a tile are only aligned on words. The vector is not returned by
+// value: outside of the avx2 kernel that would change the ABI of the function.
+template <typename V>
+static inline __attribute__((always_inline)) void moebius_load(V *x, const pck_vector_t *p) {
+    memcpy(x, p, sizeof(V));
+}
+
+// hi[j] ^= lo[j] for j < c
+template <typename V>
+static inline __attribute__((always_inline)) void moebius_xor(pck_vector_t *hi, const pck_vector_t *lo, uint64_t c) {
+    const uint64_t W = sizeof(V) / sizeof(pck_vector_t);
+    uint64_t j = 0;
+    for (; j + W <= c; j += W) {
+        V x, y;
+        moebius_load(&x, hi + j);
+        moebius_load(&y, lo + j);
+        x ^= y;
+        memcpy(hi + j, &x, sizeof(V));
+    }
+    for (; j < c; j++)
+        hi[j] ^= lo[j];
+}
+
+// appends the indices first+j of the zero words A[j], j < c
+template <typename V>
+static inline __attribute__((always_inline)) void moebius_scan(const pck_vector_t *A, uint64_t c, uint64_t first, std::vector<uint64_t> &zeros) {
+    const uint64_t W = sizeof(V) / sizeof(pck_vector_t);
+    const V zero = {};
+    uint64_t j = 0;
+    for (; j + 4*W <= c; j += 4*W) {
+        // most of the time, no word of the 4 vectors is zero
+        V a0, a1, a2, a3;
+        moebius_load(&a0, A + j);
+        moebius_load(&a1, A + j + W);
+        moebius_load(&a2, A + j + 2*W);
+        moebius_load(&a3, A + j + 3*W);
+        V eq = (V)(a0 == zero) | (V)(a1 == zero) | (V)(a2 == zero) | (V)(a3 == zero);
+        uint64_t any = 0;
+        for (uint64_t k = 0; k < W; k++)
+            any |= eq[k];
+        if (likely(any == 0))
+            continue;
+        for (uint64_t k = j; k < j + 4*W; k++)
+            if (A[k] == 0)
+                zeros.push_back(first + k);
+    }
+    for (; j < c; j++)
+        if (A[j] == 0)
+            zeros.push_back(first + j);
+}
+
+// One block or tile of a pass. Returns the number of words it covers.
+template <typename V>
+static inline __attribute__((always_inline)) uint64_t moebius_unit(const moebius_pass_t *pass, uint64_t u, std::vector<uint64_t> &zeros) {
+    const int levels = pass->levels;
+    if (pass->level == 0) {
+        const uint64_t size = (uint64_t)1 << levels;
+        pck_vector_t *A = pass->A + u * size;
+        int level = 0;
+        if (levels >= 2) {
+            // levels 0 and 1 at once, on groups of 4 words
+            for (uint64_t i = 0; i < size; i += 4) {
+                const pck_vector_t a0 = A[i], a1 = A[i+1], a2 = A[i+2], a3 = A[i+3];
+                A[i+1] = a0 ^ a1;
+                A[i+2] = a0 ^ a2;
+                A[i+3] = a0 ^ a1 ^ a2 ^ a3;
             }
+            level = 2;
+        }
+        for (; level < levels; level++) {
+            const uint64_t S = (uint64_t)1 << level;
+            for (uint64_t pos = 0; pos < size; pos += 2*S)
+                moebius_xor<V>(A + pos + S, A + pos, S);
         }
+        if (pass->scan)
+            moebius_scan<V>(A, size, u * size, zeros);
+        return size;
     }
-}
 
-void hybrid_DFS_BFS(pck_vector_t *A, int from, int to, CBlockIndex* pindexPrev) {
-    if (from >= to-1) return;
-    if (pindexPrev != pindexBest) {
-        return;
+    const uint64_t R = (uint64_t)1 << pass->level;
+    const uint64_t c = std::min(R, (uint64_t)MOEBIUS_TILE_WORDS);
+    const uint64_t chunks = R / c;
+    const uint64_t first = ((u / chunks) << (pass->level + levels)) + (u % chunks) * c;
+    pck_vector_t *A = pass->A + first;
+    const int rows = 1 << levels;
+    for (int level = 0; level < levels; level++) {
+        const int S = 1 << level;
+        for (int r = 0; r < rows; r++)
+            if (!(r & S))
+                moebius_xor<V>(A + (uint64_t)(r + S) * R, A + (uint64_t)r * R, c);
     }
-    int center = (to+from)/2;
-    int half_length = (to-from)/2;
+    if (pass->scan)
+        for (int r = 0; r < rows; r++)
+            moebius_scan<V>(A + (uint64_t)r * R, c, first + (uint64_t)r * R, zeros);
+    return c * rows;
+}
 
-    if (half_length == (1 << (THRESHOLD-1)))
-       BFS(A, from, THRESHOLD,pindexPrev);
-    else {
-        hybrid_DFS_BFS(A, from, center, pindexPrev);
-        hybrid_DFS_BFS(A, center, to,pindexPrev);
-        for(int i=0; i<half_length; i++)
-            A[center + i] ^= A[from + i];
+// The units [from, to) of a pass. With a callback, the zero words of each unit
+// are reported as soon as it is done, and the pass stops when the callback
+// asks to. Returns false when the pass was cancelled or stopped.
+template <typename V>
+static inline __attribute__((always_inline)) bool moebius_units(const moebius_pass_t *pass, uint64_t from, uint64_t to,
+                                                                 std::vector<uint64_t> *zeros, solution_callback_t callback,
+                                                                 void* callback_state, const CMQCancelToken* cancel) {
+    for (uint64_t u = from; u < to; u++) {
+        if (cancel->IsCancelled(u))
+            return false;
+        uint64_t words = moebius_unit<V>(pass, u, *zeros);
+        if (callback != NULL && pass->scan) {
+            MQCountCandidates(words);
+            if (!zeros->empty()) {
+                int answer = (*callback)(callback_state, zeros->size(), &(*zeros)[0]);
+                zeros->clear();
+                if (answer)
+                    return false;
+            }
+        }
     }
+    return true;
+}
+
+static bool moebius_units_generic(const moebius_pass_t *pass, uint64_t from, uint64_t to, std::vector<uint64_t> *zeros,
+                                  solution_callback_t callback, void* callback_state, const CMQCancelToken* cancel) {
+    return moebius_units<moebius_v2u64_t>(pass, from, to, zeros, callback, callback_state, cancel);
+}
+
+#ifdef HAVE_SSE2
+// only called when the cpu supports AVX2
+__attribute__((target("avx2")))
+static bool moebius_units_avx2(const moebius_pass_t *pass, uint64_t from, uint64_t to, std::vector<uint64_t> *zeros,
+                               solution_callback_t callback, void* callback_state, const CMQCancelToken* cancel) {
+    return moebius_units<moebius_v4u64_t>(pass, from, to, zeros, callback, callback_state, cancel);
+}
+#endif
+
+typedef bool (*moebius_units_t)(const moebius_pass_t *, uint64_t, uint64_t, std::vector<uint64_t> *,
+                                solution_callback_t, void*, const CMQCancelToken*);
+
+static void moebius_pass_thread(moebius_units_t units, const moebius_pass_t *pass, uint64_t from, uint64_t to,
+                                std::vector<uint64_t> *zeros, const CMQCancelToken* cancel, char *fDone) {
+    *fDone = units(pass, from, to, zeros, NULL, NULL, cancel);
 }
 
-void moebius_transform(int n, pck_vector_t F[], solution_callback_t callback, void* callback_state, CBlockIndex* pindexPrev) {
+void moebius_transform(int n, pck_vector_t F[], solution_callback_t callback, void* callback_state,
+                       const wrapper_settings_t *settings, const CMQCancelToken* cancel) {
+    moebius_units_t units = moebius_units_generic;
+#ifdef HAVE_SSE2
+    if (settings->algo_enum_use_avx2)
+        units = moebius_units_avx2;
+#endif
 
-    // compute the moebius transform
-    hybrid_DFS_BFS(F, 0, (1ll << n), pindexPrev);
+    moebius_pass_t pass;
+    pass.A = F;
+    pass.level = 0;
+    pass.levels = std::min(n, MOEBIUS_BLOCK_LEVELS);
+    while (pass.level < n) {
+        if (pass.level > 0)
+            pass.levels = std::min(n - pass.level, MOEBIUS_TILE_LEVELS);
+        pass.scan = (pass.level + pass.levels == n);
+        if (pass.level == 0)
+            pass.units = (uint64_t)1 << (n - pass.levels);
+        else
+            pass.units = ((uint64_t)1 << (n - pass.levels)) / std::min((uint64_t)1 << pass.level, (uint64_t)MOEBIUS_TILE_WORDS);
 
-    // check for solutions [could/should be integrated into BFS, at least to allow early abort, and to improve cache usage ?]
-    uint64_t size = 1ll << n;
-    for(uint64_t i=0; i<size; i++)
-        if (F[i] == 0)
-            if ((*callback)(callback_state, 1, &i))
+        const int nThreads = (int)std::min((uint64_t)std::max(settings->fft_threads, 1), pass.units);
+        if (nThreads == 1) {
+            std::vector<uint64_t> zeros;
+            if (!units(&pass, 0, pass.units, &zeros, callback, callback_state, cancel))
                 return;
+        } else {
+            // the zero words found by the threads are reported in order once
+            // they are all done
+            std::vector<std::vector<uint64_t> > zeros(nThreads);
+            std::vector<char> fDone(nThreads);
+            boost::thread_group threads;
+            for (int t = 0; t < nThreads; t++)
+                threads.create_thread(boost::bind(&moebius_pass_thread, units, &pass, pass.units * t / nThreads,
+                                                  pass.units * (t+1) / nThreads, &zeros[t], cancel, &fDone[t]));
+            threads.join_all();
+            for (int t = 0; t < nThreads; t++)
+                if (!fDone[t])
+                    return;
+            if (pass.scan) {
+                MQCountCandidates((uint64_t)1 << n);
+                for (int t = 0; t < nThreads; t++)
+                    if (!zeros[t].empty() && (*callback)(callback_state, zeros[t].size(), &zeros[t][0]))
+                        return;
+            }
+        }
+        pass.level += pass.levels;
+    }
+}
+
+// The table of the Moebius transform of the degree 2 packed system F in n
+// variables: the word of x_j*x_k (j<k) goes to index 2^j+2^k, the word of x_k
+// to 2^k and the constant term to 0.
+void moebius_load_deg_2(LUT_t LUT, int n, const pck_vector_t F[], pck_vector_t A[]) {
+    memset(A, 0, sizeof(pck_vector_t) << n);
+    A[0] = F[0];
+    for (int k = 0; k < n; k++) {
+        A[(uint64_t)1 << k] = F[ idx_1(LUT, k) ];
+        for (int j = 0; j < k; j++)
+            A[((uint64_t)1 << j) | ((uint64_t)1 << k)] = F[ idx_2(LUT, j, k) ];
+    }
 }
 
 void print_vec(__m128i foo) {
@@ -122,7 +398,7 @@ pck_vector_t packed_eval_deg_2(LUT_t LUT, int n, pck_vector_t F[], uint64_t i) {
     pck_vector_t v[n];
     for(int k=0; k<n; k++) {
         v[k] = 0;
-        if (i & 0x0001) v[k] = 0xffffffff;
+        if (i & 0x0001) v[k] = ~(pck_vector_t) 0;
         i = (i >> 1ll);
     }
 
@@ -181,14 +457,14 @@ typedef struct {
 // generated with L = 9
 void exhaustive_ia32_deg_2(LUT_t LUT, int n, pck_vector_t F[],
                                        solution_callback_t callback, void* callback_state,
-                                       int verbose, CBlockIndex* pindexPrev) {
+                                       int verbose, const CMQCancelToken* cancel) {
 
     #define QUIT() { \
         return; \
     }
 
     uint64_t init_start_time = rdtsc();
-    if (pindexPrev != pindexBest) {
+    if (cancel->IsCancelled()) {
         QUIT();
     }
 
@@ -235,10 +511,11 @@ void exhaustive_ia32_deg_2(LUT_t LUT, int n, pck_vector_t F[],
     // special case for i=0
     const uint64_t weight_0_start = 0;
     STEP_0(0);
+    MQCountCandidates(1);
 
     // from now on, hamming weight is >= 1
     for(int idx_0=0; idx_0<n    ; idx_0++) {
-        if (pindexPrev != pindexBest) {
+        if (cancel->IsCancelled()) {
             QUIT();
         }
         // special case when i has hamming weight exactly 1
@@ -253,9 +530,6 @@ void exhaustive_ia32_deg_2(LUT_t LUT, int n, pck_vector_t F[],
 
         const uint64_t rolled_end = weight_1_start + (1ll << min(9, idx_0));
         for(uint64_t i=1 + weight_1_start; i< rolled_end; i++) {
-            if (pindexPrev != pindexBest) {
-                QUIT();
-            }
             int pos = 0;
             uint64_t _i = i;
             while ((_i & 0x0001) == 0) { _i >>= 1; pos++; }
@@ -267,13 +541,14 @@ void exhaustive_ia32_deg_2(LUT_t LUT, int n, pck_vector_t F[],
         }
 
         CHECK_SOLUTIONS();
+        MQCountCandidates(rolled_end - weight_1_start);
 
         // Here, the number of iterations to perform is (supposedly) sufficiently large
         // We will therefore unroll the loop 512 times
 
         // unrolled critical section where the hamming weight is >= 2
         for(uint64_t j=512; j<(1ull << idx_0); j+=512) {
-            if (pindexPrev != pindexBest) {
+            if (cancel->IsCancelled(j >> 9)) {
                 QUIT();
             }
             const uint64_t i = j + weight_1_start;
@@ -800,6 +1075,13 @@ void exhaustive_ia32_deg_2(LUT_t LUT, int n, pck_vector_t F[],
             STEP_2(1, 3, i + 511);
 
             CHECK_SOLUTIONS();
+            MQCountCandidates(512);
+
+            // a solution must not wait for the pack to fill up
+            if (current_solution_index && ((j >> 9) & (PACK_FLUSH_CHUNKS - 1)) == 0) {
+                FLUSH_SOLUTIONS();
+                current_solution_index = 0;
+            }
         }
 
 
@@ -812,6 +1094,360 @@ void exhaustive_ia32_deg_2(LUT_t LUT, int n, pck_vector_t F[],
     QUIT();
 }
 
+#ifdef HAVE_SSE2
+// The SIMD kernels enumerate 2^T copies of the system at once, one copy per
+// lane of 16, 32 or 64 equations: the last T variables are fixed to the lane
+// number, and the remaining n-T variables are enumerated in gray code order
+// exactly as in exhaustive_ia32_deg_2. They are written with the GCC vector
+// extensions so that the same code is compiled for SSE2 and, under a target
+// attribute, for AVX2.
+typedef uint16_t simd_v8u16_t __attribute__ ((vector_size (16)));
+typedef uint16_t simd_v16u16_t __attribute__ ((vector_size (32)));
+typedef uint32_t simd_v4u32_t __attribute__ ((vector_size (16)));
+typedef uint32_t simd_v8u32_t __attribute__ ((vector_size (32)));
+typedef uint64_t simd_v2u64_t __attribute__ ((vector_size (16)));
+typedef uint64_t simd_v4u64_t __attribute__ ((vector_size (32)));
+
+// returns a bitmask of the lanes of x that are zero (most of the time, none is)
+template <typename V>
+static inline __attribute__((always_inline)) uint32_t simd_zero_lanes(const V *x) {
+    const V zero = {};
+    const V eq = (V)(*x == zero);
+    uint64_t w[sizeof(V) / sizeof(uint64_t)];
+    memcpy(w, &eq, sizeof(V));
+    uint64_t any = 0;
+    for (unsigned int k = 0; k < sizeof(V) / sizeof(uint64_t); k++)
+        any |= w[k];
+    if (likely(any == 0))
+        return 0;
+
+    uint32_t mask = 0;
+    for (unsigned int l = 0; l < sizeof(V) / sizeof((*x)[0]); l++)
+        if ((*x)[l] == 0)
+            mask |= (1u << l);
+    return mask;
+}
+
+// Fix the last T variables of the (non-derived) packed system F in n variables
+// to each of their 2^T values, and interleave the 2^T resulting systems in n-T
+// variables into the lanes of Fv. The deginvlex index of a monomial does not
+// depend on the number of variables, so the LUT of F is also valid for Fv.
+template <typename V, typename U, int T>
+static inline __attribute__((always_inline)) void simd_specialize_deg_2(LUT_t LUT, int n, const pck_vector_t F[], V Fv[]) {
+    const int np = n - T;
+    const uint64_t N = n_monomials(np, 2);
+
+    for (uint64_t m = 0; m < N; m++)
+        for (int lane = 0; lane < (1 << T); lane++)
+            Fv[m][lane] = (U) F[m];
+
+    for (int lane = 1; lane < (1 << T); lane++) {
+        pck_vector_t c = F[0];
+        for (int t = 0; t < T; t++) {
+            if (!((lane >> t) & 1))
+                continue;
+            c ^= F[ idx_1(LUT, np + t) ];
+            for (int u = 0; u < t; u++)
+                if ((lane >> u) & 1)
+                    c ^= F[ idx_2(LUT, np + u, np + t) ];
+        }
+        Fv[0][lane] = (U) c;
+
+        for (int j = 0; j < np; j++) {
+            pck_vector_t l = F[ idx_1(LUT, j) ];
+            for (int t = 0; t < T; t++)
+                if ((lane >> t) & 1)
+                    l ^= F[ idx_2(LUT, j, np + t) ];
+            Fv[ idx_1(LUT, j) ][lane] = (U) l;
+        }
+    }
+}
+
+#define SIMD_CHECK(i) { \
+    const uint32_t zero_lanes = simd_zero_lanes(&y); \
+    if (unlikely(zero_lanes)) { \
+        solution_buffer[n_solutions_found].int_idx = i; \
+        solution_buffer[n_solutions_found].mask = zero_lanes; \
+        n_solutions_found++; \
+    } \
+}
+
+#define SIMD_STEP_1(a,i) { \
+    y ^= Fv[ a ]; \
+    SIMD_CHECK(i); \
+}
+
+#define SIMD_STEP_2(a,b,i) { \
+    Fv[ a ] ^= Fv[ b ]; \
+    y ^= Fv[ a ]; \
+    SIMD_CHECK(i); \
+}
+
+template <typename V, typename U, int T>
+static inline __attribute__((always_inline)) void exhaustive_simd_deg_2(LUT_t LUT, int n, pck_vector_t F[],
+                                       solution_callback_t callback, void* callback_state,
+                                       int verbose, const CMQCancelToken* cancel) {
+    uint64_t init_start_time = rdtsc();
+    if (cancel->IsCancelled() || n <= T) {
+        return;
+    }
+
+    const int np = n - T;
+    const uint64_t N = n_monomials(np, 2);
+    V *Fv = (V *) _mm_malloc(N * sizeof(V), sizeof(V));
+    if (Fv == NULL) {
+        return;
+    }
+
+    #define SIMD_QUIT() { \
+        _mm_free(Fv); \
+        return; \
+    }
+
+    simd_specialize_deg_2<V, U, T>(LUT, n, F, Fv);
+
+    // computes the derivatives required by the enumeration kernel, see exhaustive_ia32_deg_2
+    for(int i0=1; i0<np; i0++) {
+        Fv[ idx_1(LUT, i0) ] ^= Fv[ idx_2(LUT, i0-1, i0) ];
+    }
+
+    if (verbose) {
+        printf("fes: initialisation = %15" PRI64u " cycles\n", (uint64)(rdtsc()-init_start_time));
+    }
+    uint64_t enumeration_start_time = rdtsc();
+    uint64_t n_solutions_found = 0;
+    uint64_t current_solution_index = 0;
+    uint64_t pack_of_solution[1024];
+    solution_t solution_buffer[(1 << SIMD_CHUNK_SIZE) + 4];
+
+    #define SIMD_FLUSH_SOLUTIONS() { \
+        if ((*callback)(callback_state, current_solution_index, pack_of_solution)) \
+            SIMD_QUIT(); \
+    }
+
+    #define SIMD_PUSH_SOLUTION(current_solution) { \
+        pack_of_solution[current_solution_index] = current_solution; \
+        current_solution_index++; \
+        if (current_solution_index == 1024){ \
+            SIMD_FLUSH_SOLUTIONS(); \
+            current_solution_index = 0; \
+        } \
+    }
+
+    #define SIMD_CHECK_SOLUTIONS() { \
+        for(uint64_t s=0; s<n_solutions_found; s++){ \
+            const uint64_t x = to_gray(solution_buffer[s].int_idx); \
+            for(uint32_t lane=0; lane<(1u << T); lane++) \
+                if ((solution_buffer[s].mask >> lane) & 1) \
+                    SIMD_PUSH_SOLUTION(x | ((uint64_t) lane << np)); \
+        } \
+        n_solutions_found = 0; \
+    }
+
+    // the current values of the 2^T systems are kept in a register rather than in Fv[0]
+    V y = Fv[ 0 ];
+
+    // the first chunk is enumerated without unrolling
+    const uint64_t size = 1ull << np;
+    const uint64_t chunk = 1ull << SIMD_CHUNK_SIZE;
+    SIMD_CHECK(0);
+    for(uint64_t i=1; i<min(size, chunk); i++) {
+        const int k_1 = __builtin_ctzll(i);
+        const uint64_t rest = i & (i-1);
+        if (rest == 0) {
+            SIMD_STEP_1( idx_1(LUT, k_1), i );
+        } else {
+            SIMD_STEP_2( idx_1(LUT, k_1), idx_2(LUT, k_1, __builtin_ctzll(rest)), i );
+        }
+    }
+    SIMD_CHECK_SOLUTIONS();
+    MQCountCandidates(min(size, chunk) << T);
+
+    // inside a chunk, the two lowest set bits of i only depend on its
+    // position in the chunk, except when this position is a power of two
+    LUT_int_t step_a[1 << SIMD_CHUNK_SIZE], step_b[1 << SIMD_CHUNK_SIZE];
+    for(uint64_t t=1; t<chunk; t++) {
+        const int k_1 = __builtin_ctzll(t);
+        const uint64_t rest = t & (t-1);
+        step_a[t] = idx_1(LUT, k_1);
+        step_b[t] = (rest == 0) ? 0 : idx_2(LUT, k_1, __builtin_ctzll(rest));
+    }
+
+    for(uint64_t j=chunk; j<size; j+=chunk) {
+        if (cancel->IsCancelled(j >> SIMD_CHUNK_SIZE)) {
+            SIMD_QUIT();
+        }
+        const int k_1 = __builtin_ctzll(j);
+        const uint64_t rest = j & (j-1);
+        if (rest == 0) {
+            SIMD_STEP_1( idx_1(LUT, k_1), j );
+        } else {
+            SIMD_STEP_2( idx_1(LUT, k_1), idx_2(LUT, k_1, __builtin_ctzll(rest)), j );
+        }
+
+        for(int k=0; k<SIMD_CHUNK_SIZE; k++) {
+            step_b[1 << k] = idx_2(LUT, k, k_1);
+        }
+        for(uint64_t t=1; t<chunk; t++) {
+            SIMD_STEP_2( step_a[t], step_b[t], j + t );
+        }
+
+        SIMD_CHECK_SOLUTIONS();
+        MQCountCandidates(chunk << T);
+
+        // a solution must not wait for the pack to fill up
+        if (current_solution_index && ((j >> SIMD_CHUNK_SIZE) & (PACK_FLUSH_CHUNKS - 1)) == 0) {
+            SIMD_FLUSH_SOLUTIONS();
+            current_solution_index = 0;
+        }
+    }
+    SIMD_FLUSH_SOLUTIONS();
+    uint64_t end_time = rdtsc();
+    if (verbose) {
+        printf("fes: enumeration+check = %" PRI64u " cycles\n", (uint64)(end_time - enumeration_start_time));
+    }
+    SIMD_QUIT();
+
+    #undef SIMD_QUIT
+    #undef SIMD_FLUSH_SOLUTIONS
+    #undef SIMD_PUSH_SOLUTION
+    #undef SIMD_CHECK_SOLUTIONS
+}
+
+#undef SIMD_CHECK
+#undef SIMD_STEP_1
+#undef SIMD_STEP_2
+
+// 8 lanes of 16 equations in a 128-bit register
+void exhaustive_sse2_deg_2_T_3_el_0(LUT_t LUT, int n, pck_vector_t F[],
+                                       solution_callback_t callback, void* callback_state,
+                                       int verbose, const CMQCancelToken* cancel) {
+    exhaustive_simd_deg_2<simd_v8u16_t, uint16_t, 3>(LUT, n, F, callback, callback_state, verbose, cancel);
+}
+
+// 4 lanes of 32 equations in a 128-bit register
+void exhaustive_sse2_deg_2_T_2_w32(LUT_t LUT, int n, pck_vector_t F[],
+                                       solution_callback_t callback, void* callback_state,
+                                       int verbose, const CMQCancelToken* cancel) {
+    exhaustive_simd_deg_2<simd_v4u32_t, uint32_t, 2>(LUT, n, F, callback, callback_state, verbose, cancel);
+}
+
+// 2 lanes of 64 equations in a 128-bit register
+void exhaustive_sse2_deg_2_T_1_w64(LUT_t LUT, int n, pck_vector_t F[],
+                                       solution_callback_t callback, void* callback_state,
+                                       int verbose, const CMQCancelToken* cancel) {
+    exhaustive_simd_deg_2<simd_v2u64_t, uint64_t, 1>(LUT, n, F, callback, callback_state, verbose, cancel);
+}
+
+// 16 lanes of 16 equations in a 256-bit register, only called when the cpu supports AVX2
+__attribute__((target("avx2")))
+void exhaustive_avx2_deg_2_T_4_el_0(LUT_t LUT, int n, pck_vector_t F[],
+                                       solution_callback_t callback, void* callback_state,
+                                       int verbose, const CMQCancelToken* cancel) {
+    exhaustive_simd_deg_2<simd_v16u16_t, uint16_t, 4>(LUT, n, F, callback, callback_state, verbose, cancel);
+}
+
+// 8 lanes of 32 equations in a 256-bit register
+__attribute__((target("avx2")))
+void exhaustive_avx2_deg_2_T_3_w32(LUT_t LUT, int n, pck_vector_t F[],
+                                       solution_callback_t callback, void* callback_state,
+                                       int verbose, const CMQCancelToken* cancel) {
+    exhaustive_simd_deg_2<simd_v8u32_t, uint32_t, 3>(LUT, n, F, callback, callback_state, verbose, cancel);
+}
+
+// 4 lanes of 64 equations in a 256-bit register
+__attribute__((target("avx2")))
+void exhaustive_avx2_deg_2_T_2_w64(LUT_t LUT, int n, pck_vector_t F[],
+                                       solution_callback_t callback, void* callback_state,
+                                       int verbose, const CMQCancelToken* cancel) {
+    exhaustive_simd_deg_2<simd_v4u64_t, uint64_t, 2>(LUT, n, F, callback, callback_state, verbose, cancel);
+}
+
+// The batched tester evaluates one candidate per lane, each lane holding a
+// batch of equations. The candidates are transposed first, so that variable k
+// is a vector holding 0 or ~0 in each lane, and the monomials of a batch are
+// then walked once for all the lanes. A block of candidates stops at the first batch that none of its lanes
+// satisfies, which is almost always the first one.
+template <typename V, typename U>
+static inline __attribute__((always_inline)) uint64_t simd_test_candidates_deg_2(LUT_t LUT, int n, int n_batches, pck_vector_t **G,
+                                                                                 const uint64_t *candidates, uint64_t size) {
+    const int L = sizeof(V) / sizeof(U);
+    const int B = 8 * sizeof(U);
+    V v[n];
+
+    for (uint64_t block = 0; block < size; block += L) {
+        const int lanes = (int) std::min((uint64_t) L, size - block);
+
+        // transpose B variables at a time
+        for (int k0 = 0; k0 < n; k0 += B) {
+            V w = {};
+            for (int lane = 0; lane < lanes; lane++)
+                w[lane] = (U) (candidates[block + lane] >> k0);
+            for (int k = k0; k < n && k < k0 + B; k++)
+                v[k] = -((w >> (k - k0)) & 1);
+        }
+
+        uint32_t alive = (1u << lanes) - 1;
+        for (int j = 0; alive && j < n_batches; j++) {
+            const pck_vector_t *F = G[j];
+            V y = {};
+            y ^= (U) F[0];
+            for (int idx_0 = 0; idx_0 < n; idx_0++) {
+                const V v_0 = v[idx_0];
+                y ^= (U) F[ idx_1(LUT, idx_0) ] & v_0;
+                for (int idx_1 = 0; idx_1 < idx_0; idx_1++)
+                    y ^= (U) F[ idx_2(LUT, idx_1, idx_0) ] & (v_0 & v[idx_1]);
+            }
+            alive &= simd_zero_lanes(&y);
+        }
+        if (alive)
+            return block + __builtin_ctz(alive);
+    }
+    return size;
+}
+
+static uint64_t sse2_test_candidates_deg_2(LUT_t LUT, int n, int n_batches, pck_vector_t **G,
+                                           const uint64_t *candidates, uint64_t size, int word_size) {
+    switch (word_size) {
+        case 16: return simd_test_candidates_deg_2<simd_v8u16_t, uint16_t>(LUT, n, n_batches, G, candidates, size);
+        case 32: return simd_test_candidates_deg_2<simd_v4u32_t, uint32_t>(LUT, n, n_batches, G, candidates, size);
+        default: return simd_test_candidates_deg_2<simd_v2u64_t, uint64_t>(LUT, n, n_batches, G, candidates, size);
+    }
+}
+
+__attribute__((target("avx2")))
+static uint64_t avx2_test_candidates_deg_2(LUT_t LUT, int n, int n_batches, pck_vector_t **G,
+                                           const uint64_t *candidates, uint64_t size, int word_size) {
+    switch (word_size) {
+        case 16: return simd_test_candidates_deg_2<simd_v16u16_t, uint16_t>(LUT, n, n_batches, G, candidates, size);
+        case 32: return simd_test_candidates_deg_2<simd_v8u32_t, uint32_t>(LUT, n, n_batches, G, candidates, size);
+        default: return simd_test_candidates_deg_2<simd_v4u64_t, uint64_t>(LUT, n, n_batches, G, candidates, size);
+    }
+}
+#endif
+
+uint64_t packed_test_candidates_deg_2(LUT_t LUT, int n, int n_batches, pck_vector_t **G,
+                                      const uint64_t *candidates, uint64_t size, const wrapper_settings_t *settings) {
+#ifdef HAVE_SSE2
+    // a lane holds a batch of 16, 32 or 64 equations
+    const int word_size = settings->word_size;
+    if (settings->algo_enum_use_sse && (word_size == 16 || word_size == 32 || word_size == 64)) {
+        if (settings->algo_enum_use_avx2)
+            return avx2_test_candidates_deg_2(LUT, n, n_batches, G, candidates, size, word_size);
+        return sse2_test_candidates_deg_2(LUT, n, n_batches, G, candidates, size, word_size);
+    }
+#endif
+
+    for (uint64_t i = 0; i < size; i++) {
+        int j = 0;
+        while (j < n_batches && packed_eval_deg_2(LUT, n, G[j], candidates[i]) == 0)
+            j++;
+        if (j == n_batches)
+            return i;
+    }
+    return size;
+}
+
 
 uint64_t timeSecondStep = 0;
 
@@ -836,10 +1472,13 @@ void init_settings(wrapper_settings_t *result) {
 
 #ifdef HAVE_SSE2
     result->algo_enum_use_sse = 1;
+    result->algo_enum_use_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
 #else
     result->algo_enum_use_sse = 0;
+    result->algo_enum_use_avx2 = 0;
 #endif
 
+    result->fft_threads = 1;
     result->verbose = 0;
 }
 
@@ -847,27 +1486,40 @@ void choose_settings( wrapper_settings_t *s, int n, int n_eqs, int degree) {
     // choose algorithm
     assert(n_eqs > 0);
     if ( s->algorithm == ALGO_AUTO ) {
-        if (degree < s->algo_auto_degree_bound) {
+        if (degree == 2) {
+            // the faster one on this machine, see MQTuneSolver()
+            s->algorithm = MQSolver(n, n_eqs);
+            verbose_print(s, "degree 2 --> using %s code", s->algorithm == ALGO_FFT ? "FFT" : "enumeration");
+        } else if (degree < s->algo_auto_degree_bound) {
         verbose_print(s, "low degree (%d) --> using enumeration code [threshold=%d]", degree, s->algo_auto_degree_bound);
         s->algorithm = ALGO_ENUMERATION;
         } else {
             verbose_print(s, "''large'' degree (%d) --> using FFT evaluation");
             s->algorithm = ALGO_FFT;
         }
+    }
 
-        if( s->algorithm == ALGO_ENUMERATION && s->algo_enum_self_tune ) {
-            if ( degree == 2 ) {
-                verbose_print(s, "very small degree, using 16-bit words");
-                s->word_size = 16;
-            }
-            if ( n < SIMD_CHUNK_SIZE + 2 ) {
-                verbose_print(s, "too few variables (%d), disabling sse assembly code [threshold=%d]", n, SIMD_CHUNK_SIZE + 2);
-                s->algo_enum_use_sse = 0;
-            } else {
-                verbose_print(s, "Using SIMD code (sse2 instructions available)");
-            }
+    if( s->algorithm == ALGO_ENUMERATION && s->algo_enum_self_tune ) {
+        if ( degree == 2 ) {
+            s->word_size = MQWordSize(n_eqs);
+            verbose_print(s, "very small degree, using %d-bit words", s->word_size);
+        }
+        if ( n < SIMD_CHUNK_SIZE + 2 ) {
+            verbose_print(s, "too few variables (%d), disabling sse assembly code [threshold=%d]", n, SIMD_CHUNK_SIZE + 2);
+            s->algo_enum_use_sse = 0;
+            s->algo_enum_use_avx2 = 0;
+        } else if ( s->algo_enum_use_avx2 ) {
+            verbose_print(s, "Using SIMD code (avx2 instructions available)");
+        } else if ( s->algo_enum_use_sse ) {
+            verbose_print(s, "Using SIMD code (sse2 instructions available)");
         }
     }
+
+    if( s->algorithm == ALGO_FFT ) {
+        // the transform evaluates whole words
+        s->word_size = 8 * sizeof(pck_vector_t);
+        verbose_print(s, "FFT on %d variables, using %d-bit words", n, s->word_size);
+    }
 }
 
 
@@ -881,8 +1533,9 @@ void next_set(int n, int d, int set[]) {
     }
 }
 
+//  packs the terms of degree min_degree..max_degree of equations from..to-1,
 //  assumes that F (the target array) is already allocated
-void convert_input_equations(const int n, const int degree, int from, int to, int ***coeffs, idx_lut_t *idx_LUT, pck_vector_t F[]) {
+void convert_input_equations_range(const int n, const int min_degree, const int max_degree, int from, int to, int ***coeffs, idx_lut_t *idx_LUT, pck_vector_t F[]) {
 
     assert(to-from <= (int) (8*sizeof(pck_vector_t)));
     vector_t x = init_vector(to-from);   // this is used to pack the equations in memory words
@@ -891,7 +1544,7 @@ void convert_input_equations(const int n, const int degree, int from, int to, in
     for(int j=0; j<n; j++) {
         set[j] = -1;
     }
-    for(int d=0; d<degree+1; d++) {   // collect degree-d terms
+    for(int d=min_degree; d<max_degree+1; d++) {   // collect degree-d terms
         for(int j=0; j<d; j++) {
             set[j] = d-1-j;
         }
@@ -919,26 +1572,17 @@ int solution_tester(void *_state, uint64_t size, uint64_t* n_solutions) {
 
     assert( state->degree < enumerated_degree_bound); // enumerated_degree_bound is defined in fes.h
 
+    CMQSolverStats::Add(mqSolverStats.nTested, size);
+
     uint64_t corrects_solutions[1];
-    uint64_t current_solution;
     int index_correct_solution = 0;
-    int is_correct;
-    int j;
-
-    for(uint64_t i=0; i<size; i++){
-        is_correct = 1;
-        j = 0;
-        current_solution = n_solutions[i];
-        while(is_correct && j<(state->n_batches)){
-            if (packed_eval(state->testing_LUT->LUT, state->n, state->degree, state->G[j], current_solution) != 0)
-                is_correct = 0;
-            j++;
-        }
-        if (is_correct){
-            corrects_solutions[0] = current_solution;
-            index_correct_solution++;
-            break;
-        }
+
+    // only the first candidate satisfying all the batches is reported
+    uint64_t i = packed_test_candidates_deg_2(state->testing_LUT->LUT, state->n, state->n_batches, state->G,
+                                              n_solutions, size, state->settings);
+    if (i < size) {
+        corrects_solutions[0] = n_solutions[i];
+        index_correct_solution++;
     }
 
     timeSecondStep += (rdtsc() - start);
@@ -956,9 +1600,9 @@ int solution_tester(void *_state, uint64_t size, uint64_t* n_solutions) {
 
 // --------------------------------------------------------------------------------------
 void moebius_wrapper(int n, pck_vector_t F[], solution_callback_t callback,
-                              void* callback_state, wrapper_settings_t *settings, CBlockIndex* pindexPrev) {
+                              void* callback_state, wrapper_settings_t *settings, const CMQCancelToken* cancel) {
     verbose_print(settings, "running FFT");
-    moebius_transform(n, F, callback, callback_state, pindexPrev);
+    moebius_transform(n, F, callback, callback_state, settings, cancel);
 }
 
 
@@ -966,208 +1610,286 @@ void moebius_wrapper(int n, pck_vector_t F[], solution_callback_t callback,
 void enumeration_wrapper(LUT_t LUT, int n, int d,
                                     pck_vector_t F[], solution_callback_t callback,
                                     void* callback_state, wrapper_settings_t *settings,
-                                    CBlockIndex* pindexPrev) {
+                                    const CMQCancelToken* cancel) {
 
-    // TODO : this should probably also include a run-time check that SSE2 instructions are actually there
-    if (pindexPrev != pindexBest) {
+    if (cancel->IsCancelled()) {
         return;
     }
-    //if ( !settings->algo_enum_use_sse ) {
-    if (1) {
-        switch (d) {
-            case 2: exhaustive_ia32_deg_2(LUT, n, F, callback, callback_state, settings->verbose, pindexPrev); break;
-            default:
-            assert(0);
-        }
+    assert(d == 2);
+    // the SIMD kernels pack 16, 32 or 64 equations per lane
+    const int word_size = settings->word_size;
+    if ( !settings->algo_enum_use_sse || (word_size != 16 && word_size != 32 && word_size != 64) ) {
+        exhaustive_ia32_deg_2(LUT, n, F, callback, callback_state, settings->verbose, cancel);
     } else {
-        if ( settings->word_size == 32 ) {
-            switch (d) {
-                //case 2: exhaustive_sse2_deg_2_T_2_el_0(LUT, n, F, callback, callback_state, settings->verbose); break;
-                default:
-                assert(0);
-            }
-        } else if ( settings->word_size == 16 ){
-            switch (d) {
-                //case 2: exhaustive_sse2_deg_2_T_3_el_0(LUT, n, F, callback, callback_state, settings->verbose); break;
-                default:
-                assert(0);
+#ifdef HAVE_SSE2
+        if ( settings->algo_enum_use_avx2 ) {
+            switch (word_size) {
+                case 16: exhaustive_avx2_deg_2_T_4_el_0(LUT, n, F, callback, callback_state, settings->verbose, cancel); break;
+                case 32: exhaustive_avx2_deg_2_T_3_w32(LUT, n, F, callback, callback_state, settings->verbose, cancel); break;
+                case 64: exhaustive_avx2_deg_2_T_2_w64(LUT, n, F, callback, callback_state, settings->verbose, cancel); break;
             }
-        } else if ( settings->word_size == 8 ){
-            switch (d) {
-                //case 2: exhaustive_sse2_deg_2_T_4_el_0(LUT, n, F, callback, callback_state, settings->verbose); break;
-                default:
-                assert(0);
+        } else {
+            switch (word_size) {
+                case 16: exhaustive_sse2_deg_2_T_3_el_0(LUT, n, F, callback, callback_state, settings->verbose, cancel); break;
+                case 32: exhaustive_sse2_deg_2_T_2_w32(LUT, n, F, callback, callback_state, settings->verbose, cancel); break;
+                case 64: exhaustive_sse2_deg_2_T_1_w64(LUT, n, F, callback, callback_state, settings->verbose, cancel); break;
             }
         }
+#endif
     }
 }
 
 
 // -------------------------------------
 
-int exhaustive_search_wrapper(const int n, int n_eqs, const int degree,
-                                             int ***coeffs, solution_callback_t callback,
-                                             void* callback_state,  CBlockIndex* pindexPrev) {
+packed_system_t *init_packed_system(int n, int n_eqs, const int degree, int ***coeffs) {
+    return init_packed_system_algorithm(n, n_eqs, degree, coeffs, ALGO_AUTO);
+}
 
-    wrapper_settings_t settings[1];
-    init_settings(settings);
-    choose_settings(settings, n, n_eqs, degree);
-    if (pindexPrev != pindexBest) {
-        return -5;
+packed_system_t *init_packed_system_algorithm(int n, int n_eqs, const int degree, int ***coeffs, int algorithm) {
+    packed_system_t *sys = (packed_system_t *)calloc(1, sizeof(packed_system_t));
+    if (sys == NULL) {
+        return NULL;
     }
 
-    //bool must_free_tester_state = false;
-    const uint64_t N = n_monomials(n, degree);
-    //  int enumerated_equations = 128 >> (T);
-
-    // --------- allocate/initialize some of our data structures
-    pck_vector_t *F = NULL;
-    idx_lut_t* idx_LUT = NULL;
-    size_t F_size = -1;
+    init_settings(&sys->settings);
+    sys->settings.algorithm = algorithm;
+    choose_settings(&sys->settings, n, n_eqs, degree);
+    // the FFT path only knows how to load degree 2 systems
+    if ( sys->settings.algorithm != ALGO_ENUMERATION && !(sys->settings.algorithm == ALGO_FFT && degree == 2) ) {
+        printf("internal bug (settings not chosen ?!?) \n");
+        free(sys);
+        return NULL;
+    }
 
-    bool should_free_LUT = 0;
-    switch( settings->algorithm ) {
-        case ALGO_ENUMERATION:
-            idx_LUT = init_deginvlex_LUT(n, degree);
-            if (idx_LUT == NULL) {
-                return -4;
-            }
-            should_free_LUT = 1;
-            F_size = N;
-            break;
+    sys->n = n;
+    sys->n_eqs = n_eqs;
+    sys->degree = degree;
+    sys->N = n_monomials(n, degree);
 
-        default:
-            printf("internal bug (settings not chosen ?!?) \n");
+    // if there are more equations that what we can enumerate simultaneously,
+    // we just deal with the first `word_size`, and then check any eventual
+    // solutions of these against the remaining equations.
+    // we split the equations into "batches" of `settings->word_size` each
+    const int word_size = sys->settings.word_size;
+    sys->n_batches = n_eqs / word_size;
+    if ( (n_eqs % word_size) > 0 ) {
+        sys->n_batches++;
     }
 
-    bool should_free_F = 0;
-    F = (pck_vector_t *)malloc(F_size * sizeof(pck_vector_t));
-    if (F == NULL) {
-        if (should_free_LUT && idx_LUT)
-            free_LUT(idx_LUT);
-        return -4;
+    sys->idx_LUT = init_deginvlex_LUT(n, degree);
+    if (sys->idx_LUT == NULL) {
+        free(sys);
+        return NULL;
     }
-    should_free_F = 1;
-
-    // ---------- deal where the case where there is more equations than what the kernel(s) deals with
-
-    pck_vector_t **G = NULL;
 
-    wrapper_state_t * tester_state = NULL;
-
-    // if there are more equations that what we can enumerate simultaneously,
-    // we just deal with the first `enumerated_equations`, and then check
-    // any eventual solutions of these against the remaining equations
-
-    verbose_print(settings, "wordsize (=%d) < #equations (=%d) --> wrapping tester around core fixed-size algorithm directly", settings->word_size, n_eqs );
+    // the FFT evaluates the first batch on a table of 2^n words after the batches
+    sys->scratch_words = sys->n_batches * sys->N;
+    if ( sys->settings.algorithm == ALGO_FFT ) {
+        sys->scratch_words += (uint64_t)1 << n;
+    }
 
-    // we split the equations into "batches" of `settings->word_size` each
-    int n_batches = n_eqs / settings->word_size;
-    if ( (n_eqs % settings->word_size) > 0 ) {
-        n_batches++;
+    sys->quad = (pck_vector_t *)calloc(sys->n_batches * sys->N, sizeof(pck_vector_t));
+    if (sys->quad == NULL) {
+        free_LUT(sys->idx_LUT);
+        free(sys);
+        return NULL;
+    }
+    for(int i=0; i<sys->n_batches; i++) {
+        convert_input_equations_range(n, 2, degree, word_size*i, min(n_eqs, word_size*(i+1)), coeffs, sys->idx_LUT, sys->quad + i*sys->N);
     }
 
-    // the first batch goes into the enumeration code
-    // prepare the input for the enumeration
-    convert_input_equations(n, degree, 0, settings->word_size, coeffs, idx_LUT, F) ;
+    return sys;
+}
 
+void free_packed_system(packed_system_t *sys) {
+    if (sys) {
+        if (sys->quad)
+            free(sys->quad);
+        if (sys->idx_LUT)
+            free_LUT(sys->idx_LUT);
+        free(sys);
+    }
+}
 
-    // the next batches will be used by the tester. They must be in deginvlex order
-    idx_lut_t *testing_LUT = idx_LUT;
+static int exhaustive_search_prepared(packed_system_t *sys, pck_vector_t *F,
+                                      solution_callback_t callback, void* callback_state,
+                                      const CMQCancelToken* cancel);
 
-    bool should_free_G = 0;
-    G = (pck_vector_t**)calloc(n_batches-1, sizeof(pck_vector_t *));
-    if (G == NULL) {
-        if (should_free_F && F)
-            free(F);
-        if (should_free_LUT && idx_LUT)
-            free_LUT(idx_LUT);
-        return -4;
+int exhaustive_search_packed(packed_system_t *sys, pck_vector_t *F, int ***coeffs,
+                                             solution_callback_t callback, void* callback_state,
+                                             const CMQCancelToken* cancel) {
+    if (cancel->IsCancelled()) {
+        return -5;
     }
-    should_free_G = 1;
 
-    int should_free_G_count = -1;
-    for(int i=1; i<n_batches; i++) {
-        G[i-1] = (pck_vector_t*)calloc(N, sizeof(pck_vector_t));
-        if (G[i-1] == NULL) {
-            should_free_G_count = i-1;
-            break;
-        }
-        convert_input_equations(n, degree, settings->word_size*i, min(n_eqs, settings->word_size*(i+1)), coeffs, testing_LUT, G[i-1]);
-    }
-    should_free_G_count -= 1;
-    while (should_free_G_count >= 0 && G[should_free_G_count]) {
-        free(G[should_free_G_count] );
-        should_free_G_count -= 1;
-    }
-    if (should_free_G_count == -1) {
-        if (should_free_G && G)
-            free(G);
-        if (should_free_F && F)
-            free(F);
-        if (should_free_LUT && idx_LUT)
-            free_LUT(idx_LUT);
-        return -4;
+    const int degree = sys->degree;
+    const int word_size = sys->settings.word_size;
+
+    // the quadratic terms were packed once, only the lower degree terms
+    // depend on the random start point and on the fixed variables
+    memcpy(F, sys->quad, sys->n_batches * sys->N * sizeof(pck_vector_t));
+    for(int i=0; i<sys->n_batches; i++) {
+        convert_input_equations_range(sys->n, 0, min(1, degree), word_size*i, min(sys->n_eqs, word_size*(i+1)), coeffs, sys->idx_LUT, F + i*sys->N);
     }
 
+    return exhaustive_search_prepared(sys, F, callback, callback_state, cancel);
+}
 
-    // the "tester" needs some internal state
-    bool should_free_tester_state = 0;
-    if ( ( tester_state = (wrapper_state_t*)malloc( sizeof(wrapper_state_t) ) ) == NULL) {
-        if (should_free_G && G) {
-            for(int i=n_batches-1; i>=1; i--) {
-                free(G[i-1]);
-            }
-            free(G);
-        }
-        if (should_free_F && F )
-            free(F);
-        if (should_free_LUT && idx_LUT)
-            free_LUT(idx_LUT);
-        return -4;
+// Search the system whose packed n_batches * N words are already in F, F has
+// room for sys->scratch_words words.
+static int exhaustive_search_prepared(packed_system_t *sys, pck_vector_t *F,
+                                      solution_callback_t callback, void* callback_state,
+                                      const CMQCancelToken* cancel) {
+    const int n = sys->n;
+    const int degree = sys->degree;
+
+    // the first batch goes into the enumeration code, the next ones are used by the tester
+    pck_vector_t *G[sys->n_batches];
+    for(int i=1; i<sys->n_batches; i++) {
+        G[i-1] = F + i*sys->N;
     }
-    should_free_tester_state = 1;
 
+    // the "tester" needs some internal state
+    wrapper_state_t tester_state[1];
     tester_state->n = n;
     tester_state->degree = degree;
-    tester_state->n_batches = n_batches-1;
+    tester_state->n_batches = sys->n_batches-1;
     tester_state->G = G;
-    tester_state->testing_LUT = testing_LUT;
-
+    tester_state->testing_LUT = sys->idx_LUT;
+    tester_state->settings = &sys->settings;
     tester_state->callback = callback;
     tester_state->callback_state = callback_state;
-    //must_free_tester_state = true;
-
-    callback = solution_tester;
-    callback_state = (void *) tester_state;
 
     // ------------ start actual computation
-    verbose_print(settings, "starting kernel");
+    verbose_print(&sys->settings, "starting kernel");
     uint64_t start = rdtsc();
+    MQStartCandidates();
 
-    enumeration_wrapper(idx_LUT->LUT, n, degree, F, callback, callback_state, settings, pindexPrev);
+    if ( sys->settings.algorithm == ALGO_FFT ) {
+        pck_vector_t *A = F + sys->n_batches * sys->N;
+        moebius_load_deg_2(sys->idx_LUT->LUT, n, F, A);
+        moebius_wrapper(n, A, solution_tester, (void *) tester_state, &sys->settings, cancel);
+    } else {
+        enumeration_wrapper(sys->idx_LUT->LUT, n, degree, F, solution_tester, (void *) tester_state, &sys->settings, cancel);
+    }
 
+    MQFlushCandidates();
     uint64_t totalTime = rdtsc() - start;
-    verbose_print(settings, "%.2f CPU cycles/candidate solution", totalTime * 1.0 / (1ll << n));
+    verbose_print(&sys->settings, "%.2f CPU cycles/candidate solution", totalTime * 1.0 / (1ll << n));
+
+    return 0;
+}
+
+static int MQIgnoreSolutions(void *, uint64_t, uint64_t *) {
+    return 0;
+}
+
+int exhaustive_search_wrapper(const int n, int n_eqs, const int degree,
+                                             int ***coeffs, solution_callback_t callback,
+                                             void* callback_state, const CMQCancelToken* cancel) {
+    if (cancel->IsCancelled()) {
+        return -5;
+    }
+
+    packed_system_t *sys = init_packed_system(n, n_eqs, degree, coeffs);
+    if (sys == NULL) {
+        return -4;
+    }
+    pck_vector_t *F = (pck_vector_t *)malloc(sys->scratch_words * sizeof(pck_vector_t));
+    if (F == NULL) {
+        free_packed_system(sys);
+        return -4;
+    }
+
+    int ret = exhaustive_search_packed(sys, F, coeffs, callback, callback_state, cancel);
+
+    free(F);
+    free_packed_system(sys);
+    return ret;
+}
 
-    // ----------- clean up
+// Cycles per candidate of the degree 2 solver `algorithm` on a fixed random
+// system of n variables and n_eqs equations, the best of two runs.
+static double MQMeasureSolver(int n, int n_eqs, int algorithm) {
+    int ***coeffs = CreateEquations(n, n_eqs);
+    uint64_t x = 0x9e3779b97f4a7c15ULL ^ ((uint64_t)n << 32) ^ (uint64_t)n_eqs;
+    for (int i = 0; i < n_eqs; i++)
+        for (int d = 0; d <= 2; d++)
+            for (uint64_t k = 0; k < binomials[n][d]; k++) {
+                x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+                coeffs[i][d][k] = x & 1;
+            }
 
-    if (should_free_tester_state && tester_state)
-        free(tester_state);
-    if (should_free_G && G) {
-        for(int i=n_batches-1; i>=1; i--) {
-            if (G[i-1])
-                free(G[i-1]);
+    double best = -1;
+    packed_system_t *sys = init_packed_system_algorithm(n, n_eqs, 2, coeffs, algorithm);
+    if (sys != NULL) {
+        std::vector<pck_vector_t> F(sys->scratch_words);
+        std::atomic<uint64_t> epoch(0);
+        CMQCancelToken cancel(epoch);
+
+        // the runs are not work of the miner, leave the counters of this thread alone
+        CMQSolverStats& stats = mqSolverStats;
+        uint64_t nCandidates = stats.nCandidates, nTested = stats.nTested, nCycles = stats.nCycles;
+        for (int run = 0; run < 2; run++) {
+            uint64_t start = rdtsc();
+            exhaustive_search_packed(sys, &F[0], coeffs, MQIgnoreSolutions, NULL, &cancel);
+            double cycles = (double)(rdtsc() - start) / ((uint64_t)1 << n);
+            if (best < 0 || cycles < best)
+                best = cycles;
         }
-        free(G);
+        stats.nCandidates = nCandidates;
+        stats.nTested = nTested;
+        stats.nCycles = nCycles;
+        free_packed_system(sys);
     }
-    if (should_free_F && F)
-        free(F);
-    if (should_free_LUT && idx_LUT)
-        free_LUT(idx_LUT);
+    FreeEquations(n_eqs, coeffs);
+    return best;
+}
 
-    return 0;
+// The measures of MQTuneSolver(), by number of variables and of equations,
+// ALGO_AUTO while a thread is measuring
+static CCriticalSection cs_mqSolver;
+static std::map<std::pair<int, int>, int> mapMQSolver;
+
+void MQTuneSolver(int nVariables, int nEquations)
+{
+    if (nVariables > MQ_FFT_MAX_VARIABLES || nMQSolver != ALGO_AUTO)
+        return;
+    std::pair<int, int> size(nVariables, nEquations);
+    {
+        LOCK(cs_mqSolver);
+        if (mapMQSolver.count(size))
+            return;
+        mapMQSolver[size] = ALGO_AUTO;
+    }
 
+    // the enumeration does a few cycles per candidate whatever the size, the
+    // transform does n/2 XORs per word but is bounded by the memory bandwidth
+    // once the table leaves the cache: measure both on a system of this size
+    double dEnumeration = MQMeasureSolver(nVariables, nEquations, ALGO_ENUMERATION);
+    double dFFT = MQMeasureSolver(nVariables, nEquations, ALGO_FFT);
+    int nAlgorithm = (dFFT >= 0 && dFFT < dEnumeration) ? ALGO_FFT : ALGO_ENUMERATION;
+    printf("MQSolver: %d variables, %d equations: %.2f cycles/candidate enumerating, %.2f with the FFT\n",
+           nVariables, nEquations, dEnumeration, dFFT);
+
+    LOCK(cs_mqSolver);
+    mapMQSolver[size] = nAlgorithm;
+}
+
+int MQSolver(int nVariables, int nEquations)
+{
+    // the table of the transform has 2^nVariables words
+    if (nVariables > MQ_FFT_MAX_VARIABLES)
+        return ALGO_ENUMERATION;
+    if (nMQSolver != ALGO_AUTO)
+        return nMQSolver;
+
+    LOCK(cs_mqSolver);
+    std::map<std::pair<int, int>, int>::iterator it = mapMQSolver.find(std::make_pair(nVariables, nEquations));
+    if (it != mapMQSolver.end() && it->second != ALGO_AUTO)
+        return it->second;
+    return ALGO_ENUMERATION;
 }
 
 struct exfes_context {
@@ -1227,17 +1949,8 @@ int Merge_Solution (void *_ctx_ptr, uint64_t count, uint64_t *Sol) {
     return 1;
 }
 
-void exfes(int m, int n, int e, uint64_t *Mask, uint64_t maxsol, int ***Eqs, uint64_t **SolArray,CBlockIndex* pindexPrev) {
-    struct exfes_context exfes_ctx;
-    exfes_ctx.mcopy = m;
-    exfes_ctx.ncopy = n;
-    exfes_ctx.solm = 0;
-    exfes_ctx.SolMerge = SolArray;
-    exfes_ctx.SolCount = 0;
-    exfes_ctx.MaxSolCount = maxsol;
-    exfes_ctx.MaskCopy = Mask;
-
-    // Mask Eqs for a random start point.
+// Mask Eqs for a random start point.
+void exfes_mask(int n, int e, uint64_t *Mask, int ***Eqs) {
     for (int i=0; i<e; i++) {
         for (int j=0; j<n; j++)
             Eqs[i][0][0] ^= Eqs[i][1][j] & M(Mask, j);
@@ -1250,52 +1963,157 @@ void exfes(int m, int n, int e, uint64_t *Mask, uint64_t maxsol, int ***Eqs, uin
                 offset += 1;
             }
     }
-    // Make a copy of Eqs for evaluating fixed variables.
-    int *** EqsCopy = CreateEquations(n, e);
+}
 
-    // Partition problem into (1<<n_fixed) sub_problems.
-    int p = n - m;
-    int npartial;
-    int fixvalue;
-    for (exfes_ctx.solm=0; exfes_ctx.solm<(uint64_t)1<<m; exfes_ctx.solm++) {
-        if (pindexPrev != pindexBest)
-            break;
-        // Initialize npartial and EqsCopy.
-        npartial = n;
-        for (int i=0; i<e; i++)
-            for (int j=0; j<3; j++)
-                for (int k=0; k<C(n, j); k++)
-                    EqsCopy[i][j][k] = Eqs[i][j][k];
-        // Fix m variables.
-        while (npartial != p) {
-            fixvalue = (exfes_ctx.solm >> (n - npartial)) & 1;
-            for (int i=0; i<e; i++) {
-                // Fix a variable.
-                for (int j=0; j<npartial-1; j++)
-                    EqsCopy[i][1][j+1] ^= EqsCopy[i][2][j] & fixvalue;
-                EqsCopy[i][0][0] ^= EqsCopy[i][1][0] & fixvalue;
-                // Shrink EqsCopy.
-                for (int j=0; j<npartial-1; j++)
-                    EqsCopy[i][1][j] = EqsCopy[i][1][j+1];
-                for (int j=0; j<C(npartial-1, 2); j++)
-                    EqsCopy[i][2][j] = EqsCopy[i][2][j+npartial-1];
-            }
-            npartial -= 1;
-        }
+// Offset of the first quadratic term x_j*x_k (j<k) of an n variable system.
+static inline int QuadraticOffset(int n, int j) {
+    return j * (2 * n - j - 1) / 2;
+}
 
-        if (exhaustive_search_wrapper(npartial, e, 2, EqsCopy, Merge_Solution, &exfes_ctx,  pindexPrev) != 0) {
-            break;
+exfes_packed_eqs_t *exfes_pack_equations(int m, int n, int e, int ***Eqs, const packed_system_t *sys) {
+    exfes_packed_eqs_t *eqs = (exfes_packed_eqs_t *)calloc(1, sizeof(exfes_packed_eqs_t));
+    if (eqs == NULL) {
+        return NULL;
+    }
+    eqs->m = m;
+    eqs->n = n;
+    eqs->n_batches = sys->n_batches;
+    eqs->stride = 1 + n + QuadraticOffset(n, m);
+    eqs->words = (pck_vector_t *)calloc(eqs->n_batches * eqs->stride, sizeof(pck_vector_t));
+    if (eqs->words == NULL) {
+        free(eqs);
+        return NULL;
+    }
+
+    const int word_size = sys->settings.word_size;
+    for (int i=0; i<e; i++) {
+        pck_vector_t *P = eqs->words + (i / word_size) * eqs->stride;
+        const pck_vector_t bit = (pck_vector_t)1 << (i % word_size);
+        if (Eqs[i][0][0] & 1)
+            P[0] |= bit;
+        for (int j=0; j<n; j++)
+            if (Eqs[i][1][j] & 1)
+                P[1 + j] |= bit;
+        for (uint64_t q=0; q<eqs->stride - 1 - n; q++)
+            if (Eqs[i][2][q] & 1)
+                P[1 + n + q] |= bit;
+    }
+    return eqs;
+}
+
+void free_exfes_packed_eqs(exfes_packed_eqs_t *eqs) {
+    if (eqs) {
+        free(eqs->words);
+        free(eqs);
+    }
+}
+
+// Fix the first m variables of eqs to the bits of solm, and write the constant
+// and linear terms of the resulting (n-m) variable system into F, whose
+// quadratic terms were copied from sys->quad: they do not depend on solm.
+static void exfes_fix_variables(const exfes_packed_eqs_t *eqs, uint64_t solm, const packed_system_t *sys, pck_vector_t *F) {
+    const int m = eqs->m;
+    const int n = eqs->n;
+    LUT_t LUT = sys->idx_LUT->LUT;
+
+    for (int b=0; b<eqs->n_batches; b++) {
+        const pck_vector_t *P = eqs->words + b * eqs->stride;
+        const pck_vector_t *linear = P + 1;
+        pck_vector_t *Fb = F + b * sys->N;
+
+        pck_vector_t constant = P[0];
+        for (int k=m; k<n; k++)
+            Fb[ idx_1(LUT, k-m) ] = linear[k];
+
+        for (int j=0; j<m; j++) {
+            if (((solm >> j) & 1) == 0)
+                continue;
+            // x_j x_k for k > j
+            const pck_vector_t *quadratic = P + 1 + n + QuadraticOffset(n, j) - (j + 1);
+            constant ^= linear[j];
+            for (int k=j+1; k<m; k++)
+                if ((solm >> k) & 1)
+                    constant ^= quadratic[k];
+            for (int k=m; k<n; k++)
+                Fb[ idx_1(LUT, k-m) ] ^= quadratic[k];
         }
+        Fb[0] = constant;
+    }
+}
+
+// Pack the quadratic part shared by all the sub-problems of Eqs, i.e. the terms
+// of Eqs in its last n-m variables. Masking Eqs does not change it either.
+packed_system_t *exfes_packed_system(int m, int n, int e, int ***Eqs) {
+    int p = n - m;
+    int ***EqsQuadratic = CreateEquations(p, e);
+    for (int i=0; i<e; i++)
+        memcpy(EqsQuadratic[i][2], Eqs[i][2] + QuadraticOffset(n, m), C(p, 2) * sizeof(int));
+    packed_system_t *sys = init_packed_system(p, e, 2, EqsQuadratic);
+    FreeEquations(e, EqsQuadratic);
+    return sys;
+}
+
+// Solve the sub-problem `solm` of the (masked) equations eqs, i.e. the system
+// obtained by fixing their first m variables to the bits of solm. sys comes from
+// exfes_packed_system(m, n, e, Eqs), eqs from exfes_pack_equations(m, n, e, Eqs, sys)
+// and F is scratch space for exhaustive_search_packed(). Returns 1 when a solution
+// was stored in SolArray, 0 when the sub-problem has none and -1 when the search
+// was aborted.
+int exfes_subproblem(int m, int n, uint64_t *Mask, uint64_t solm, const exfes_packed_eqs_t *eqs, packed_system_t *sys, pck_vector_t *F, uint64_t **SolArray, const CMQCancelToken* cancel) {
+    struct exfes_context exfes_ctx;
+    exfes_ctx.mcopy = m;
+    exfes_ctx.ncopy = n;
+    exfes_ctx.solm = solm;
+    exfes_ctx.SolMerge = SolArray;
+    exfes_ctx.SolCount = 0;
+    exfes_ctx.MaxSolCount = 1;
+    exfes_ctx.MaskCopy = Mask;
+
+    if (cancel->IsCancelled()) {
+        return -1;
+    }
+    memcpy(F, sys->quad, sys->n_batches * sys->N * sizeof(pck_vector_t));
+    exfes_fix_variables(eqs, solm, sys, F);
 
+    if (exhaustive_search_prepared(sys, F, Merge_Solution, &exfes_ctx, cancel) != 0 ||
+        (exfes_ctx.SolCount == 0 && cancel->IsCancelled())) {
+        return -1;
+    }
+
+    CMQSolverStats::Add(mqSolverStats.nSubProblems, 1);
+    return exfes_ctx.SolCount == 1 ? 1 : 0;
+}
+
+// Search the sub-problems of the (masked) Eqs in order, stopping at the first solution.
+void exfes_search(int m, int n, int e, uint64_t *Mask, int ***Eqs, packed_system_t *sys, uint64_t **SolArray, const CMQCancelToken* cancel) {
+    exfes_packed_eqs_t *eqs = exfes_pack_equations(m, n, e, Eqs, sys);
+    pck_vector_t *F = (pck_vector_t *)malloc(sys->scratch_words * sizeof(pck_vector_t));
+
+    // Partition problem into (1<<n_fixed) sub_problems.
+    for (uint64_t solm=0; eqs != NULL && F != NULL && solm<(uint64_t)1<<m; solm++) {
+        if (cancel->IsCancelled())
+            break;
         // Determine to early aborb or not.
-        if (exfes_ctx.SolCount == 1)
+        if (exfes_subproblem(m, n, Mask, solm, eqs, sys, F, SolArray, cancel) != 0)
             break;
     }
 
-    FreeEquations(e, EqsCopy);
-
+    free(F);
+    free_exfes_packed_eqs(eqs);
 }
 
+void exfes(int m, int n, int e, uint64_t *Mask, uint64_t maxsol, int ***Eqs, uint64_t **SolArray, const CMQCancelToken* cancel) {
+    // the search stops at the first solution, which goes to SolArray[0]
+    (void)maxsol;
+    packed_system_t *sys = exfes_packed_system(m, n, e, Eqs);
+    if (sys == NULL)
+        return;
+
+    exfes_mask(n, e, Mask, Eqs);
+    exfes_search(m, n, e, Mask, Eqs, sys, SolArray, cancel);
+
+    free_packed_system(sys);
+}
 
 
 uint64 nLastBlockTx = 0;
@@ -1723,21 +2541,6 @@ static int Binomial(int n, int m) {
         return 0;
 }
 
-// Transform coefficientsMatrix into the structure required by exfes.
-static void TransformDataStructure (int n, int e, std::vector<uint8_t> &coefficientsMatrix, int ***Eqs) {
-    uint64_t offset = 0;
-    for (int i=0; i<e; i++) {
-        for (int j=0; j<Binomial(n, 2); j++)
-            Eqs[i][2][j] = (int)coefficientsMatrix[offset+j];
-        offset += Binomial(n, 2);
-        for (int j=0; j<n; j++)
-            Eqs[i][1][j] = (int)coefficientsMatrix[offset+j];
-        offset += n;
-        Eqs[i][0][0] = (int)coefficientsMatrix[offset];
-        offset += 1;
-    }
-}
-
 // Define a function to print equations for debugging.
 void PrintEquation (int n, int e, int ***Eqs) {
     for (int i=0; i<e; i++) {
@@ -1796,7 +2599,7 @@ void FreeArray (uint64_t maxsol, uint64_t **SolArray) {
 
 
 // Define a function to print solutions obtained from exfes.
-static int ReportSolution (uint64_t maxsol, uint64_t **SolArray, uint256 &s) {
+int ReportSolution (uint64_t maxsol, uint64_t **SolArray, uint256 &s) {
     for (uint64_t i=0; i<maxsol; i++) {
         for (int j=3; j>=0; j--) {
             s = s << 64;
@@ -1806,75 +2609,306 @@ static int ReportSolution (uint64_t maxsol, uint64_t **SolArray, uint256 &s) {
     return 0;
 }
 
+bool UseNewCoeffMatrix(int nHeight) {
+    return nHeight >= 25217;
+}
+
+CMQSolverContext::CMQSolverContext(uint256 seedHashIn, unsigned int nBitsIn, bool fNewCoeffMatrixIn, int nSearchVariablesIn) :
+    seedHash(seedHashIn), nBits(nBitsIn), fNewCoeffMatrix(fNewCoeffMatrixIn), nSearchVariables(nSearchVariablesIn),
+    nUnknowns(nBitsIn + 8), mEquations(nBitsIn), Eqs(NULL), sys(NULL)
+{
+    // the rows of the coefficient matrix are in the order of Eqs: the
+    // quadratic terms, then the linear terms and the constant term
+    CMQCoeffGenerator generator(seedHash, nBits, fNewCoeffMatrix);
+    std::vector<uint64_t> row(generator.RowWords());
+    const int nQuadratic = Binomial(nUnknowns, 2);
+    Eqs = CreateEquations(nUnknowns, mEquations);
+    for (int i=0; i<mEquations; i++) {
+        generator.Next(&row[0]);
+        for (int t=0; t<nQuadratic; t++)
+            Eqs[i][2][t] = (row[t / 64] >> (t % 64)) & 1;
+        for (int j=0; j<nUnknowns; j++) {
+            const int t = nQuadratic + j;
+            Eqs[i][1][j] = (row[t / 64] >> (t % 64)) & 1;
+        }
+        const int t = nQuadratic + nUnknowns;
+        Eqs[i][0][0] = (row[t / 64] >> (t % 64)) & 1;
+    }
+    sys = exfes_packed_system(nSearchVariables, nUnknowns, mEquations, Eqs);
+}
+
+CMQSolverContext::~CMQSolverContext()
+{
+    free_packed_system(sys);
+    FreeEquations(mEquations, Eqs);
+}
+
+exfes_packed_eqs_t *CMQSolverContext::PackedMaskedEquations(uint64_t *Mask) const
+{
+    int ***EqsMasked = MaskedEquations(Mask);
+    exfes_packed_eqs_t *eqs = exfes_pack_equations(nSearchVariables, nUnknowns, mEquations, EqsMasked, sys);
+    FreeEquations(mEquations, EqsMasked);
+    return eqs;
+}
+
+int ***CMQSolverContext::MaskedEquations(uint64_t *Mask) const
+{
+    int ***EqsMasked = CreateEquations(nUnknowns, mEquations);
+    for (int i=0; i<mEquations; i++)
+        for (int j=0; j<3; j++)
+            memcpy(EqsMasked[i][j], Eqs[i][j], Binomial(nUnknowns, j) * sizeof(int));
+    exfes_mask(nUnknowns, mEquations, Mask, EqsMasked);
+    return EqsMasked;
+}
+
+// A template is usually searched several times, by every miner thread and from
+// several start points, so keep the contexts of the last few templates around.
+static const unsigned int nMaxMQSolverContexts = 4;
+static CCriticalSection cs_mqSolverContexts;
+static std::list<boost::shared_ptr<const CMQSolverContext> > lMQSolverContexts; // most recently used first
+
+boost::shared_ptr<const CMQSolverContext> GetMQSolverContext(uint256 seedHash, unsigned int nBits, int nHeight, int nSearchVariables)
+{
+    bool fNewCoeffMatrix = UseNewCoeffMatrix(nHeight);
+
+    LOCK(cs_mqSolverContexts);
+    // the solver and word size the sub-problems would be packed for now
+    wrapper_settings_t settings;
+    init_settings(&settings);
+    choose_settings(&settings, nBits + 8 - nSearchVariables, nBits, 2);
+    for (std::list<boost::shared_ptr<const CMQSolverContext> >::iterator it = lMQSolverContexts.begin(); it != lMQSolverContexts.end(); ++it) {
+        const CMQSolverContext& context = **it;
+        if (context.seedHash == seedHash && context.nBits == nBits && context.fNewCoeffMatrix == fNewCoeffMatrix &&
+            context.nSearchVariables == nSearchVariables && context.PackedSystem()->settings.algorithm == settings.algorithm &&
+            context.PackedSystem()->settings.word_size == settings.word_size) {
+            lMQSolverContexts.splice(lMQSolverContexts.begin(), lMQSolverContexts, it);
+            return lMQSolverContexts.front();
+        }
+    }
+
+    boost::shared_ptr<const CMQSolverContext> pcontext(new CMQSolverContext(seedHash, nBits, fNewCoeffMatrix, nSearchVariables));
+    if (!pcontext->IsValid())
+        return boost::shared_ptr<const CMQSolverContext>();
+    lMQSolverContexts.push_front(pcontext);
+    if (lMQSolverContexts.size() > nMaxMQSolverContexts)
+        lMQSolverContexts.pop_back();
+    return pcontext;
+}
+
+int MQSearchVariables(int nUnknowns, uint64_t nSubProblems)
+{
+    // enough sub-problems for every thread, but not so many that they
+    // become too small for the enumeration kernels
+    int nSearchVariables = nUnknowns > 62 ? nUnknowns - 62 : 0;
+    while (((uint64_t)1 << nSearchVariables) < nSubProblems &&
+           nUnknowns - nSearchVariables > SIMD_CHUNK_SIZE + 8)
+        nSearchVariables++;
+    return nSearchVariables;
+}
+
 uint256 SerchSolution(uint256 hash, unsigned int nBits, uint256 randomNonce, CBlockIndex* pindexPrev) {
-    unsigned int mEquations = nBits;
     unsigned int nUnknowns = nBits + 8;
-    unsigned int nTerms = 1 + (nUnknowns+1)*(nUnknowns)/2;
-    std::vector<uint8_t> coeffMatrix;
-    coeffMatrix.resize(mEquations*nTerms);
-	if (pindexPrev->nHeight < 25216) {
-        GenCoeffMatrix(hash, nBits, coeffMatrix);
-	} else {
-        NewGenCoeffMatrix(hash, nBits, coeffMatrix);
-	}
-    int ***Eqs = CreateEquations(nUnknowns, mEquations);
+    int nSearchVariables = 0;
+    if (nUnknowns > 62) {
+        nSearchVariables = nUnknowns - 62;
+    } else {
+        nSearchVariables = 0;
+    }
+    boost::shared_ptr<const CMQSolverContext> pcontext = GetMQSolverContext(hash, nBits, pindexPrev->nHeight + 1, nSearchVariables);
+    uint256 nonce = 0;
+    if (!pcontext)
+        return nonce;
+
+    CMQCancelToken cancel;
     uint64_t maxsol = 1; // The solver only returns maxsol solutions. Other solutions will be discarded.
     uint64_t **SolArray = CreateArray(maxsol); // Set all array elements to zero.
     //serch
-    uint256 nonce = 0;
     uint64_t startPoint[4];
     for (int width = 0; width < 4; width++) {
         startPoint[width] = randomNonce.Get64(width);
     }
-    int nSearchVariables = 0;
-    if (nUnknowns > 62) {
-        nSearchVariables = nUnknowns - 62;
-    } else {
-        nSearchVariables = 0;
-    }
-    TransformDataStructure(nUnknowns, mEquations, coeffMatrix, Eqs); // Transform coefficientsMatrix into the structure required by exfes.
-    exfes(nSearchVariables, nUnknowns, mEquations, startPoint, maxsol, Eqs, SolArray, pindexPrev); // Solve equations by exfes.
+    int ***Eqs = pcontext->MaskedEquations(startPoint);
+    exfes_search(nSearchVariables, nUnknowns, pcontext->mEquations, startPoint, Eqs, pcontext->PackedSystem(), SolArray, &cancel); // Solve equations by exfes.
     ReportSolution(maxsol, SolArray, nonce); // Report obtained solutions in uint256 format.
-    FreeEquations(mEquations, Eqs);
+    FreeEquations(pcontext->mEquations, Eqs);
     FreeArray(maxsol, SolArray);
     return nonce;
-
 }
 
-bool CheckSolution(uint256 hash, unsigned int nBits, uint256 preblockhash, int nblockversion, uint256 nNonce) {
-    unsigned int mEquations = nBits;
-    unsigned int nUnknowns = nBits+8;
-    unsigned int nTerms = 1 + (nUnknowns+1)*(nUnknowns)/2;
-    std::vector<uint8_t> coeffMatrix;
-    coeffMatrix.resize(mEquations*nTerms);
-
-    // Get prev block index
-    CBlockIndex* pindexPrev = NULL;
+// Height of the block whose solution is checked, which selects the coefficient rule.
+static int SolutionHeight(uint256 preblockhash, int nblockversion) {
     int height = 0;
-	uint256 initHash = 0;
+    uint256 initHash = 0;
     if (preblockhash != initHash) {
         std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(preblockhash);
         if (mi == mapBlockIndex.end()) {
             if (nblockversion == 1) {
                 height = 0;
-			}
-			if (nblockversion == 2) {
+            }
+            if (nblockversion == 2) {
                 height = 25217;
-			}
-		} else {
-            pindexPrev = (*mi).second;
-            height = pindexPrev->nHeight+1;
-		}
+            }
+        } else {
+            height = (*mi).second->nHeight+1;
+        }
+    }
+    return height;
+}
+
+// 64 bits of src starting at bit nOffset, src needs one word of padding.
+static inline uint64_t GetBits64(const uint64_t *src, unsigned int nOffset) {
+    unsigned int w = nOffset / 64, s = nOffset % 64;
+    uint64_t r = src[w] >> s;
+    if (s)
+        r |= src[w+1] << (64 - s);
+    return r;
+}
+
+// Or nCount bits of src starting at bit nSrcOffset into dst starting at bit
+// nDstOffset. Both buffers need one word of padding.
+static void CopyBits(uint64_t *dst, unsigned int nDstOffset, const uint64_t *src, unsigned int nSrcOffset, unsigned int nCount) {
+    for (unsigned int k = 0; k < nCount; k += 64) {
+        uint64_t word = GetBits64(src, nSrcOffset + k);
+        if (nCount - k < 64)
+            word &= ((uint64_t)1 << (nCount - k)) - 1;
+        unsigned int w = (nDstOffset + k) / 64, s = (nDstOffset + k) % 64;
+        dst[w] |= word << s;
+        if (s)
+            dst[w+1] |= word >> (64 - s);
+    }
+}
+
+// Pack a SHA-256 output into 4 words, in the bit order of Uint256ToBits.
+static inline void PackHashBits(const unsigned char *bytes, uint64_t *words) {
+    for (int i = 0; i < 4; i++) {
+        uint64_t word = 0;
+        for (int j = 7; j >= 0; j--)
+            word = (word << 8) | bytes[i*8+j];
+        words[i] = word;
+    }
+}
+
+CMQCoeffGenerator::CMQCoeffGenerator(uint256 hash, unsigned int nBits, bool fNewCoeffMatrixIn) :
+    fNewCoeffMatrix(fNewCoeffMatrixIn), nTerms(1 + (nBits+9)*(nBits+8)/2), nWords((nTerms + 63) / 64),
+    nHashes((nTerms + 255) / 256), nRow(0)
+{
+    pqcSha256(hash.begin(), 32, in);
+    if (!fNewCoeffMatrix) {
+        // GenCoeffMatrix: equation k is the first one rotated right by k+1
+        // terms, i.e. a window of two copies of it
+        std::vector<uint64_t> first(4 * nHashes + 1, 0);
+        NextHashes(&first[0]);
+        twice.assign(2 * nWords + 2, 0);
+        CopyBits(&twice[0], 0, &first[0], 0, nTerms);
+        CopyBits(&twice[0], nTerms, &first[0], 0, nTerms);
+    }
+}
+
+// The next nHashes outputs of the SHA-256 chain, packed from row[0] on.
+void CMQCoeffGenerator::NextHashes(uint64_t *row)
+{
+    for (unsigned int h = 0; h < nHashes; h++) {
+        unsigned char out[32];
+        pqcSha256(in, 32, out);
+        PackHashBits(out, &row[4*h]);
+        memcpy(in, out, 32);
+    }
+}
+
+void CMQCoeffGenerator::Next(uint64_t *row)
+{
+    if (fNewCoeffMatrix) {
+        // NewGenCoeffMatrix: the chain goes on with the next equation, so
+        // the last hash of a row only has its first bits used
+        NextHashes(row);
     } else {
-        height = 0;
-	}
-    if (height < 25217) {
-	    GenCoeffMatrix(hash, nBits, coeffMatrix);
+        unsigned int nOffset = nTerms - (nRow+1) % nTerms;
+        for (unsigned int w = 0; w < nWords; w++)
+            row[w] = GetBits64(&twice[0], nOffset + 64*w);
+    }
+    if (nTerms % 64)
+        row[nWords-1] &= ((uint64_t)1 << (nTerms % 64)) - 1;
+    for (unsigned int w = nWords; w < RowWords(); w++)
+        row[w] = 0;
+    nRow++;
+}
+
+// Bit t of terms is the value at nNonce of the t-th term of the equations, in
+// the order of the coefficient matrix: x[i]*x[j] for i<j, then x[i], then 1.
+static void SolutionToPackedTerms(unsigned int nUnknowns, uint256 nNonce, std::vector<uint64_t> &terms) {
+    unsigned int nTerms = 1 + (nUnknowns+1)*(nUnknowns)/2;
+    terms.assign((nTerms + 63) / 64 + 1, 0);
+
+    // the unknowns past the 256 bits of the nonce are zero
+    uint64_t x[(256 + 8) / 64 + 2] = {0};
+    for (int width = 0; width < 4; width++)
+        x[width] = nNonce.Get64(width);
+    if (nUnknowns < 256)
+        x[nUnknowns / 64] &= ((uint64_t)1 << (nUnknowns % 64)) - 1;
+    for (unsigned int w = nUnknowns / 64 + 1; w < sizeof(x) / sizeof(x[0]); w++)
+        x[w] = 0;
+
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < nUnknowns; i++) {
+        if ((x[i / 64] >> (i % 64)) & 1)
+            CopyBits(&terms[0], count, x, i+1, nUnknowns-1-i);
+        count += nUnknowns-1-i;
+    }
+    CopyBits(&terms[0], count, x, 0, nUnknowns);
+    count += nUnknowns;
+    terms[count / 64] |= (uint64_t)1 << (count % 64);
+}
+
+// Parity of the number of terms present both in row and in terms.
+static inline int PackedEval(const uint64_t *row, const uint64_t *terms, unsigned int nWords) {
+    uint64_t acc = 0;
+    for (unsigned int w = 0; w < nWords; w++)
+        acc ^= row[w] & terms[w];
+    return __builtin_parityll(acc);
+}
+
+bool CheckSolution(uint256 hash, unsigned int nBits, uint256 preblockhash, int nblockversion, uint256 nNonce) {
+    return CheckSolution(hash, nBits, UseNewCoeffMatrix(SolutionHeight(preblockhash, nblockversion)), nNonce);
+}
+
+bool CheckSolution(uint256 hash, unsigned int nBits, bool fNewCoeffMatrix, uint256 nNonce) {
+    unsigned int mEquations = nBits;
+    unsigned int nUnknowns = nBits+8;
+    unsigned int nTerms = 1 + (nUnknowns+1)*(nUnknowns)/2;
+    unsigned int nWords = (nTerms + 63) / 64;
+
+    std::vector<uint64_t> terms;
+    SolutionToPackedTerms(nUnknowns, nNonce, terms);
+
+    // the coefficients of an equation are only generated when the previous
+    // equations are satisfied
+    CMQCoeffGenerator generator(hash, nBits, fNewCoeffMatrix);
+    std::vector<uint64_t> row(generator.RowWords());
+    for (unsigned int k = 0; k < mEquations; k++) {
+        generator.Next(&row[0]);
+        if (PackedEval(&row[0], &terms[0], nWords))
+            return false;
+    }
+
+    return true;
+}
+
+// Byte per coefficient version of CheckSolution, kept as a reference.
+bool CheckSolutionBytewise(uint256 hash, unsigned int nBits, uint256 preblockhash, int nblockversion, uint256 nNonce) {
+    unsigned int mEquations = nBits;
+    unsigned int nUnknowns = nBits+8;
+    unsigned int nTerms = 1 + (nUnknowns+1)*(nUnknowns)/2;
+    std::vector<uint8_t> coeffMatrix;
+    coeffMatrix.resize(mEquations*nTerms);
+
+    if (SolutionHeight(preblockhash, nblockversion) < 25217) {
+        GenCoeffMatrix(hash, nBits, coeffMatrix);
     } else {
         NewGenCoeffMatrix(hash, nBits, coeffMatrix);
-	}
+    }
     unsigned int i, j, k, count;
     uint8_t x[nUnknowns], tempbit;
+    memset(x, 0, nUnknowns);
     Uint256ToSolutionBits(x, nUnknowns, nNonce);
 
     for (k = 0; k < mEquations; k++) {
@@ -1901,7 +2935,80 @@ bool CheckSolution(uint256 hash, unsigned int nBits, uint256 preblockhash, int n
 }
 
 
+/** Valid (seed hash, nBits, nonce, coefficient rule) proofs of work, so that
+ *  headers which were already verified, like the ones of blocks read back from
+ *  disk, do not evaluate their equation system again.
+ */
+class CPoWCache
+{
+private:
+    typedef boost::tuple<uint256, unsigned int, uint256, bool> powdata_type;
+    std::set<powdata_type> setValid;
+    boost::shared_mutex cs_powcache;
+
+public:
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
+
+    CPoWCache() : nHits(0), nMisses(0) {}
+
+    bool Get(uint256 hash, unsigned int nBits, uint256 nNonce, bool fNewCoeffMatrix)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_powcache);
+
+        if (setValid.count(powdata_type(hash, nBits, nNonce, fNewCoeffMatrix))) {
+            nHits++;
+            return true;
+        }
+        nMisses++;
+        return false;
+    }
+
+    void Set(uint256 hash, unsigned int nBits, uint256 nNonce, bool fNewCoeffMatrix)
+    {
+        // ~150 bytes per entry, 100,000 entries is enough for the headers
+        // of the blocks touched by a rescan or a reindex
+        int64 nMaxCacheSize = GetArg("-maxpowcachesize", 100000);
+        if (nMaxCacheSize <= 0) return;
+
+        boost::unique_lock<boost::shared_mutex> lock(cs_powcache);
+
+        while (static_cast<int64>(setValid.size()) >= nMaxCacheSize)
+        {
+            // Evict a random entry, so that the cache can not be flushed with
+            // a set of headers just larger than it.
+            std::set<powdata_type>::iterator it =
+                setValid.lower_bound(powdata_type(GetRandHash(), 0, 0, false));
+            if (it == setValid.end())
+                it = setValid.begin();
+            setValid.erase(it);
+        }
+
+        setValid.insert(powdata_type(hash, nBits, nNonce, fNewCoeffMatrix));
+    }
+
+    uint64_t Size()
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_powcache);
+        return setValid.size();
+    }
+};
+
+static CPoWCache powCache;
+
+void GetPoWCacheStats(uint64_t& nSize, uint64_t& nHits, uint64_t& nMisses)
+{
+    nSize = powCache.Size();
+    nHits = powCache.nHits;
+    nMisses = powCache.nMisses;
+}
+
 bool CheckProofOfWork(uint256 hash, unsigned int nBits, uint256 preblockhash, int nblockversion,  uint256 nNonce)
+{
+    return CheckProofOfWork(hash, nBits, UseNewCoeffMatrix(SolutionHeight(preblockhash, nblockversion)), nblockversion, nNonce);
+}
+
+bool CheckProofOfWork(uint256 hash, unsigned int nBits, bool fNewCoeffMatrix, int nblockversion, uint256 nNonce)
 {
     unsigned int bnTarget = nBits;
 
@@ -1910,10 +3017,15 @@ bool CheckProofOfWork(uint256 hash, unsigned int nBits, uint256 preblockhash, in
         return error("CheckProofOfWork() : nBits below minimum work");
     if (nNonce == -1 && nblockversion > 1)
         return false;
+
+    if (powCache.Get(hash, nBits, nNonce, fNewCoeffMatrix))
+        return true;
+
     // Check proof of work matches claimed amount
-    if (!CheckSolution(hash, nBits, preblockhash, nblockversion, nNonce))
+    if (!CheckSolution(hash, nBits, fNewCoeffMatrix, nNonce))
         return error("CheckProofOfWork() : hash doesn't match nBits");
 
+    powCache.Set(hash, nBits, nNonce, fNewCoeffMatrix);
     return true;
 }
 
@@ -1979,6 +3091,70 @@ public:
 };
 
 
+// What CreateNewBlock() found out about a memory pool transaction on the current tip
+struct CTxTemplateEntry
+{
+    double dPriority;
+    double dFeePerKb;
+    bool fMissingInputs;
+    bool fScriptsChecked;            // its scripts passed CheckInputs()
+    std::set<uint256> setDependsOn;  // memory pool transactions it spends
+
+    CTxTemplateEntry() : dPriority(0), dFeePerKb(0), fMissingInputs(false), fScriptsChecked(false) {}
+};
+
+// The entries of the memory pool transactions seen on hashTemplateTip, so that
+// a new template only evaluates the transactions which arrived since the last one.
+// Protected by cs_main.
+static uint256 hashTemplateTip;
+static std::map<uint256, CTxTemplateEntry> mapTemplateEntries;
+
+static CTxTemplateEntry EvaluateTemplateTx(const CTransaction& tx, CCoinsViewCache& view, CBlockIndex* pindexPrev)
+{
+    CTxTemplateEntry entry;
+    int64 nTotalIn = 0;
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+    {
+        // Read prev transaction
+        if (!view.HaveCoins(txin.prevout.hash))
+        {
+            // This should never happen; all transactions in the memory
+            // pool should connect to either transactions in the chain
+            // or other transactions in the memory pool.
+            if (!mempool.mapTx.count(txin.prevout.hash))
+            {
+                printf("ERROR: mempool transaction missing input\n");
+                if (fDebug) assert("mempool transaction missing input" == 0);
+                entry.fMissingInputs = true;
+                return entry;
+            }
+
+            // Has to wait for dependencies
+            entry.setDependsOn.insert(txin.prevout.hash);
+            nTotalIn += mempool.mapTx[txin.prevout.hash].vout[txin.prevout.n].nValue;
+            continue;
+        }
+        const CCoins &coins = view.GetCoins(txin.prevout.hash);
+
+        int64 nValueIn = coins.vout[txin.prevout.n].nValue;
+        nTotalIn += nValueIn;
+
+        int nConf = pindexPrev->nHeight - coins.nHeight + 1;
+
+        entry.dPriority += (double)nValueIn * nConf;
+    }
+
+    // Priority is sum(valuein * age) / txsize
+    unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, ABC_PROTOCOL_VERSION);
+    entry.dPriority /= nTxSize;
+
+    // This is a more accurate fee-per-kilobyte than is used by the client code, because the
+    // client code rounds up the size to the nearest 1K. That's good, because it gives an
+    // incentive to create smaller transactions.
+    entry.dFeePerKb =  double(nTotalIn-tx.GetValueOut()) / (double(nTxSize)/1000.0);
+    return entry;
+}
+
 // We want to sort transactions by priority and fee, so:
 typedef boost::tuple<double, double, CTransaction*> TxPriority;
 class TxPriorityCompare
@@ -2108,6 +3284,25 @@ CBlockTemplate* CreateNewBlock(CReserveKey& reservekey)
         map<uint256, vector<COrphan*> > mapDependers;
         bool fPrintPriority = GetBoolArg("-printpriority");
 
+        // The entries of the transactions evaluated for an earlier template stay
+        // valid as long as the tip does not change, and the memory pool still
+        // holds the transaction and the memory pool transactions it spends
+        if (hashTemplateTip != pindexPrev->GetBlockHash())
+        {
+            mapTemplateEntries.clear();
+            hashTemplateTip = pindexPrev->GetBlockHash();
+        }
+        for (map<uint256, CTxTemplateEntry>::iterator it = mapTemplateEntries.begin(); it != mapTemplateEntries.end(); )
+        {
+            bool fStale = !mempool.mapTx.count(it->first);
+            BOOST_FOREACH(const uint256& hashDependsOn, it->second.setDependsOn)
+                fStale = fStale || !mempool.mapTx.count(hashDependsOn);
+            if (fStale)
+                mapTemplateEntries.erase(it++);
+            else
+                ++it;
+        }
+
         // This vector will be sorted into a priority queue:
         vector<TxPriority> vecPriority;
         vecPriority.reserve(mempool.mapTx.size());
@@ -2117,67 +3312,30 @@ CBlockTemplate* CreateNewBlock(CReserveKey& reservekey)
             if (tx.IsCoinBase() || !tx.IsFinal())
                 continue;
 
-            COrphan* porphan = NULL;
-            double dPriority = 0;
-            int64 nTotalIn = 0;
-            bool fMissingInputs = false;
-            BOOST_FOREACH(const CTxIn& txin, tx.vin)
+            map<uint256, CTxTemplateEntry>::iterator it = mapTemplateEntries.find(mi->first);
+            if (it == mapTemplateEntries.end())
             {
-                // Read prev transaction
-                if (!view.HaveCoins(txin.prevout.hash))
-                {
-                    // This should never happen; all transactions in the memory
-                    // pool should connect to either transactions in the chain
-                    // or other transactions in the memory pool.
-                    if (!mempool.mapTx.count(txin.prevout.hash))
-                    {
-                        printf("ERROR: mempool transaction missing input\n");
-                        if (fDebug) assert("mempool transaction missing input" == 0);
-                        fMissingInputs = true;
-                        if (porphan)
-                            vOrphan.pop_back();
-                        break;
-                    }
-
-                    // Has to wait for dependencies
-                    if (!porphan)
-                    {
-                        // Use list for automatic deletion
-                        vOrphan.push_back(COrphan(&tx));
-                        porphan = &vOrphan.back();
-                    }
-                    mapDependers[txin.prevout.hash].push_back(porphan);
-                    porphan->setDependsOn.insert(txin.prevout.hash);
-                    nTotalIn += mempool.mapTx[txin.prevout.hash].vout[txin.prevout.n].nValue;
+                CTxTemplateEntry entryNew = EvaluateTemplateTx(tx, view, pindexPrev);
+                // not kept, the missing inputs may enter the memory pool later
+                if (entryNew.fMissingInputs)
                     continue;
-                }
-                const CCoins &coins = view.GetCoins(txin.prevout.hash);
-
-                int64 nValueIn = coins.vout[txin.prevout.n].nValue;
-                nTotalIn += nValueIn;
-
-                int nConf = pindexPrev->nHeight - coins.nHeight + 1;
-
-                dPriority += (double)nValueIn * nConf;
+                it = mapTemplateEntries.insert(make_pair(mi->first, entryNew)).first;
             }
-            if (fMissingInputs) continue;
-
-            // Priority is sum(valuein * age) / txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, ABC_PROTOCOL_VERSION);
-            dPriority /= nTxSize;
-
-            // This is a more accurate fee-per-kilobyte than is used by the client code, because the
-            // client code rounds up the size to the nearest 1K. That's good, because it gives an
-            // incentive to create smaller transactions.
-            double dFeePerKb =  double(nTotalIn-tx.GetValueOut()) / (double(nTxSize)/1000.0);
+            const CTxTemplateEntry& entry = it->second;
 
-            if (porphan)
+            if (!entry.setDependsOn.empty())
             {
-                porphan->dPriority = dPriority;
-                porphan->dFeePerKb = dFeePerKb;
+                // Use list for automatic deletion
+                vOrphan.push_back(COrphan(&tx));
+                COrphan* porphan = &vOrphan.back();
+                porphan->setDependsOn = entry.setDependsOn;
+                porphan->dPriority = entry.dPriority;
+                porphan->dFeePerKb = entry.dFeePerKb;
+                BOOST_FOREACH(const uint256& hashDependsOn, entry.setDependsOn)
+                    mapDependers[hashDependsOn].push_back(porphan);
             }
             else
-                vecPriority.push_back(TxPriority(dPriority, dFeePerKb, &(*mi).second));
+                vecPriority.push_back(TxPriority(entry.dPriority, entry.dFeePerKb, &(*mi).second));
         }
 
         // Collect transactions into block
@@ -2232,13 +3390,17 @@ CBlockTemplate* CreateNewBlock(CReserveKey& reservekey)
             if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
                 continue;
 
+            // the scripts of a transaction only need to be verified once per tip
+            uint256 hash = tx.GetHash();
+            CTxTemplateEntry& entry = mapTemplateEntries[hash];
             CValidationState state;
-            tx.vPubKeys.clear();
-            if (!tx.CheckInputs(state, view, true, SCRIPT_VERIFY_P2SH))
+            if (!entry.fScriptsChecked)
+                tx.vPubKeys.clear();
+            if (!tx.CheckInputs(state, view, !entry.fScriptsChecked, SCRIPT_VERIFY_P2SH))
                 continue;
+            entry.fScriptsChecked = true;
 
             CTxUndo txundo;
-            uint256 hash = tx.GetHash();
             tx.UpdateCoins(state, view, txundo, pindexPrev->nHeight+1, hash);
 
             // Added
@@ -2294,6 +3456,8 @@ CBlockTemplate* CreateNewBlock(CReserveKey& reservekey)
         indexDummy.nHeight = pindexPrev->nHeight + 1;
         CCoinsViewCache viewNew(*pcoinsTip, true);
         CValidationState state;
+        // verifies the scripts of every transaction again under the block's own flags,
+        // mapTemplateEntries only saves the assembly its scan and CheckInputs()
         if (!pblock->ConnectBlock(state, &indexDummy, viewNew, true))
             throw std::runtime_error("CreateNewBlock() : ConnectBlock failed");
     }
@@ -2349,39 +3513,78 @@ void FormatHashBuffers(CBlock* pblock, char* pmidstate, char* pdata, char* phash
     memcpy(phash1, &tmp.hash1, 64);
 }
 
-void static AbcmintMiner(CWallet *pwallet)
+// Each miner thread is initially dealt this many sub-problems of the shared
+// job, so that threads which run out of work have something to steal.
+static const int nMinerSubProblemsPerThread = 8;
+
+// A range [nBegin, nEnd) of exfes sub-problems owned by one miner thread.
+struct CMinerWorkRange
 {
-    printf("AbcmintMiner started\n");
-    SetThreadPriority(THREAD_PRIORITY_LOWEST);
-    RenameThread("abcmint-miner");
+    CCriticalSection cs;
+    uint64_t nBegin;
+    uint64_t nEnd;
+};
 
-    // Each thread has its own key and counter
-    CReserveKey reservekey(pwallet);
-    unsigned int nExtraNonce = 0;
+// Start of the current miner job, 0 once it was refreshed for new transactions
+static std::atomic<int64> nMinerJobStart(0);
+static std::atomic<uint64_t> nMinerJobCount(0);
 
-    try { while(true) {
-        while (vNodes.empty())
-            MilliSleep(1000);
+/** A block template shared by all miner threads. The 2^nSearchVariables
+ *  sub-problems of its equation system are split between the threads, a
+ *  thread which exhausted its range steals half of the largest other range,
+ *  and the first solution found ends the job for every thread.
+ */
+class CMinerJob
+{
+public:
+    CReserveKey reservekey;
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    CBlockIndex* pindexPrev;
+    unsigned int nTransactionsUpdatedLast;
+    int64 nStart;
+
+    uint256 seedHash;
+    uint256 prevblockhash;
+    int nUnknowns;
+    int mEquations;
+    int nSearchVariables;
+    uint64_t startPoint[4];
+    boost::shared_ptr<const CMQSolverContext> pcontext;
+    exfes_packed_eqs_t *eqs;
+
+    std::atomic<bool> fDone;
+    CMQCancelToken cancel;
+    const uint64_t nId;
+    int64 nNewTipMicros;                // time of the new tip which caused this job, or 0
+    std::atomic<int> nThreadsStarted;   // miner threads which started to work on this job
+
+    CMinerJob(CWallet* pwallet, int nWorkersIn) : reservekey(pwallet), pindexPrev(NULL), eqs(NULL), fDone(false),
+                                                  nId(++nMinerJobCount), nNewTipMicros(0), nThreadsStarted(0),
+                                                  nWorkers(nWorkersIn), vRanges(new CMinerWorkRange[nWorkersIn]), nInFlight(0)
+    {
+    }
 
-        //
-        // Create new block
-        //
-        unsigned int nTransactionsUpdatedLast = nTransactionsUpdated;
-        CBlockIndex* pindexPrev = pindexBest;
+    ~CMinerJob()
+    {
+        free_exfes_packed_eqs(eqs);
+    }
 
-        std::unique_ptr<CBlockTemplate> pblocktemplate(CreateNewBlock(reservekey));
+    bool Init(unsigned int& nExtraNonce)
+    {
+        cancel = CMQCancelToken();
+        nNewTipMicros = nMinerNewTipMicros.exchange(0);
+        nTransactionsUpdatedLast = nTransactionsUpdated;
+        pindexPrev = pindexBest;
+
+        pblocktemplate.reset(CreateNewBlock(reservekey));
         if (!pblocktemplate.get())
-            return;
+            return false;
         CBlock *pblock = &pblocktemplate->block;
         IncrementExtraNonce(pblock, pindexPrev, nExtraNonce);
 
         printf("Running AbcmintMiner with %" PRIszu " transactions in block (%u bytes)\n", pblock->vtx.size(),
                ::GetSerializeSize(*pblock, SER_NETWORK, ABC_PROTOCOL_VERSION));
 
-
-        //
-        // Search
-        //
         uint256 randomNonce = 0;
         if (pblock->nBits + 8 <= 48) {
             randomNonce = (uint64)random_uint32_t();
@@ -2390,50 +3593,396 @@ void static AbcmintMiner(CWallet *pwallet)
         } else {
             randomNonce = GetRandHash();
         }
+        for (int width = 0; width < 4; width++) {
+            startPoint[width] = randomNonce.Get64(width);
+        }
 
-        int64 nStart = GetTime();
+        nStart = GetTime();
+        nMinerJobStart = nStart;
         uint256 tempHash = pblock->hashPrevBlock ^ pblock->hashMerkleRoot;
-        uint256 seedHash = Hash(BEGIN(tempHash), END(tempHash));
-		uint256 prevblockhash = 0;
-		if (pindexBest->GetBlockHash() == hashGenesisBlock || pindexPrev->pprev->GetBlockHash() == hashGenesisBlock) {
-		    prevblockhash = 0;
-		} else {
+        seedHash = Hash(BEGIN(tempHash), END(tempHash));
+        if (pindexBest->GetBlockHash() == hashGenesisBlock || pindexPrev->pprev->GetBlockHash() == hashGenesisBlock) {
+            prevblockhash = 0;
+        } else {
             prevblockhash = pindexPrev->GetBlockHash();
-		}
+        }
 
-        while(true)
-        {
-            uint256 nNonceFound;
+        mEquations = pblock->nBits;
+        nUnknowns = pblock->nBits + 8;
+
+        nSearchVariables = MQSearchVariables(nUnknowns, nWorkers * nMinerSubProblemsPerThread);
+
+        pcontext = GetMQSolverContext(seedHash, pblock->nBits, pindexPrev->nHeight + 1, nSearchVariables);
+        if (!pcontext)
+            return false;
+        eqs = pcontext->PackedMaskedEquations(startPoint);
+        if (!eqs)
+            return false;
+
+        uint64_t nSubProblems = (uint64_t)1 << nSearchVariables;
+        for (int i = 0; i < nWorkers; i++) {
+            vRanges[i].nBegin = nSubProblems * i / nWorkers;
+            vRanges[i].nEnd = nSubProblems * (i + 1) / nWorkers;
+        }
+        return true;
+    }
 
-            // Solve the multivariable quadratic polynomial equations.
-            nNonceFound = SerchSolution(seedHash, pblock->nBits, randomNonce,pindexPrev);
+    bool IsStale() const
+    {
+        if (fDone || cancel.IsCancelled())
+            return true;
+        if (nTransactionsUpdated != nTransactionsUpdatedLast && GetTime() - nStart > 60)
+            return true;
+        return false;
+    }
 
-            // Check if something found
-            if (nNonceFound !=  -1)
+    // Hand out the next sub-problem to worker nWorker, stealing from the other
+    // workers when its own range is empty. Every sub-problem handed out must be
+    // finished with FinishSubProblem().
+    bool NextSubProblem(int nWorker, uint64_t& solm)
+    {
+        CMinerWorkRange& own = vRanges[nWorker];
+        while (true) {
             {
-                if (CheckSolution(seedHash, pblock->nBits, prevblockhash, pblock->nVersion, nNonceFound))
-                {
-                    // Found a solution
-                    pblock->nNonce = nNonceFound;
-                    SetThreadPriority(THREAD_PRIORITY_NORMAL);
-                    CheckWork(pblock, *pwalletMain, reservekey);
-                    SetThreadPriority(THREAD_PRIORITY_LOWEST);
-                    break;
+                LOCK(own.cs);
+                if (own.nBegin < own.nEnd) {
+                    solm = own.nBegin++;
+                    nInFlight++;
+                    return true;
                 }
             }
 
-            // Check for stop or if block needs to be rebuilt
-            boost::this_thread::interruption_point();
-            if (vNodes.empty())
-                break;
-            if (nTransactionsUpdated != nTransactionsUpdatedLast && GetTime() - nStart > 60)
-                break;
-            if (pindexPrev != pindexBest)
-                break;
+            int nVictim = -1;
+            uint64_t nMostLeft = 0;
+            for (int i = 0; i < nWorkers; i++) {
+                if (i == nWorker)
+                    continue;
+                LOCK(vRanges[i].cs);
+                if (vRanges[i].nEnd - vRanges[i].nBegin > nMostLeft) {
+                    nMostLeft = vRanges[i].nEnd - vRanges[i].nBegin;
+                    nVictim = i;
+                }
+            }
+            if (nVictim < 0)
+                return false;
 
-            // Update nTime every few seconds
-            pblock->UpdateTime(pindexPrev);
+            uint64_t nStolenBegin, nStolenEnd;
+            {
+                CMinerWorkRange& victim = vRanges[nVictim];
+                LOCK(victim.cs);
+                // emptied since the scan, look again without holding its lock
+                if (victim.nBegin >= victim.nEnd)
+                    continue;
+                nStolenEnd = victim.nEnd;
+                nStolenBegin = victim.nEnd - (victim.nEnd - victim.nBegin + 1) / 2;
+                victim.nEnd = nStolenBegin;
+                // counted before the stolen range leaves the victim's lock, so
+                // that it is never in no range without being in flight
+                nInFlight++;
+            }
+
+            LOCK(own.cs);
+            own.nBegin = nStolenBegin + 1;
+            own.nEnd = nStolenEnd;
+            solm = nStolenBegin;
+            return true;
         }
+    }
+
+    void FinishSubProblem()
+    {
+        nInFlight--;
+    }
+
+    // Ends the job once the whole search space was solved without a solution.
+    // A sub-problem still in flight may yet find one, the worker which finishes
+    // the last of them ends the job.
+    void CheckExhausted()
+    {
+        // work only leaves a range under its lock, with all of them held
+        // nInFlight can not go up
+        for (int i = 0; i < nWorkers; i++)
+            ENTER_CRITICAL_SECTION(vRanges[i].cs);
+        bool fExhausted = (nInFlight == 0);
+        for (int i = 0; i < nWorkers && fExhausted; i++)
+            fExhausted = (vRanges[i].nBegin >= vRanges[i].nEnd);
+        for (int i = nWorkers - 1; i >= 0; i--)
+            LEAVE_CRITICAL_SECTION(vRanges[i].cs);
+        if (fExhausted)
+            fDone = true;
+    }
+
+    void SubmitSolution(uint256 nNonceFound)
+    {
+        CBlock *pblock = &pblocktemplate->block;
+        if (!CheckSolution(seedHash, pblock->nBits, prevblockhash, pblock->nVersion, nNonceFound))
+            return;
+
+        LOCK(cs);
+        if (fDone)
+            return;
+        fDone = true;
+
+        // Found a solution
+        pblock->nNonce = nNonceFound;
+        pblock->UpdateTime(pindexPrev);
+        SetThreadPriority(THREAD_PRIORITY_NORMAL);
+        CheckWork(pblock, *pwalletMain, reservekey);
+        SetThreadPriority(THREAD_PRIORITY_LOWEST);
+    }
+
+private:
+    CCriticalSection cs;
+    int nWorkers;
+    boost::scoped_array<CMinerWorkRange> vRanges;
+    std::atomic<int> nInFlight;         // sub-problems handed out and not finished yet
+};
+
+static CCriticalSection cs_minerJob;
+static boost::shared_ptr<CMinerJob> pminerJob;
+static unsigned int nMinerExtraNonce = 0;
+
+// Return the job all miner threads are working on, creating a new one when it
+// went stale.
+static boost::shared_ptr<CMinerJob> GetMinerJob(CWallet *pwallet, int nWorkers)
+{
+    LOCK(cs_minerJob);
+    if (pminerJob && !pminerJob->IsStale())
+        return pminerJob;
+
+    pminerJob.reset();
+    boost::shared_ptr<CMinerJob> pjob(new CMinerJob(pwallet, nWorkers));
+    if (!pjob->Init(nMinerExtraNonce))
+        return boost::shared_ptr<CMinerJob>();
+    pminerJob = pjob;
+    return pjob;
+}
+
+void MinerTransactionsUpdated()
+{
+    // same refresh policy as CMinerJob::IsStale(), applied without waiting
+    // for the miner threads to finish their sub-problems
+    int64 nStart = nMinerJobStart;
+    if (nStart != 0 && GetTime() - nStart > 60 && nMinerJobStart.compare_exchange_strong(nStart, 0))
+        AdvanceMinerEpoch(false);
+}
+
+static CCriticalSection cs_minerStats;
+static std::set<const CMQSolverStats*> setMinerStats; // the running miner threads
+static CMinerStats minerStatsRetired;                 // the miner threads which exited, and the template switches
+
+/** Makes the solver counters of a miner thread visible to GetMinerStats() while it runs */
+class CMinerStatsRegistration
+{
+public:
+    CMinerStatsRegistration()
+    {
+        LOCK(cs_minerStats);
+        setMinerStats.insert(&mqSolverStats);
+    }
+
+    ~CMinerStatsRegistration()
+    {
+        LOCK(cs_minerStats);
+        setMinerStats.erase(&mqSolverStats);
+        minerStatsRetired.nCandidates += mqSolverStats.nCandidates;
+        minerStatsRetired.nTested += mqSolverStats.nTested;
+        minerStatsRetired.nSubProblems += mqSolverStats.nSubProblems;
+        minerStatsRetired.nRestarts += mqSolverStats.nRestarts;
+        minerStatsRetired.nCycles += mqSolverStats.nCycles;
+    }
+};
+
+// All the miner threads started to work on the template of a new tip, nMicros after it
+static void RecordTemplateSwitch(int64 nMicros)
+{
+    LOCK(cs_minerStats);
+    minerStatsRetired.nSwitches++;
+    minerStatsRetired.nSwitchMicrosLast = nMicros;
+    minerStatsRetired.nSwitchMicrosTotal += nMicros;
+    minerStatsRetired.nSwitchMicrosMax = std::max(minerStatsRetired.nSwitchMicrosMax, (uint64_t)nMicros);
+}
+
+void GetMinerStats(CMinerStats& stats)
+{
+    LOCK(cs_minerStats);
+    stats = minerStatsRetired;
+    stats.nThreads = setMinerStats.size();
+    BOOST_FOREACH(const CMQSolverStats* pstats, setMinerStats) {
+        stats.nCandidates += pstats->nCandidates.load(std::memory_order_relaxed);
+        stats.nTested += pstats->nTested.load(std::memory_order_relaxed);
+        stats.nSubProblems += pstats->nSubProblems.load(std::memory_order_relaxed);
+        stats.nRestarts += pstats->nRestarts.load(std::memory_order_relaxed);
+        stats.nCycles += pstats->nCycles.load(std::memory_order_relaxed);
+    }
+}
+
+static CCriticalSection cs_hashesPerSec; // dHashesPerSec and nHPSTimerStart
+
+// Candidates enumerated per second by all the miner threads, over the last 4 seconds at least.
+void UpdateHashesPerSec()
+{
+    static uint64_t nCandidatesStart = 0;
+
+    TRY_LOCK(cs_hashesPerSec, lockHPS);
+    if (!lockHPS)
+        return;
+
+    int64 nNow = GetTimeMillis();
+    if (nNow - nHPSTimerStart < 4000)
+        return;
+
+    CMinerStats stats;
+    GetMinerStats(stats);
+    if (nHPSTimerStart != 0 && stats.nThreads > 0)
+        dHashesPerSec = 1000.0 * (stats.nCandidates - nCandidatesStart) / (nNow - nHPSTimerStart);
+    else
+        dHashesPerSec = 0;
+    nCandidatesStart = stats.nCandidates;
+    nHPSTimerStart = nNow;
+}
+
+double GetHashesPerSec()
+{
+    UpdateHashesPerSec();
+    LOCK(cs_hashesPerSec);
+    if (GetTimeMillis() - nHPSTimerStart > 8000)
+        return 0;
+    return dHashesPerSec;
+}
+
+/** The memory of a miner thread, reused by the sub-problems of all the
+ *  templates it works on instead of being allocated for each of them. The
+ *  thread allocates it once it is pinned, so that its pages are on the NUMA
+ *  node of the thread.
+ */
+class CMinerArena
+{
+public:
+    explicit CMinerArena(bool fHugePagesIn) : fHugePages(fHugePagesIn), pScratch(NULL), nSize(0)
+    {
+        SolArray = CreateArray(1);
+    }
+
+    ~CMinerArena()
+    {
+        FreePages(pScratch, nSize);
+        FreeArray(1, SolArray);
+    }
+
+    // Scratch space of at least nWords words, NULL when out of memory
+    pck_vector_t *Scratch(uint64_t nWords)
+    {
+        size_t nNeeded = nWords * sizeof(pck_vector_t);
+        if (nNeeded > nSize) {
+            FreePages(pScratch, nSize);
+            // huge pages are 2 MB on x86
+            nSize = fHugePages ? (nNeeded + (1 << 21) - 1) & ~(size_t)((1 << 21) - 1) : nNeeded;
+            pScratch = (pck_vector_t *)AllocPages(nSize, fHugePages);
+            if (pScratch == NULL)
+                nSize = 0;
+        }
+        return pScratch;
+    }
+
+    uint64_t **SolArray;
+
+private:
+    bool fHugePages;
+    pck_vector_t *pScratch;
+    size_t nSize;
+};
+
+// The cpu of each of nThreads miner threads, spread over the NUMA nodes so
+// that they share the memory bandwidth of every node.
+static std::vector<int> MinerThreadCpus(int nThreads)
+{
+    std::vector<std::vector<int> > vNodes = GetNumaNodes();
+    // unknown cpus, the threads are not pinned
+    std::vector<int> vCpus;
+    if (vNodes.empty())
+        return std::vector<int>(nThreads, -1);
+    for (int i = 0; i < nThreads; i++) {
+        const std::vector<int>& vNodeCpus = vNodes[i % vNodes.size()];
+        vCpus.push_back(vNodeCpus[(i / vNodes.size()) % vNodeCpus.size()]);
+    }
+    return vCpus;
+}
+
+void static AbcmintMiner(CWallet *pwallet, int nWorker, int nWorkers, int nCpu, bool fHugePages)
+{
+    printf("AbcmintMiner started\n");
+    SetThreadPriority(THREAD_PRIORITY_LOWEST);
+    RenameThread("abcmint-miner");
+    if (nCpu >= 0 && !SetThreadAffinity(nCpu))
+        printf("AbcmintMiner: cannot pin thread %d to cpu %d\n", nWorker, nCpu);
+    CMinerStatsRegistration statsRegistration;
+    CMinerArena arena(fHugePages);
+    uint64_t nLastJob = 0;
+
+    try { while(true) {
+        while (vNodes.empty())
+            MilliSleep(1000);
+
+        boost::shared_ptr<CMinerJob> pjob = GetMinerJob(pwallet, nWorkers);
+        if (!pjob)
+            return;
+
+        if (pjob->nId != nLastJob) {
+            nLastJob = pjob->nId;
+            if (++pjob->nThreadsStarted == nWorkers && pjob->nNewTipMicros != 0)
+                RecordTemplateSwitch(GetTimeMicros() - pjob->nNewTipMicros);
+            // a new size is measured by one thread while the others mine, the
+            // templates after this one use the faster solver
+            MQTuneSolver(pjob->nUnknowns - pjob->nSearchVariables, pjob->mEquations);
+        }
+
+        //
+        // Search
+        //
+        packed_system_t *sys = pjob->pcontext->PackedSystem();
+        pck_vector_t *F = arena.Scratch(sys->scratch_words);
+        if (F == NULL) {
+            printf("AbcmintMiner: cannot allocate %" PRI64u " words of scratch space\n", (uint64)sys->scratch_words);
+            return;
+        }
+        uint64_t **SolArray = arena.SolArray;
+        uint64_t solm;
+        bool fExhausted = true;
+        while (pjob->NextSubProblem(nWorker, solm))
+        {
+            // Check if block needs to be rebuilt
+            int nResult = -1;
+            if (!pjob->IsStale() && !vNodes.empty()) {
+                // Solve the multivariable quadratic polynomial equations.
+                nResult = exfes_subproblem(pjob->nSearchVariables, pjob->nUnknowns, pjob->startPoint,
+                                           solm, pjob->eqs, sys, F, SolArray, &pjob->cancel);
+                if (nResult == 1) {
+                    uint256 nNonceFound = 0;
+                    ReportSolution(1, SolArray, nNonceFound);
+                    pjob->SubmitSolution(nNonceFound);
+                }
+            }
+            pjob->FinishSubProblem();
+            if (nResult != 0) {
+                fExhausted = false;
+                break;
+            }
+            UpdateHashesPerSec();
+        }
+        if (pjob->cancel.IsCancelled())
+            CMQSolverStats::Add(mqSolverStats.nRestarts, 1);
+
+        // nobody found a solution in the whole search space, move on to a new template
+        if (fExhausted) {
+            pjob->CheckExhausted();
+            // the other threads are still solving their last sub-problems
+            if (!pjob->IsStale())
+                MilliSleep(10);
+        }
+
+        // Check for stop
+        boost::this_thread::interruption_point();
     } }
     catch (boost::thread_interrupted)
     {
@@ -2450,19 +3999,37 @@ void GenerateAbcmints(bool fGenerate, CWallet* pwallet)
     if (nThreads < 0)
         nThreads = boost::thread::hardware_concurrency();
 
+    // the solver loops are not interruption points, cancel their work first
+    AdvanceMinerEpoch(false);
+    nMinerJobStart = 0;
     if (minerThreads != NULL)
     {
         minerThreads->interrupt_all();
         delete minerThreads;
         minerThreads = NULL;
     }
+    {
+        LOCK(cs_minerJob);
+        if (pminerJob)
+            pminerJob->fDone = true;
+        pminerJob.reset();
+    }
 
     if (nThreads == 0 || !fGenerate)
         return;
 
+    SetMQCancelInterval(GetArg("-minercancelinterval", 1));
+    SetMQWordSize(GetArg("-minerwordsize", 0));
+    std::string strSolver = GetArg("-minersolver", "auto");
+    SetMQSolver(strSolver == "enum" ? ALGO_ENUMERATION : strSolver == "fft" ? ALGO_FFT : ALGO_AUTO);
+    nMinerNewTipMicros = 0;
+
+    std::vector<int> vCpus(nThreads, -1);
+    if (GetBoolArg("-minerthreadaffinity"))
+        vCpus = MinerThreadCpus(nThreads);
+    bool fHugePages = GetBoolArg("-minerhugepages");
+
     minerThreads = new boost::thread_group();
     for (int i = 0; i < nThreads; i++)
-        minerThreads->create_thread(boost::bind(&AbcmintMiner, pwallet));
+        minerThreads->create_thread(boost::bind(&AbcmintMiner, pwallet, i, nThreads, vCpus[i], fHugePages));
 }
-
-
@@ -12,9 +12,14 @@
 #include <assert.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <atomic>
+#include <boost/shared_ptr.hpp>
 #include "idxlut.h"
 #include "main.h"
 
+#if defined(__SSE2__) && !defined(HAVE_SSE2)
+#define HAVE_SSE2 1
+#endif
 
 
 
@@ -31,16 +36,22 @@ typedef struct {
     int algo_enum_self_tune;
     int algo_auto_degree_bound;
     int algo_enum_use_sse;
+    int algo_enum_use_avx2;
+    int fft_threads;     // threads sharing the passes of the Moebius transform
     int verbose;
 } wrapper_settings_t;
 
 typedef int*  vector_t ;
 typedef vector_t* matrix_t;
-typedef uint32_t pck_vector_t;
+typedef uint64_t pck_vector_t;
 
 #define SIMD_CHUNK_SIZE 9
 #define IA32_CHUNK_SIZE 9
+// the kernels test the candidates found so far at least every PACK_FLUSH_CHUNKS chunks
+#define PACK_FLUSH_CHUNKS 256
 #define enumerated_degree_bound 10
+// MQTuneSolver() only measures the Moebius transform up to 2^24 words (128 MB) per table
+#define MQ_FFT_MAX_VARIABLES 24
 //#define min(x,y) (((x) > (y)) ? (y) : (x)) 
 
 typedef struct {
@@ -55,14 +66,89 @@ typedef struct {
     int n_batches;
     pck_vector_t **G;
     idx_lut_t * testing_LUT;
+    const wrapper_settings_t *settings;
 
     solution_callback_t callback;
     void *callback_state;
 } wrapper_state_t;
 
+// the quadratic part of a system packed once, so that systems differing only
+// in their constant and linear terms can be searched without repacking.
+typedef struct {
+    int n;
+    int n_eqs;
+    int degree;
+    int n_batches;
+    uint64_t N;          // number of monomials of each batch
+    wrapper_settings_t settings;
+    idx_lut_t *idx_LUT;
+    pck_vector_t *quad;  // n_batches * N packed words, zero below degree 2
+    uint64_t scratch_words;  // size of the F buffers of the searches
+} packed_system_t;
+
+// The (masked) equations of exfes, packed once for all the sub-problems. The
+// words of batch b start at words + b*stride: the constant term, the n linear
+// terms, then the quadratic terms x_j*x_k with j < m in the order of Eqs[i][2].
+// Bit i of a word of batch b belongs to equation b*word_size + i.
+typedef struct {
+    int m;
+    int n;
+    int n_batches;
+    uint64_t stride;
+    pck_vector_t *words;
+} exfes_packed_eqs_t;
+
 typedef quadratic_form* system_t;
+#define likely(x)       __builtin_expect(!!(x), 1)
 #define unlikely(x)     __builtin_expect(!!(x), 0)
 
+/** Cancellation token of the MQ solver. It is cancelled as soon as the work
+ *  epoch it was taken in ends, the solver loops check it every 2^k chunks of
+ *  512 candidates (-minercancelinterval). The epoch of the miner threads is
+ *  advanced by a new tip, by a template refresh for new transactions and by
+ *  stopping the miner.
+ */
+class CMQCancelToken
+{
+public:
+    CMQCancelToken(); // token of the current miner work epoch
+    explicit CMQCancelToken(const std::atomic<uint64_t>& epochIn);
+
+    bool IsCancelled() const { return pepoch->load(std::memory_order_relaxed) != nEpoch; }
+
+    // periodic check, for the nChunk-th chunk of a solver loop
+    bool IsCancelled(uint64_t nChunk) const { return (nChunk & nCheckMask) == 0 && IsCancelled(); }
+
+    uint64_t Epoch() const { return nEpoch; }
+
+private:
+    const std::atomic<uint64_t>* pepoch;
+    uint64_t nEpoch;
+    uint64_t nCheckMask;
+};
+
+/** Check the tokens taken from now on every nChunks chunks, rounded up to a power of two */
+void SetMQCancelInterval(int64 nChunks);
+
+/** Number of equations the enumeration kernels pack in a word: 16, 32 or 64, 0 chooses from nBits */
+void SetMQWordSize(int nWordSize);
+int MQWordSize(int nEquations);
+
+/** Solver of the degree 2 sub-problems: ALGO_ENUMERATION, ALGO_FFT, or ALGO_AUTO
+ *  for the faster one, measured once per size on this machine */
+void SetMQSolver(int nAlgorithm);
+/* measures both solvers on a system of this size, once: slow, call it without holding a lock */
+void MQTuneSolver(int nVariables, int nEquations);
+/* the faster solver measured by MQTuneSolver(), the enumeration until it ran */
+int MQSolver(int nVariables, int nEquations);
+
+/** End the current work epoch of the miner threads. fNewTip starts the measure
+ *  of the time the miner threads take to switch to the new template. */
+void AdvanceMinerEpoch(bool fNewTip);
+
+/** The memory pool changed, refresh the miner template if it is old enough */
+void MinerTransactionsUpdated();
+
 /* In principe, this function should be the single entry point to the library
    The input format is explicit, except for the coefficients of the equations.
    coeffs[e][d][m] = coefficient of the m-th monomial of degree d in the e-th equation
@@ -74,8 +160,68 @@ int exhaustive_search_wrapper(const int n,
                                               int ***coeffs, 
                                               solution_callback_t callback, 
                                               void* callback_state, 
-                                              CBlockIndex* pindexPrev);
-
+                                              const CMQCancelToken* cancel);
+
+/** Counters of the MQ solver running on one thread. Only that thread updates
+ *  them, with relaxed stores, and any thread may read them at any time.
+ */
+struct CMQSolverStats
+{
+    std::atomic<uint64_t> nCandidates;  // candidate solutions enumerated
+    std::atomic<uint64_t> nTested;      // candidates checked against the remaining equations
+    std::atomic<uint64_t> nSubProblems; // exfes sub-problems searched to the end
+    std::atomic<uint64_t> nRestarts;    // searches abandoned because of a new tip
+    std::atomic<uint64_t> nCycles;      // cycles spent to enumerate nCandidates
+
+    // candidates not counted yet, and the time they started being enumerated
+    uint64_t nPending;
+    uint64_t nPendingStart;
+
+    static void Add(std::atomic<uint64_t>& counter, uint64_t n)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+};
+
+extern thread_local CMQSolverStats mqSolverStats;
+
+/** Totals of the miner threads, see GetMinerStats() */
+struct CMinerStats
+{
+    int nThreads;
+    uint64_t nCandidates;
+    uint64_t nTested;
+    uint64_t nSubProblems;
+    uint64_t nRestarts;
+    uint64_t nCycles;
+
+    // time from a new tip until all the miner threads work on its template
+    uint64_t nSwitches;
+    uint64_t nSwitchMicrosLast;
+    uint64_t nSwitchMicrosTotal;
+    uint64_t nSwitchMicrosMax;
+};
+
+void GetMinerStats(CMinerStats& stats);
+void UpdateHashesPerSec();
+/* the last measurement of UpdateHashesPerSec(), 0 when the miner threads stopped updating it */
+double GetHashesPerSec();
+
+packed_system_t *init_packed_system(int n, int n_eqs, const int degree, int ***coeffs);
+/* same as init_packed_system, with the algorithm chosen by the caller */
+packed_system_t *init_packed_system_algorithm(int n, int n_eqs, const int degree, int ***coeffs, int algorithm);
+void free_packed_system(packed_system_t *sys);
+
+/* same as exhaustive_search_wrapper, with the degree >= 2 terms taken from sys.
+   F is scratch space of sys->scratch_words words */
+int exhaustive_search_packed(packed_system_t *sys,
+                                             pck_vector_t *F,
+                                             int ***coeffs,
+                                             solution_callback_t callback,
+                                             void* callback_state,
+                                             const CMQCancelToken* cancel);
+
+void convert_input_equations_range(const int n, const int min_degree, const int max_degree, int from, int to, int ***coeffs, idx_lut_t *idx_LUT, pck_vector_t F[]);
 void init_settings(wrapper_settings_t *result);
 void choose_settings( wrapper_settings_t *s, int n, int n_eqs, int degree);
 vector_t init_vector(int n_rows);
@@ -83,7 +229,11 @@ pck_vector_t pack(int n, const vector_t v);
 uint64_t to_gray(uint64_t i);
 uint64_t rdtsc(void);
 pck_vector_t packed_eval(LUT_t LUT, int n, int d, pck_vector_t *F, uint64_t i);
-void moebius_transform(int n, pck_vector_t F[], solution_callback_t callback, void* callback_state, CBlockIndex* pindexPrev); 
+/* evaluates the 2^n words of F on all the inputs in place, and reports the
+   zero ones to the callback */
+void moebius_transform(int n, pck_vector_t F[], solution_callback_t callback, void* callback_state,
+                       const wrapper_settings_t *settings, const CMQCancelToken* cancel);
+void moebius_load_deg_2(LUT_t LUT, int n, const pck_vector_t F[], pck_vector_t A[]);
 void print_vec(__m128i foo);
 void exhaustive_ia32_deg_2(LUT_t LUT, 
                                        int n, 
@@ -91,31 +241,64 @@ void exhaustive_ia32_deg_2(LUT_t LUT,
                                        solution_callback_t callback, 
                                        void* callback_state, 
                                        int verbose,
-                                       CBlockIndex* pindexPrev); // autogenerated_sequential_deg_2.c
+                                       const CMQCancelToken* cancel); // autogenerated_sequential_deg_2.c
 pck_vector_t packed_eval_deg_2(LUT_t LUT, 
                                       int n, 
                                       pck_vector_t F[], 
                                       uint64_t i); // autogenerated_tester_deg_2.c
+/* index of the first of the `size` candidates on which the n_batches packed
+   systems G[j] all vanish, or `size` if there is none */
+uint64_t packed_test_candidates_deg_2(LUT_t LUT,
+                                      int n,
+                                      int n_batches,
+                                      pck_vector_t **G,
+                                      const uint64_t *candidates,
+                                      uint64_t size,
+                                      const wrapper_settings_t *settings);
 
 #ifdef HAVE_SSE2
-void exhaustive_sse2_deg_2_T_2_el_0(LUT_t LUT, 
-                                                      int n, 
-                                                      pck_vector_t nonsimd_F[], 
-                                                      solution_callback_t callback, 
-                                                      void* callback_state, 
-                                                      int verbose); // autogenerated_simd_deg_2_T_2_el_0.c
 void exhaustive_sse2_deg_2_T_3_el_0(LUT_t LUT, 
                                                   int n, 
-                                                  pck_vector_t nonsimd_F[], 
+                                                  pck_vector_t F[], 
                                                   solution_callback_t callback, 
                                                   void* callback_state, 
-                                                  int verbose); // autogenerated_simd_deg_2_T_3_el_0.c
-void exhaustive_sse2_deg_2_T_4_el_0(LUT_t LUT, 
+                                                  int verbose,
+                                                  const CMQCancelToken* cancel); // 8 lanes of 16 equations
+void exhaustive_avx2_deg_2_T_4_el_0(LUT_t LUT, 
                                                   int n, 
-                                                  pck_vector_t nonsimd_F[], 
+                                                  pck_vector_t F[], 
                                                   solution_callback_t callback, 
                                                   void* callback_state, 
-                                                  int verbose); // autogenerated_simd_deg_2_T_4_el_0.c
+                                                  int verbose,
+                                                  const CMQCancelToken* cancel); // 16 lanes of 16 equations, needs AVX2
+void exhaustive_sse2_deg_2_T_2_w32(LUT_t LUT, 
+                                                  int n, 
+                                                  pck_vector_t F[], 
+                                                  solution_callback_t callback, 
+                                                  void* callback_state, 
+                                                  int verbose,
+                                                  const CMQCancelToken* cancel); // 4 lanes of 32 equations
+void exhaustive_sse2_deg_2_T_1_w64(LUT_t LUT, 
+                                                  int n, 
+                                                  pck_vector_t F[], 
+                                                  solution_callback_t callback, 
+                                                  void* callback_state, 
+                                                  int verbose,
+                                                  const CMQCancelToken* cancel); // 2 lanes of 64 equations
+void exhaustive_avx2_deg_2_T_3_w32(LUT_t LUT, 
+                                                  int n, 
+                                                  pck_vector_t F[], 
+                                                  solution_callback_t callback, 
+                                                  void* callback_state, 
+                                                  int verbose,
+                                                  const CMQCancelToken* cancel); // 8 lanes of 32 equations, needs AVX2
+void exhaustive_avx2_deg_2_T_2_w64(LUT_t LUT, 
+                                                  int n, 
+                                                  pck_vector_t F[], 
+                                                  solution_callback_t callback, 
+                                                  void* callback_state, 
+                                                  int verbose,
+                                                  const CMQCancelToken* cancel); // 4 lanes of 64 equations, needs AVX2
 #endif
 
 #ifdef HAVE_64_BITS
@@ -123,9 +306,17 @@ extern void func_deg_2_T_2_el_0(__m128i *F, uint64_t *F_sp, void *buf, uint64_t
 extern void func_deg_2_T_3_el_0(__m128i *F, uint64_t *F_sp, void *buf, uint64_t *num, uint64_t idx); // autogenerated_asm_deg_2_T_3_el_0.s
 extern void func_deg_2_T_4_el_0(__m128i *F, uint64_t *F_sp, void *buf, uint64_t *num, uint64_t idx); // autogenerated_asm_deg_2_T_4_el_0.s
 #endif
-void exfes (int m, int n, int e, uint64_t *Mask, uint64_t maxsol, int ***Eqs, uint64_t **SolArray,CBlockIndex* pindexPrev);
+void exfes (int m, int n, int e, uint64_t *Mask, uint64_t maxsol, int ***Eqs, uint64_t **SolArray,const CMQCancelToken* cancel);
+void exfes_mask (int n, int e, uint64_t *Mask, int ***Eqs);
+packed_system_t *exfes_packed_system (int m, int n, int e, int ***Eqs);
+exfes_packed_eqs_t *exfes_pack_equations (int m, int n, int e, int ***Eqs, const packed_system_t *sys);
+void free_exfes_packed_eqs (exfes_packed_eqs_t *eqs);
+int exfes_subproblem (int m, int n, uint64_t *Mask, uint64_t solm, const exfes_packed_eqs_t *eqs, packed_system_t *sys, pck_vector_t *F, uint64_t **SolArray, const CMQCancelToken* cancel);
+void exfes_search (int m, int n, int e, uint64_t *Mask, int ***Eqs, packed_system_t *sys, uint64_t **SolArray, const CMQCancelToken* cancel);
 int ***CreateEquations (int n, int e);
 void FreeEquations (int e, int ***Eqs);
+uint64_t **CreateArray (uint64_t maxsol);
+void FreeArray (uint64_t maxsol, uint64_t **SolArray);
 
 
 
@@ -139,12 +330,95 @@ unsigned int ComputeMinWork(unsigned int nBase, int64 nTime);
 
 unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock);
 
+/** The equation system of a block template together with the packed quadratic
+ *  part of its exfes sub-problems. Both only depend on (seedHash, nBits,
+ *  coefficient rule), each attempt on the template only applies its own start point.
+ */
+class CMQSolverContext
+{
+public:
+    const uint256 seedHash;
+    const unsigned int nBits;
+    const bool fNewCoeffMatrix;
+    const int nSearchVariables;
+    const int nUnknowns;
+    const int mEquations;
+
+    CMQSolverContext(uint256 seedHashIn, unsigned int nBitsIn, bool fNewCoeffMatrixIn, int nSearchVariablesIn);
+    ~CMQSolverContext();
+
+    bool IsValid() const { return sys != NULL; }
+    packed_system_t *PackedSystem() const { return sys; }
+
+    // Copy of the equations masked with the start point Mask, free it with FreeEquations().
+    int ***MaskedEquations(uint64_t *Mask) const;
+
+    // Same, packed for exfes_subproblem(). Free it with free_exfes_packed_eqs().
+    exfes_packed_eqs_t *PackedMaskedEquations(uint64_t *Mask) const;
+
+private:
+    int ***Eqs;
+    packed_system_t *sys;
+
+    CMQSolverContext(const CMQSolverContext&);
+    CMQSolverContext& operator=(const CMQSolverContext&);
+};
+
+/** Generator of the coefficients of the equation system of a block, one
+ *  equation at a time. A row holds the nTerms coefficients of an equation,
+ *  packed 64 per word in the order of the coefficient matrix: x[i]*x[j] for
+ *  i<j, then x[i], then 1. The bits past nTerms are zero.
+ */
+class CMQCoeffGenerator
+{
+public:
+    CMQCoeffGenerator(uint256 hash, unsigned int nBits, bool fNewCoeffMatrix);
+
+    unsigned int Terms() const { return nTerms; }
+    unsigned int Words() const { return nWords; }
+    // size of the row buffers given to Next()
+    unsigned int RowWords() const { return 4 * nHashes + 1; }
+
+    // Write the row of the next equation
+    void Next(uint64_t *row);
+
+private:
+    const bool fNewCoeffMatrix;
+    const unsigned int nTerms;
+    const unsigned int nWords;
+    const unsigned int nHashes;      // SHA-256 outputs per row
+    unsigned int nRow;
+    unsigned char in[32];            // input of the next SHA-256 of the chain
+    std::vector<uint64_t> twice;     // GenCoeffMatrix: two copies of the first row
+
+    void NextHashes(uint64_t *row);
+};
+
+/** Whether the block at height nHeight uses NewGenCoeffMatrix */
+bool UseNewCoeffMatrix(int nHeight);
+
+/** Shared solver context of the block at height nHeight, built on first use */
+boost::shared_ptr<const CMQSolverContext> GetMQSolverContext(uint256 seedHash, unsigned int nBits, int nHeight, int nSearchVariables);
+
+/** Number of variables fixed by exfes to split a system of nUnknowns unknowns
+ *  into at least nSubProblems sub-problems, as far as the kernels allow */
+int MQSearchVariables(int nUnknowns, uint64_t nSubProblems);
+
+/** Store the first maxsol solutions of SolArray in s */
+int ReportSolution(uint64_t maxsol, uint64_t **SolArray, uint256 &s);
+
 uint256 SerchSolution(uint256 hash, unsigned int nBits, uint256 randomNonce, CBlockIndex* pindexPrev);
 
 bool CheckSolution(uint256 hash, unsigned int nBits, uint256 preblockhash, int nblockversion, uint256 nNonce) ;
+bool CheckSolution(uint256 hash, unsigned int nBits, bool fNewCoeffMatrix, uint256 nNonce) ;
+bool CheckSolutionBytewise(uint256 hash, unsigned int nBits, uint256 preblockhash, int nblockversion, uint256 nNonce) ;
 
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
 bool CheckProofOfWork(uint256 hash, unsigned int nBits, uint256 preblockhash, int nblockversion, uint256 nNonce);
+bool CheckProofOfWork(uint256 hash, unsigned int nBits, bool fNewCoeffMatrix, int nblockversion, uint256 nNonce);
+
+/** Number of entries, hits and misses of the proof of work verification cache */
+void GetPoWCacheStats(uint64_t& nSize, uint64_t& nHits, uint64_t& nMisses);
 
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
@@ -23,14 +23,25 @@ extern  "C" {
 #include "blas_u64.h"
 
 #define gf16v_mul_scalar  _gf16v_mul_scalar_u64
+#ifdef _BLAS_SIMD_
+#include "blas_simd.h"
+#define gf16v_madd        gf16v_madd_simd
+#else
 #define gf16v_madd        _gf16v_madd_u64
+#endif
 
 #define gf256v_add        _gf256v_add_u64
 #define gf256v_mul_scalar  _gf256v_mul_scalar_u64
 #define gf256v_madd        _gf256v_madd_u64
 #define gf256v_m0x10_add  _gf256v_m0x10_add_u64
 
+#ifdef _BLAS_SIMD_
+#define gf16mat_prod      gf16mat_prod_simd
+#define gf16mat_gauss_elim  gf16mat_gauss_elim_simd
+#else
 #define gf16mat_prod      _gf16mat_prod
+#define gf16mat_gauss_elim  _gf16mat_gauss_elim
+#endif
 #define gf16v_dot         _gf16v_dot
 
 #define gf256v_m0x4_add  _gf256v_m0x4_add
@@ -42,6 +53,7 @@ extern  "C" {
 #define gf16v_mul_scalar  _gf16v_mul_scalar
 #define gf16v_madd        _gf16v_madd
 #define gf16mat_prod      _gf16mat_prod
+#define gf16mat_gauss_elim  _gf16mat_gauss_elim
 #define gf16v_dot         _gf16v_dot
 
 #define gf256v_add        _gf256v_add
@@ -203,7 +215,7 @@ void gf16mat_mul( uint8_t * c , const uint8_t * a , const uint8_t * b , unsigned
 }
 
 static inline
-unsigned gf16mat_gauss_elim( uint8_t * mat , unsigned h , unsigned w )
+unsigned _gf16mat_gauss_elim( uint8_t * mat , unsigned h , unsigned w )
 {
 	unsigned n_w_byte = (w+1)/2;
 	unsigned r8 = 1;
@@ -4,6 +4,11 @@
 
 #define _BLAS_UINT64_
 
+/// SSSE3/AVX2 kernels of blas_simd.h, selected at runtime
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define _BLAS_SIMD_
+#endif
+
 #define NDEBUG
 
 #endif
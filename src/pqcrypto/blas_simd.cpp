@@ -0,0 +1,550 @@
+#include "blas.h"
+
+#ifdef _BLAS_SIMD_
+
+#include "blas_u64.h"
+#include "blas_simd.h"
+
+#include "rainbow_config.h"
+#include "mpkc.h"
+
+#include <immintrin.h>
+
+
+
+/// gf16_mul_tab[b][a] = gf16_mul(a,b), one pshufb table per multiplier
+static const uint8_t gf16_mul_tab[16][16] __attribute__((aligned(16))) = {
+	{0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00},
+	{0x00,0x01,0x02,0x03,0x04,0x05,0x06,0x07,0x08,0x09,0x0a,0x0b,0x0c,0x0d,0x0e,0x0f},
+	{0x00,0x02,0x03,0x01,0x08,0x0a,0x0b,0x09,0x0c,0x0e,0x0f,0x0d,0x04,0x06,0x07,0x05},
+	{0x00,0x03,0x01,0x02,0x0c,0x0f,0x0d,0x0e,0x04,0x07,0x05,0x06,0x08,0x0b,0x09,0x0a},
+	{0x00,0x04,0x08,0x0c,0x06,0x02,0x0e,0x0a,0x0b,0x0f,0x03,0x07,0x0d,0x09,0x05,0x01},
+	{0x00,0x05,0x0a,0x0f,0x02,0x07,0x08,0x0d,0x03,0x06,0x09,0x0c,0x01,0x04,0x0b,0x0e},
+	{0x00,0x06,0x0b,0x0d,0x0e,0x08,0x05,0x03,0x07,0x01,0x0c,0x0a,0x09,0x0f,0x02,0x04},
+	{0x00,0x07,0x09,0x0e,0x0a,0x0d,0x03,0x04,0x0f,0x08,0x06,0x01,0x05,0x02,0x0c,0x0b},
+	{0x00,0x08,0x0c,0x04,0x0b,0x03,0x07,0x0f,0x0d,0x05,0x01,0x09,0x06,0x0e,0x0a,0x02},
+	{0x00,0x09,0x0e,0x07,0x0f,0x06,0x01,0x08,0x05,0x0c,0x0b,0x02,0x0a,0x03,0x04,0x0d},
+	{0x00,0x0a,0x0f,0x05,0x03,0x09,0x0c,0x06,0x01,0x0b,0x0e,0x04,0x02,0x08,0x0d,0x07},
+	{0x00,0x0b,0x0d,0x06,0x07,0x0c,0x0a,0x01,0x09,0x02,0x04,0x0f,0x0e,0x05,0x03,0x08},
+	{0x00,0x0c,0x04,0x08,0x0d,0x01,0x09,0x05,0x06,0x0a,0x02,0x0e,0x0b,0x07,0x0f,0x03},
+	{0x00,0x0d,0x06,0x0b,0x09,0x04,0x0f,0x02,0x0e,0x03,0x08,0x05,0x07,0x0a,0x01,0x0c},
+	{0x00,0x0e,0x07,0x09,0x05,0x0b,0x02,0x0c,0x0a,0x04,0x0d,0x03,0x0f,0x01,0x08,0x06},
+	{0x00,0x0f,0x05,0x0a,0x01,0x0e,0x04,0x0b,0x02,0x0d,0x07,0x08,0x03,0x0c,0x06,0x09},
+};
+
+
+static unsigned gf16_simd_detect( void )
+{
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports("avx2") ) return GF16_SIMD_AVX2;
+	if( __builtin_cpu_supports("ssse3") ) return GF16_SIMD_SSSE3;
+	return GF16_SIMD_NONE;
+}
+
+/// zero ( the u64 library ) until the static initialization ran
+static unsigned _gf16_simd_supported = gf16_simd_detect();
+static unsigned _gf16_simd_level = _gf16_simd_supported;
+
+unsigned gf16_simd_supported( void ) { return _gf16_simd_supported; }
+
+unsigned gf16_simd_level( void ) { return _gf16_simd_level; }
+
+unsigned gf16_simd_set_level( unsigned level )
+{
+	_gf16_simd_level = (level < _gf16_simd_supported)? level : _gf16_simd_supported;
+	return _gf16_simd_level;
+}
+
+
+
+//////////////////////////////////////////
+/// SSSE3
+/////////////////////////////////////////
+
+/// a*b of 32 gf16 elements, tab_l = gf16_mul_tab[b], tab_h = tab_l<<4
+static inline __attribute__((always_inline,target("ssse3")))
+__m128i gf16v_mul_x16( __m128i a , __m128i tab_l , __m128i tab_h , __m128i mask_f )
+{
+	__m128i l = _mm_shuffle_epi8( tab_l , _mm_and_si128( a , mask_f ) );
+	__m128i h = _mm_shuffle_epi8( tab_h , _mm_and_si128( _mm_srli_epi16( a , 4 ) , mask_f ) );
+	return _mm_xor_si128( l , h );
+}
+
+static inline __attribute__((always_inline,target("ssse3")))
+__m128i gf16_tab_x16( uint8_t b ) { return _mm_load_si128( (const __m128i *)gf16_mul_tab[b&0xf] ); }
+
+__attribute__((target("ssse3")))
+static void gf16v_madd_ssse3( uint8_t * accu_c, const uint8_t * a , uint8_t b, unsigned _num_byte )
+{
+	const __m128i mask_f = _mm_set1_epi8( 0xf );
+	const __m128i tab_l = gf16_tab_x16( b );
+	const __m128i tab_h = _mm_slli_epi16( tab_l , 4 );
+	unsigned i=0;
+	for(;i+16<=_num_byte;i+=16) {
+		__m128i c = _mm_loadu_si128( (const __m128i *)&accu_c[i] );
+		__m128i p = gf16v_mul_x16( _mm_loadu_si128( (const __m128i *)&a[i] ) , tab_l , tab_h , mask_f );
+		_mm_storeu_si128( (__m128i *)&accu_c[i] , _mm_xor_si128( c , p ) );
+	}
+	if( i < _num_byte ) _gf16v_madd_u64( accu_c+i , a+i , b , _num_byte-i );
+}
+
+/// column products of a matrix with n_xmm*16 byte columns, accumulated in registers
+static inline __attribute__((always_inline,target("ssse3")))
+void gf16mat_prod_xmm( uint8_t * c , const uint8_t * matA , unsigned n_xmm , unsigned n_A_width , const uint8_t * b )
+{
+	const __m128i mask_f = _mm_set1_epi8( 0xf );
+	__m128i r[4];
+	for(unsigned k=0;k<n_xmm;k++) r[k] = _mm_setzero_si128();
+	for(unsigned i=0;i<n_A_width;i++) {
+		const __m128i tab_l = gf16_tab_x16( gf16v_get_ele( b , i ) );
+		const __m128i tab_h = _mm_slli_epi16( tab_l , 4 );
+		for(unsigned k=0;k<n_xmm;k++)
+			r[k] = _mm_xor_si128( r[k] , gf16v_mul_x16( _mm_loadu_si128( (const __m128i *)matA + k ) , tab_l , tab_h , mask_f ) );
+		matA += n_xmm*16;
+	}
+	for(unsigned k=0;k<n_xmm;k++) _mm_storeu_si128( (__m128i *)c + k , r[k] );
+}
+
+__attribute__((target("ssse3")))
+static void gf16mat_prod_ssse3( uint8_t * c , const uint8_t * matA , unsigned n_A_vec_byte , unsigned n_A_width , const uint8_t * b )
+{
+	switch( n_A_vec_byte ) {
+		case 16: gf16mat_prod_xmm( c , matA , 1 , n_A_width , b ); return;
+		case 32: gf16mat_prod_xmm( c , matA , 2 , n_A_width , b ); return;
+		case 48: gf16mat_prod_xmm( c , matA , 3 , n_A_width , b ); return;
+		case 64: gf16mat_prod_xmm( c , matA , 4 , n_A_width , b ); return;
+	}
+	gf256v_set_zero( c , n_A_vec_byte );
+	for(unsigned i=0;i<n_A_width;i++) {
+		gf16v_madd_ssse3( c , matA , gf16v_get_ele( b , i ) , n_A_vec_byte );
+		matA += n_A_vec_byte;
+	}
+}
+
+/// the same steps as _gf16mat_gauss_elim(), on rows padded to 32 bytes. row i
+/// stays in registers while it is reduced, with its element i kept aside.
+__attribute__((target("ssse3")))
+static unsigned gf16mat_gauss_elim_ssse3( uint8_t (* m)[32] , unsigned h )
+{
+	const __m128i mask_f = _mm_set1_epi8( 0xf );
+	unsigned r8 = 1;
+	for(unsigned i=0;i<h;i++) {
+		__m128i ai0 = _mm_load_si128( (const __m128i *)m[i] );
+		__m128i ai1 = _mm_load_si128( (const __m128i *)m[i] + 1 );
+		uint8_t ai_i = gf16v_get_ele( m[i] , i );
+		for(unsigned j=i+1;j<h;j++) {
+			uint8_t aj_i = gf16v_get_ele( m[j] , i );
+			uint8_t cond = gf16_is_nonzero( ai_i )^gf16_is_nonzero( aj_i );
+			const __m128i mask = _mm_set1_epi8( -cond );
+			ai0 = _mm_xor_si128( ai0 , _mm_and_si128( _mm_load_si128( (const __m128i *)m[j] ) , mask ) );
+			ai1 = _mm_xor_si128( ai1 , _mm_and_si128( _mm_load_si128( (const __m128i *)m[j] + 1 ) , mask ) );
+			ai_i ^= aj_i & (-cond);
+		}
+		r8 &= gf16_is_nonzero( ai_i );
+		__m128i tab_l = gf16_tab_x16( gf16_inv( ai_i ) );
+		__m128i tab_h = _mm_slli_epi16( tab_l , 4 );
+		ai0 = gf16v_mul_x16( ai0 , tab_l , tab_h , mask_f );
+		ai1 = gf16v_mul_x16( ai1 , tab_l , tab_h , mask_f );
+		_mm_store_si128( (__m128i *)m[i] , ai0 );
+		_mm_store_si128( (__m128i *)m[i] + 1 , ai1 );
+		for(unsigned j=0;j<h;j++) {
+			if(i==j) continue;
+			tab_l = gf16_tab_x16( gf16v_get_ele( m[j] , i ) );
+			tab_h = _mm_slli_epi16( tab_l , 4 );
+			__m128i aj0 = _mm_xor_si128( _mm_load_si128( (const __m128i *)m[j] ) , gf16v_mul_x16( ai0 , tab_l , tab_h , mask_f ) );
+			__m128i aj1 = _mm_xor_si128( _mm_load_si128( (const __m128i *)m[j] + 1 ) , gf16v_mul_x16( ai1 , tab_l , tab_h , mask_f ) );
+			_mm_store_si128( (__m128i *)m[j] , aj0 );
+			_mm_store_si128( (__m128i *)m[j] + 1 , aj1 );
+		}
+	}
+	return r8;
+}
+
+
+
+//////////////////////////////////////////
+/// AVX2
+/////////////////////////////////////////
+
+static inline __attribute__((always_inline,target("avx2")))
+__m256i gf16v_mul_x32( __m256i a , __m256i tab_l , __m256i tab_h , __m256i mask_f )
+{
+	__m256i l = _mm256_shuffle_epi8( tab_l , _mm256_and_si256( a , mask_f ) );
+	__m256i h = _mm256_shuffle_epi8( tab_h , _mm256_and_si256( _mm256_srli_epi16( a , 4 ) , mask_f ) );
+	return _mm256_xor_si256( l , h );
+}
+
+static inline __attribute__((always_inline,target("avx2")))
+__m256i gf16_tab_x32( uint8_t b ) { return _mm256_broadcastsi128_si256( gf16_tab_x16( b ) ); }
+
+__attribute__((target("avx2")))
+static void gf16v_madd_avx2( uint8_t * accu_c, const uint8_t * a , uint8_t b, unsigned _num_byte )
+{
+	const __m256i mask_f = _mm256_set1_epi8( 0xf );
+	const __m256i tab_l = gf16_tab_x32( b );
+	const __m256i tab_h = _mm256_slli_epi16( tab_l , 4 );
+	unsigned i=0;
+	for(;i+32<=_num_byte;i+=32) {
+		__m256i c = _mm256_loadu_si256( (const __m256i *)&accu_c[i] );
+		__m256i p = gf16v_mul_x32( _mm256_loadu_si256( (const __m256i *)&a[i] ) , tab_l , tab_h , mask_f );
+		_mm256_storeu_si256( (__m256i *)&accu_c[i] , _mm256_xor_si256( c , p ) );
+	}
+	if( i+16 <= _num_byte ) {
+		__m128i c = _mm_loadu_si128( (const __m128i *)&accu_c[i] );
+		__m128i p = gf16v_mul_x16( _mm_loadu_si128( (const __m128i *)&a[i] ) ,
+				_mm256_castsi256_si128( tab_l ) , _mm256_castsi256_si128( tab_h ) , _mm256_castsi256_si128( mask_f ) );
+		_mm_storeu_si128( (__m128i *)&accu_c[i] , _mm_xor_si128( c , p ) );
+		i += 16;
+	}
+	if( i < _num_byte ) _gf16v_madd_u64( accu_c+i , a+i , b , _num_byte-i );
+}
+
+static inline __attribute__((always_inline,target("avx2")))
+void gf16mat_prod_ymm( uint8_t * c , const uint8_t * matA , unsigned n_ymm , unsigned n_A_width , const uint8_t * b )
+{
+	const __m256i mask_f = _mm256_set1_epi8( 0xf );
+	__m256i r[2];
+	for(unsigned k=0;k<n_ymm;k++) r[k] = _mm256_setzero_si256();
+	for(unsigned i=0;i<n_A_width;i++) {
+		const __m256i tab_l = gf16_tab_x32( gf16v_get_ele( b , i ) );
+		const __m256i tab_h = _mm256_slli_epi16( tab_l , 4 );
+		for(unsigned k=0;k<n_ymm;k++)
+			r[k] = _mm256_xor_si256( r[k] , gf16v_mul_x32( _mm256_loadu_si256( (const __m256i *)matA + k ) , tab_l , tab_h , mask_f ) );
+		matA += n_ymm*32;
+	}
+	for(unsigned k=0;k<n_ymm;k++) _mm256_storeu_si256( (__m256i *)c + k , r[k] );
+}
+
+__attribute__((target("avx2")))
+static void gf16mat_prod_avx2( uint8_t * c , const uint8_t * matA , unsigned n_A_vec_byte , unsigned n_A_width , const uint8_t * b )
+{
+	switch( n_A_vec_byte ) {
+		case 16: gf16mat_prod_xmm( c , matA , 1 , n_A_width , b ); return;
+		case 32: gf16mat_prod_ymm( c , matA , 1 , n_A_width , b ); return;
+		case 48: gf16mat_prod_xmm( c , matA , 3 , n_A_width , b ); return;
+		case 64: gf16mat_prod_ymm( c , matA , 2 , n_A_width , b ); return;
+	}
+	gf256v_set_zero( c , n_A_vec_byte );
+	for(unsigned i=0;i<n_A_width;i++) {
+		gf16v_madd_avx2( c , matA , gf16v_get_ele( b , i ) , n_A_vec_byte );
+		matA += n_A_vec_byte;
+	}
+}
+
+__attribute__((target("avx2")))
+static unsigned gf16mat_gauss_elim_avx2( uint8_t (* m)[32] , unsigned h )
+{
+	const __m256i mask_f = _mm256_set1_epi8( 0xf );
+	unsigned r8 = 1;
+	for(unsigned i=0;i<h;i++) {
+		__m256i ai = _mm256_load_si256( (const __m256i *)m[i] );
+		uint8_t ai_i = gf16v_get_ele( m[i] , i );
+		for(unsigned j=i+1;j<h;j++) {
+			uint8_t aj_i = gf16v_get_ele( m[j] , i );
+			uint8_t cond = gf16_is_nonzero( ai_i )^gf16_is_nonzero( aj_i );
+			ai = _mm256_xor_si256( ai , _mm256_and_si256( _mm256_load_si256( (const __m256i *)m[j] ) , _mm256_set1_epi8( -cond ) ) );
+			ai_i ^= aj_i & (-cond);
+		}
+		r8 &= gf16_is_nonzero( ai_i );
+		__m256i tab_l = gf16_tab_x32( gf16_inv( ai_i ) );
+		__m256i tab_h = _mm256_slli_epi16( tab_l , 4 );
+		ai = gf16v_mul_x32( ai , tab_l , tab_h , mask_f );
+		_mm256_store_si256( (__m256i *)m[i] , ai );
+		for(unsigned j=0;j<h;j++) {
+			if(i==j) continue;
+			tab_l = gf16_tab_x32( gf16v_get_ele( m[j] , i ) );
+			tab_h = _mm256_slli_epi16( tab_l , 4 );
+			_mm256_store_si256( (__m256i *)m[j] , _mm256_xor_si256( _mm256_load_si256( (const __m256i *)m[j] ) , gf16v_mul_x32( ai , tab_l , tab_h , mask_f ) ) );
+		}
+	}
+	return r8;
+}
+
+
+
+//////////////////////////////////////////
+/// public map
+/////////////////////////////////////////
+
+/// same order of terms as mpkc_pub_map_gf16(): linear terms, then x_j*x_i for j<=i, then the constant,
+/// for n_var <= 256 variables and n_xmm*16 bytes of equations
+static inline __attribute__((always_inline,target("ssse3")))
+void mpkc_quad_map_xmm( uint8_t * z , const uint8_t * pk_mat , const uint8_t * w , unsigned n_var , unsigned n_xmm )
+{
+	const __m128i mask_f = _mm_set1_epi8( 0xf );
+	uint8_t x[256];
+	for(unsigned i=0;i<n_var;i++) x[i] = gf16v_get_ele(w,i);
+
+	__m128i r[4];
+	__m128i tmp[4];
+	for(unsigned k=0;k<n_xmm;k++) r[k] = _mm_setzero_si128();
+
+	const __m128i * mat = (const __m128i *)pk_mat;
+	for(unsigned i=0;i<n_var;i++) {
+		const __m128i tab_l = gf16_tab_x16( x[i] );
+		const __m128i tab_h = _mm_slli_epi16( tab_l , 4 );
+		for(unsigned k=0;k<n_xmm;k++) r[k] = _mm_xor_si128( r[k] , gf16v_mul_x16( _mm_loadu_si128( mat+k ) , tab_l , tab_h , mask_f ) );
+		mat += n_xmm;
+	}
+
+	for(unsigned i=0;i<n_var;i++) {
+		for(unsigned k=0;k<n_xmm;k++) tmp[k] = _mm_setzero_si128();
+		for(unsigned j=0;j<=i;j++) {
+			const __m128i tab_l = gf16_tab_x16( x[j] );
+			const __m128i tab_h = _mm_slli_epi16( tab_l , 4 );
+			for(unsigned k=0;k<n_xmm;k++) tmp[k] = _mm_xor_si128( tmp[k] , gf16v_mul_x16( _mm_loadu_si128( mat+k ) , tab_l , tab_h , mask_f ) );
+			mat += n_xmm;
+		}
+		const __m128i tab_l = gf16_tab_x16( x[i] );
+		const __m128i tab_h = _mm_slli_epi16( tab_l , 4 );
+		for(unsigned k=0;k<n_xmm;k++) r[k] = _mm_xor_si128( r[k] , gf16v_mul_x16( tmp[k] , tab_l , tab_h , mask_f ) );
+	}
+	for(unsigned k=0;k<n_xmm;k++) _mm_storeu_si128( (__m128i *)z + k , _mm_xor_si128( r[k] , _mm_loadu_si128( mat+k ) ) );
+}
+
+__attribute__((target("ssse3")))
+static void mpkc_quad_map_ssse3( uint8_t * z , const uint8_t * pk_mat , const uint8_t * w , unsigned n_var , unsigned m_byte )
+{
+	switch( m_byte ) {
+		case 16: mpkc_quad_map_xmm( z , pk_mat , w , n_var , 1 ); return;
+		case 32: mpkc_quad_map_xmm( z , pk_mat , w , n_var , 2 ); return;
+		case 48: mpkc_quad_map_xmm( z , pk_mat , w , n_var , 3 ); return;
+		case 64: mpkc_quad_map_xmm( z , pk_mat , w , n_var , 4 ); return;
+	}
+}
+
+#if 0 == (_PUB_M_BYTE%16)
+
+#define _PUB_M_XMM (_PUB_M_BYTE/16)
+
+/// n <= MPKC_BATCH_MAX public maps with one pass over pk_mat, each row is multiplied for all of them
+__attribute__((target("ssse3")))
+static void mpkc_pub_map_gf16_batch_ssse3( uint8_t * z , const uint8_t * pk_mat , const uint8_t * const * w , unsigned n )
+{
+	const __m128i mask_f = _mm_set1_epi8( 0xf );
+	const unsigned n_var = _PUB_N;
+	uint8_t x[_PUB_N][MPKC_BATCH_MAX];
+	for(unsigned k=0;k<n;k++) {
+		for(unsigned i=0;i<n_var;i++) x[i][k] = gf16v_get_ele(w[k],i);
+	}
+
+	__m128i r[MPKC_BATCH_MAX][_PUB_M_XMM];
+	__m128i tmp[MPKC_BATCH_MAX][_PUB_M_XMM];
+	__m128i row[_PUB_M_XMM];
+	for(unsigned k=0;k<n;k++) {
+		for(unsigned kk=0;kk<_PUB_M_XMM;kk++) r[k][kk] = _mm_setzero_si128();
+	}
+
+	const __m128i * mat = (const __m128i *)pk_mat;
+	for(unsigned i=0;i<n_var;i++) {
+		for(unsigned kk=0;kk<_PUB_M_XMM;kk++) row[kk] = _mm_loadu_si128( mat+kk );
+		mat += _PUB_M_XMM;
+		for(unsigned k=0;k<n;k++) {
+			const __m128i tab_l = gf16_tab_x16( x[i][k] );
+			const __m128i tab_h = _mm_slli_epi16( tab_l , 4 );
+			for(unsigned kk=0;kk<_PUB_M_XMM;kk++) r[k][kk] = _mm_xor_si128( r[k][kk] , gf16v_mul_x16( row[kk] , tab_l , tab_h , mask_f ) );
+		}
+	}
+
+	for(unsigned i=0;i<n_var;i++) {
+		for(unsigned k=0;k<n;k++) {
+			for(unsigned kk=0;kk<_PUB_M_XMM;kk++) tmp[k][kk] = _mm_setzero_si128();
+		}
+		for(unsigned j=0;j<=i;j++) {
+			for(unsigned kk=0;kk<_PUB_M_XMM;kk++) row[kk] = _mm_loadu_si128( mat+kk );
+			mat += _PUB_M_XMM;
+			for(unsigned k=0;k<n;k++) {
+				const __m128i tab_l = gf16_tab_x16( x[j][k] );
+				const __m128i tab_h = _mm_slli_epi16( tab_l , 4 );
+				for(unsigned kk=0;kk<_PUB_M_XMM;kk++) tmp[k][kk] = _mm_xor_si128( tmp[k][kk] , gf16v_mul_x16( row[kk] , tab_l , tab_h , mask_f ) );
+			}
+		}
+		for(unsigned k=0;k<n;k++) {
+			const __m128i tab_l = gf16_tab_x16( x[i][k] );
+			const __m128i tab_h = _mm_slli_epi16( tab_l , 4 );
+			for(unsigned kk=0;kk<_PUB_M_XMM;kk++) r[k][kk] = _mm_xor_si128( r[k][kk] , gf16v_mul_x16( tmp[k][kk] , tab_l , tab_h , mask_f ) );
+		}
+	}
+	for(unsigned k=0;k<n;k++) {
+		for(unsigned kk=0;kk<_PUB_M_XMM;kk++) _mm_storeu_si128( (__m128i *)(z+k*_PUB_M_BYTE) + kk , _mm_xor_si128( r[k][kk] , _mm_loadu_si128( mat+kk ) ) );
+	}
+}
+
+#endif
+
+static inline __attribute__((always_inline,target("avx2")))
+void mpkc_quad_map_ymm( uint8_t * z , const uint8_t * pk_mat , const uint8_t * w , unsigned n_var , unsigned n_ymm )
+{
+	const __m256i mask_f = _mm256_set1_epi8( 0xf );
+	uint8_t x[256];
+	for(unsigned i=0;i<n_var;i++) x[i] = gf16v_get_ele(w,i);
+
+	__m256i r[2];
+	__m256i tmp[2];
+	for(unsigned k=0;k<n_ymm;k++) r[k] = _mm256_setzero_si256();
+
+	const __m256i * mat = (const __m256i *)pk_mat;
+	for(unsigned i=0;i<n_var;i++) {
+		const __m256i tab_l = gf16_tab_x32( x[i] );
+		const __m256i tab_h = _mm256_slli_epi16( tab_l , 4 );
+		for(unsigned k=0;k<n_ymm;k++) r[k] = _mm256_xor_si256( r[k] , gf16v_mul_x32( _mm256_loadu_si256( mat+k ) , tab_l , tab_h , mask_f ) );
+		mat += n_ymm;
+	}
+
+	for(unsigned i=0;i<n_var;i++) {
+		for(unsigned k=0;k<n_ymm;k++) tmp[k] = _mm256_setzero_si256();
+		for(unsigned j=0;j<=i;j++) {
+			const __m256i tab_l = gf16_tab_x32( x[j] );
+			const __m256i tab_h = _mm256_slli_epi16( tab_l , 4 );
+			for(unsigned k=0;k<n_ymm;k++) tmp[k] = _mm256_xor_si256( tmp[k] , gf16v_mul_x32( _mm256_loadu_si256( mat+k ) , tab_l , tab_h , mask_f ) );
+			mat += n_ymm;
+		}
+		const __m256i tab_l = gf16_tab_x32( x[i] );
+		const __m256i tab_h = _mm256_slli_epi16( tab_l , 4 );
+		for(unsigned k=0;k<n_ymm;k++) r[k] = _mm256_xor_si256( r[k] , gf16v_mul_x32( tmp[k] , tab_l , tab_h , mask_f ) );
+	}
+	for(unsigned k=0;k<n_ymm;k++) _mm256_storeu_si256( (__m256i *)z + k , _mm256_xor_si256( r[k] , _mm256_loadu_si256( mat+k ) ) );
+}
+
+/// 16 byte equations stay in xmm registers
+__attribute__((target("avx2")))
+static void mpkc_quad_map_avx2( uint8_t * z , const uint8_t * pk_mat , const uint8_t * w , unsigned n_var , unsigned m_byte )
+{
+	switch( m_byte ) {
+		case 16: mpkc_quad_map_xmm( z , pk_mat , w , n_var , 1 ); return;
+		case 32: mpkc_quad_map_ymm( z , pk_mat , w , n_var , 1 ); return;
+		case 48: mpkc_quad_map_xmm( z , pk_mat , w , n_var , 3 ); return;
+		case 64: mpkc_quad_map_ymm( z , pk_mat , w , n_var , 2 ); return;
+	}
+}
+
+#if 0 == (_PUB_M_BYTE%32)
+
+#define _PUB_M_YMM (_PUB_M_BYTE/32)
+
+__attribute__((target("avx2")))
+static void mpkc_pub_map_gf16_batch_avx2( uint8_t * z , const uint8_t * pk_mat , const uint8_t * const * w , unsigned n )
+{
+	const __m256i mask_f = _mm256_set1_epi8( 0xf );
+	const unsigned n_var = _PUB_N;
+	uint8_t x[_PUB_N][MPKC_BATCH_MAX];
+	for(unsigned k=0;k<n;k++) {
+		for(unsigned i=0;i<n_var;i++) x[i][k] = gf16v_get_ele(w[k],i);
+	}
+
+	__m256i r[MPKC_BATCH_MAX][_PUB_M_YMM];
+	__m256i tmp[MPKC_BATCH_MAX][_PUB_M_YMM];
+	__m256i row[_PUB_M_YMM];
+	for(unsigned k=0;k<n;k++) {
+		for(unsigned kk=0;kk<_PUB_M_YMM;kk++) r[k][kk] = _mm256_setzero_si256();
+	}
+
+	const __m256i * mat = (const __m256i *)pk_mat;
+	for(unsigned i=0;i<n_var;i++) {
+		for(unsigned kk=0;kk<_PUB_M_YMM;kk++) row[kk] = _mm256_loadu_si256( mat+kk );
+		mat += _PUB_M_YMM;
+		for(unsigned k=0;k<n;k++) {
+			const __m256i tab_l = gf16_tab_x32( x[i][k] );
+			const __m256i tab_h = _mm256_slli_epi16( tab_l , 4 );
+			for(unsigned kk=0;kk<_PUB_M_YMM;kk++) r[k][kk] = _mm256_xor_si256( r[k][kk] , gf16v_mul_x32( row[kk] , tab_l , tab_h , mask_f ) );
+		}
+	}
+
+	for(unsigned i=0;i<n_var;i++) {
+		for(unsigned k=0;k<n;k++) {
+			for(unsigned kk=0;kk<_PUB_M_YMM;kk++) tmp[k][kk] = _mm256_setzero_si256();
+		}
+		for(unsigned j=0;j<=i;j++) {
+			for(unsigned kk=0;kk<_PUB_M_YMM;kk++) row[kk] = _mm256_loadu_si256( mat+kk );
+			mat += _PUB_M_YMM;
+			for(unsigned k=0;k<n;k++) {
+				const __m256i tab_l = gf16_tab_x32( x[j][k] );
+				const __m256i tab_h = _mm256_slli_epi16( tab_l , 4 );
+				for(unsigned kk=0;kk<_PUB_M_YMM;kk++) tmp[k][kk] = _mm256_xor_si256( tmp[k][kk] , gf16v_mul_x32( row[kk] , tab_l , tab_h , mask_f ) );
+			}
+		}
+		for(unsigned k=0;k<n;k++) {
+			const __m256i tab_l = gf16_tab_x32( x[i][k] );
+			const __m256i tab_h = _mm256_slli_epi16( tab_l , 4 );
+			for(unsigned kk=0;kk<_PUB_M_YMM;kk++) r[k][kk] = _mm256_xor_si256( r[k][kk] , gf16v_mul_x32( tmp[k][kk] , tab_l , tab_h , mask_f ) );
+		}
+	}
+	for(unsigned k=0;k<n;k++) {
+		for(unsigned kk=0;kk<_PUB_M_YMM;kk++) _mm256_storeu_si256( (__m256i *)(z+k*_PUB_M_BYTE) + kk , _mm256_xor_si256( r[k][kk] , _mm256_loadu_si256( mat+kk ) ) );
+	}
+}
+
+#endif
+
+
+
+//////////////////////////////////////////
+/// dispatch
+/////////////////////////////////////////
+
+void gf16v_madd_simd( uint8_t * accu_c, const uint8_t * a , uint8_t b, unsigned _num_byte )
+{
+	if( _num_byte < 16 || GF16_SIMD_NONE == _gf16_simd_level ) { _gf16v_madd_u64( accu_c , a , b , _num_byte ); return; }
+	if( GF16_SIMD_AVX2 == _gf16_simd_level ) gf16v_madd_avx2( accu_c , a , b , _num_byte );
+	else gf16v_madd_ssse3( accu_c , a , b , _num_byte );
+}
+
+void gf16mat_prod_simd( uint8_t * c , const uint8_t * matA , unsigned n_A_vec_byte , unsigned n_A_width , const uint8_t * b )
+{
+	if( GF16_SIMD_AVX2 == _gf16_simd_level ) { gf16mat_prod_avx2( c , matA , n_A_vec_byte , n_A_width , b ); return; }
+	if( GF16_SIMD_SSSE3 == _gf16_simd_level ) { gf16mat_prod_ssse3( c , matA , n_A_vec_byte , n_A_width , b ); return; }
+
+	gf256v_set_zero( c , n_A_vec_byte );
+	for(unsigned i=0;i<n_A_width;i++) {
+		_gf16v_madd_u64( c , matA , gf16v_get_ele( b , i ) , n_A_vec_byte );
+		matA += n_A_vec_byte;
+	}
+}
+
+/// rows of gf16mat_gauss_elim_simd() in registers
+#define GF16_GAUSS_MAX_H  64
+
+unsigned gf16mat_gauss_elim_simd( uint8_t * mat , unsigned h , unsigned w )
+{
+	unsigned n_w_byte = (w+1)/2;
+	if( GF16_SIMD_NONE == _gf16_simd_level || GF16_GAUSS_MAX_H < h || 32 < n_w_byte ) return _gf16mat_gauss_elim( mat , h , w );
+
+	uint8_t m[GF16_GAUSS_MAX_H][32] __attribute__((aligned(32)));
+	for(unsigned i=0;i<h;i++) {
+		memcpy( m[i] , mat + i*n_w_byte , n_w_byte );
+		memset( m[i] + n_w_byte , 0 , 32 - n_w_byte );
+	}
+	unsigned r8 = ( GF16_SIMD_AVX2 == _gf16_simd_level )? gf16mat_gauss_elim_avx2( m , h ) : gf16mat_gauss_elim_ssse3( m , h );
+	for(unsigned i=0;i<h;i++) memcpy( mat + i*n_w_byte , m[i] , n_w_byte );
+	return r8;
+}
+
+void mpkc_pub_map_gf16_n_m_simd( uint8_t * z , const uint8_t * pk_mat , const uint8_t * w , unsigned n , unsigned m )
+{
+	unsigned m_byte = (m+1)/2;
+	if( GF16_SIMD_NONE != _gf16_simd_level && n <= 256 && 0 == (m_byte%16) && m_byte <= 64 ) {
+		if( GF16_SIMD_AVX2 == _gf16_simd_level ) mpkc_quad_map_avx2( z , pk_mat , w , n , m_byte );
+		else mpkc_quad_map_ssse3( z , pk_mat , w , n , m_byte );
+		return;
+	}
+	_mpkc_pub_map_gf16_n_m( z , pk_mat , w , n , m );
+}
+
+void mpkc_pub_map_gf16_simd( uint8_t * z , const uint8_t * pk_mat , const uint8_t * w )
+{
+	mpkc_pub_map_gf16_n_m_simd( z , pk_mat , w , _PUB_N , _PUB_M );
+}
+
+void mpkc_pub_map_gf16_batch_simd( uint8_t * z , const uint8_t * pk_mat , const uint8_t * const * w , unsigned n )
+{
+#ifdef _PUB_M_YMM
+	if( GF16_SIMD_AVX2 == _gf16_simd_level ) { mpkc_pub_map_gf16_batch_avx2( z , pk_mat , w , n ); return; }
+#endif
+#ifdef _PUB_M_XMM
+	if( GF16_SIMD_NONE != _gf16_simd_level ) { mpkc_pub_map_gf16_batch_ssse3( z , pk_mat , w , n ); return; }
+#endif
+	_mpkc_pub_map_gf16_batch( z , pk_mat , w , n );
+}
+
+
+#endif
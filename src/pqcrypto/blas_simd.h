@@ -0,0 +1,56 @@
+#ifndef _BLAS_SIMD_H_
+#define _BLAS_SIMD_H_
+
+#include <stdint.h>
+
+#include "blas_config.h"
+
+
+#ifdef  __cplusplus
+extern  "C" {
+#endif
+
+
+//////////////////////////////////////////
+/// SSSE3/AVX2 library, GF(16) multiplication by pshufb table lookups.
+/// The instruction set is chosen at runtime from cpuid, the u64 library
+/// is used on cpus without SSSE3.
+/////////////////////////////////////////
+
+#define GF16_SIMD_NONE   0
+#define GF16_SIMD_SSSE3  1
+#define GF16_SIMD_AVX2   2
+
+/// best level supported by the cpu
+unsigned gf16_simd_supported( void );
+
+/// level in use
+unsigned gf16_simd_level( void );
+
+/// select a lower level ( for tests and benchmarks ), returns the level in use
+unsigned gf16_simd_set_level( unsigned level );
+
+void gf16v_madd_simd( uint8_t * accu_c, const uint8_t * a , uint8_t b, unsigned _num_byte );
+
+void gf16mat_prod_simd( uint8_t * c , const uint8_t * matA , unsigned n_A_vec_byte , unsigned n_A_width , const uint8_t * b );
+
+/// _gf16mat_gauss_elim() with the rows in registers, for rows of at most 32 bytes
+unsigned gf16mat_gauss_elim_simd( uint8_t * mat , unsigned h , unsigned w );
+
+/// mpkc_pub_map_gf16_n_m() with the accumulators kept in registers, for 16, 32, 48 or 64 bytes of equations
+void mpkc_pub_map_gf16_n_m_simd( uint8_t * z , const uint8_t * pk_mat , const uint8_t * w , unsigned n , unsigned m );
+
+/// mpkc_pub_map_gf16() with the _PUB_M_BYTE accumulators kept in registers
+void mpkc_pub_map_gf16_simd( uint8_t * z , const uint8_t * pk_mat , const uint8_t * w );
+
+/// mpkc_pub_map_gf16_batch(), one pass over pk_mat for n <= MPKC_BATCH_MAX maps
+void mpkc_pub_map_gf16_batch_simd( uint8_t * z , const uint8_t * pk_mat , const uint8_t * const * w , unsigned n );
+
+
+#ifdef  __cplusplus
+}
+#endif
+
+
+
+#endif
@@ -27,6 +27,9 @@ extern  "C" {
 static inline
 void mpkc_pub_map_gf16( uint8_t * z , const uint8_t * pk_mat , const uint8_t * w )
 {
+#ifdef _BLAS_SIMD_
+	mpkc_pub_map_gf16_simd( z , pk_mat , w );
+#else
 	uint8_t r[_PUB_M_BYTE]  = {0};
 	uint8_t tmp[_PUB_M_BYTE] ;
 	const unsigned n_var = _PUB_N;
@@ -50,12 +53,13 @@ void mpkc_pub_map_gf16( uint8_t * z , const uint8_t * pk_mat , const uint8_t * w
 	}
 	gf256v_add( r , quad_mat , _PUB_M_BYTE );
 	memcpy( z , r , _PUB_M_BYTE );
+#endif
 }
 
 
 
 static inline
-void mpkc_pub_map_gf16_n_m( uint8_t * z , const uint8_t * pk_mat , const uint8_t * w , unsigned n, unsigned m )
+void _mpkc_pub_map_gf16_n_m( uint8_t * z , const uint8_t * pk_mat , const uint8_t * w , unsigned n, unsigned m )
 {
 	assert( n <= 256 );
 	assert( m <= 256 );
@@ -81,6 +85,60 @@ void mpkc_pub_map_gf16_n_m( uint8_t * z , const uint8_t * pk_mat , const uint8_t
 	gf256v_add( r , pk_mat , m_byte );
 }
 
+static inline
+void mpkc_pub_map_gf16_n_m( uint8_t * z , const uint8_t * pk_mat , const uint8_t * w , unsigned n, unsigned m )
+{
+#ifdef _BLAS_SIMD_
+	mpkc_pub_map_gf16_n_m_simd( z , pk_mat , w , n , m );
+#else
+	_mpkc_pub_map_gf16_n_m( z , pk_mat , w , n , m );
+#endif
+}
+
+
+/// max number of public maps evaluated by one pass of mpkc_pub_map_gf16_batch()
+#define MPKC_BATCH_MAX 16
+
+/// z[k*_PUB_M_BYTE] = public map of w[k] for k < n <= MPKC_BATCH_MAX,
+/// with one pass over pk_mat for all of them
+static inline
+void _mpkc_pub_map_gf16_batch( uint8_t * z , const uint8_t * pk_mat , const uint8_t * const * w , unsigned n )
+{
+	assert( n <= MPKC_BATCH_MAX );
+	uint8_t tmp[MPKC_BATCH_MAX][_PUB_M_BYTE] ;
+	const unsigned n_var = _PUB_N;
+	uint8_t x[_PUB_N][MPKC_BATCH_MAX];
+	for(unsigned k=0;k<n;k++) {
+		for(unsigned i=0;i<n_var;i++) x[i][k] = gf16v_get_ele(w[k],i);
+	}
+
+	gf256v_set_zero( z , n*_PUB_M_BYTE );
+	for(unsigned i=0;i<n_var;i++) {
+		for(unsigned k=0;k<n;k++) gf16v_madd( z+k*_PUB_M_BYTE , pk_mat , x[i][k] , _PUB_M_BYTE );
+		pk_mat += _PUB_M_BYTE;
+	}
+
+	for(unsigned i=0;i<n_var;i++) {
+		gf256v_set_zero( tmp[0] , n*_PUB_M_BYTE );
+		for(unsigned j=0;j<=i;j++) {
+			for(unsigned k=0;k<n;k++) gf16v_madd( tmp[k] , pk_mat , x[j][k] , _PUB_M_BYTE );
+			pk_mat += _PUB_M_BYTE;
+		}
+		for(unsigned k=0;k<n;k++) gf16v_madd( z+k*_PUB_M_BYTE , tmp[k] , x[i][k] , _PUB_M_BYTE );
+	}
+	for(unsigned k=0;k<n;k++) gf256v_add( z+k*_PUB_M_BYTE , pk_mat , _PUB_M_BYTE );
+}
+
+static inline
+void mpkc_pub_map_gf16_batch( uint8_t * z , const uint8_t * pk_mat , const uint8_t * const * w , unsigned n )
+{
+#ifdef _BLAS_SIMD_
+	mpkc_pub_map_gf16_batch_simd( z , pk_mat , w , n );
+#else
+	_mpkc_pub_map_gf16_batch( z , pk_mat , w , n );
+#endif
+}
+
 
 
 static inline
@@ -138,6 +196,62 @@ void mpkc_interpolate_gf16( uint8_t * poly , void (*quad_poly)(void *,const void
 }
 
 
+
+/// poly( w ) = quad_poly( T w + t ) , the composition of a quadratic map of _PUB_N variables
+/// with an affine one, with mat_t in the column layout of gf16mat_prod(). both polynomials are
+/// in the layout of mpkc_interpolate_gf16() and may not overlap.
+/// with a_i = sum_p T[i][p] w_p + t_i and q(j,i) the coefficient of a_j a_i :
+///   b[q][j] = sum_{i>=j} q(j,i) T[i][q] ,  d[j] = sum_{i>=j} q(j,i) t_i
+///   w_p w_q : sum_j T[j][p] b[q][j] ( + the same with p and q swapped )
+///   w_p     : sum_j T[j][p] d[j] + sum_j t_j b[p][j] + sum_i l_i T[i][p]
+static inline
+void mpkc_compose_affine_gf16( uint8_t * poly , const uint8_t * quad_poly , const uint8_t * mat_t , const uint8_t * vec_t )
+{
+	const unsigned n_var = _PUB_N;
+	const unsigned m_byte = _PUB_M_BYTE;
+	const uint8_t * lin = quad_poly;
+	const uint8_t * quad = quad_poly + n_var*m_byte;
+	const uint8_t * con = quad_poly + (TERMS_QUAD_POLY(_PUB_N)-1)*m_byte;
+
+	uint8_t * b = (uint8_t *)malloc( n_var*n_var*m_byte );
+	uint8_t d[_PUB_N*_PUB_M_BYTE];
+	uint8_t row[_PUB_N*_PUB_M_BYTE];
+	for(unsigned j=0;j<n_var;j++) {
+		gf256v_set_zero( row , j*m_byte );
+		for(unsigned i=j;i<n_var;i++) memcpy( row + i*m_byte , quad + IDX_QTERMS_REVLEX(j,i)*m_byte , m_byte );
+		for(unsigned q=0;q<n_var;q++) gf16mat_prod( b + (q*n_var+j)*m_byte , row , m_byte , n_var , mat_t + q*_PUB_N_BYTE );
+		gf16mat_prod( d + j*m_byte , row , m_byte , n_var , vec_t );
+	}
+
+	uint8_t tmp[_PUB_M_BYTE];
+	uint8_t * out_quad = poly + n_var*m_byte;
+	gf256v_set_zero( out_quad , IDX_QTERMS_REVLEX(0,n_var)*m_byte );
+	for(unsigned p=0;p<n_var;p++) {
+		const uint8_t * t_p = mat_t + p*_PUB_N_BYTE;
+		for(unsigned q=0;q<n_var;q++) {
+			gf16mat_prod( tmp , b + q*n_var*m_byte , m_byte , n_var , t_p );
+			unsigned idx = (p<q)? IDX_QTERMS_REVLEX(p,q) : IDX_QTERMS_REVLEX(q,p);
+			gf256v_add( out_quad + idx*m_byte , tmp , m_byte );
+		}
+
+		uint8_t * out_lin = poly + p*m_byte;
+		gf16mat_prod( out_lin , d , m_byte , n_var , t_p );
+		gf16mat_prod( tmp , b + p*n_var*m_byte , m_byte , n_var , vec_t );
+		gf256v_add( out_lin , tmp , m_byte );
+		gf16mat_prod( tmp , lin , m_byte , n_var , t_p );
+		gf256v_add( out_lin , tmp , m_byte );
+	}
+
+	uint8_t * out_con = poly + (TERMS_QUAD_POLY(_PUB_N)-1)*m_byte;
+	gf16mat_prod( out_con , d , m_byte , n_var , vec_t );
+	gf16mat_prod( tmp , lin , m_byte , n_var , vec_t );
+	gf256v_add( out_con , tmp , m_byte );
+	gf256v_add( out_con , con , m_byte );
+
+	free( b );
+}
+
+
 #ifdef  __cplusplus
 }
 #endif
@@ -30,6 +30,8 @@ static void rainbow_pubmap_seckey( uint8_t * z , const rainbow_key * sk , const
 
 static void rainbow_genkey_debug( rainbow_key * pk , rainbow_key * sk );
 
+static void rainbow_pubkey_interpolate( uint8_t * pk , const rainbow_key * pk_key );
+
 #endif
 
 
@@ -80,6 +82,69 @@ void rainbow_pubmap_wrapper( void * z, const void* pk_key, const void * w) {
 	rainbow_pubmap_seckey( (uint8_t *)z , (const rainbow_key *)pk_key, (const uint8_t *)w );
 }
 
+#ifndef _DEBUG_RAINBOW_
+static
+#endif
+void rainbow_pubkey_interpolate( uint8_t * pk , const rainbow_key * pk_key )
+{
+	mpkc_interpolate_gf16( pk , rainbow_pubmap_wrapper , (const void*) pk_key );
+}
+
+
+/// the central map as a polynomial of the _PUB_N variables, in the layout of the public key.
+/// layer 1 gives the first _O1 outputs, layer 2 the last _O2 ones.
+static
+void rainbow_central_poly( uint8_t * poly , const rainbow_ckey * k )
+{
+	const unsigned m_byte = _PUB_M_BYTE;
+	uint8_t * quad = poly + _PUB_N*m_byte;
+	uint8_t * con = poly + (TERMS_QUAD_POLY(_PUB_N)-1)*m_byte;
+	gf256v_set_zero( poly , TERMS_QUAD_POLY(_PUB_N)*m_byte );
+
+	/// the vinegar variables are the first ones of both layers
+	for(unsigned i=0;i<_V1;i++) memcpy( poly + i*m_byte , k->l1_vv + i*_O1_BYTE , _O1_BYTE );
+	for(unsigned i=0;i<IDX_QTERMS_REVLEX(0,_V1);i++) memcpy( quad + i*m_byte , k->l1_vv + (_V1+i)*_O1_BYTE , _O1_BYTE );
+	memcpy( con , k->l1_vv + (TERMS_QUAD_POLY(_V1)-1)*_O1_BYTE , _O1_BYTE );
+
+	for(unsigned i=0;i<V2;i++) memcpy( poly + i*m_byte + _O1_BYTE , k->l2_vv + i*_O2_BYTE , _O2_BYTE );
+	for(unsigned i=0;i<IDX_QTERMS_REVLEX(0,V2);i++) memcpy( quad + i*m_byte + _O1_BYTE , k->l2_vv + (V2+i)*_O2_BYTE , _O2_BYTE );
+	memcpy( con + _O1_BYTE , k->l2_vv + (TERMS_QUAD_POLY(V2)-1)*_O2_BYTE , _O2_BYTE );
+
+	/// output r : sum_i x_i ( o[r][i] + sum_j v_j vo[r][j][i] ) , see gen_l1_mat()
+	for(unsigned r=0;r<_O1;r++) {
+		for(unsigned i=0;i<_O1;i++) {
+			gf16v_set_ele( poly + (_V1+i)*m_byte , r , gf16v_get_ele( k->l1_o + r*_O1_BYTE , i ) );
+			for(unsigned j=0;j<_V1;j++)
+				gf16v_set_ele( quad + IDX_QTERMS_REVLEX(j,_V1+i)*m_byte , r , gf16v_get_ele( k->l1_vo[r] + j*_O1_BYTE , i ) );
+		}
+	}
+	for(unsigned r=0;r<_O2;r++) {
+		for(unsigned i=0;i<_O2;i++) {
+			gf16v_set_ele( poly + (V2+i)*m_byte , _O1+r , gf16v_get_ele( k->l2_o + r*_O2_BYTE , i ) );
+			for(unsigned j=0;j<V2;j++)
+				gf16v_set_ele( quad + IDX_QTERMS_REVLEX(j,V2+i)*m_byte , _O1+r , gf16v_get_ele( k->l2_vo[r] + j*_O2_BYTE , i ) );
+		}
+	}
+}
+
+
+/// the public key S( F( T(w) ) ) composed from the matrices of the key, instead of
+/// interpolating it from O(n^2) evaluations of rainbow_pubmap_seckey().
+void rainbow_pubkey( uint8_t * pk , const rainbow_key * pk_key )
+{
+	uint8_t * f = (uint8_t *)malloc( TERMS_QUAD_POLY(_PUB_N)*_PUB_M_BYTE );
+	rainbow_central_poly( f , &pk_key->ckey );
+	mpkc_compose_affine_gf16( pk , f , pk_key->mat_t , pk_key->vec_t );
+	free( f );
+
+	uint8_t tmp[_PUB_M_BYTE];
+	for(unsigned i=0;i<TERMS_QUAD_POLY(_PUB_N);i++) {
+		gf16mat_prod( tmp , pk_key->mat_s , _PUB_M_BYTE , _PUB_M , pk + i*_PUB_M_BYTE );
+		memcpy( pk + i*_PUB_M_BYTE , tmp , _PUB_M_BYTE );
+	}
+	gf256v_add( pk + (TERMS_QUAD_POLY(_PUB_N)-1)*_PUB_M_BYTE , pk_key->vec_s , _PUB_M_BYTE );
+}
+
 
 void rainbow_genkey( uint8_t * pk , uint8_t * sk )
 {
@@ -89,7 +154,7 @@ void rainbow_genkey( uint8_t * pk , uint8_t * sk )
 	rainbow_genkey_debug( &_pk , &_sk );
 	memcpy( sk , (uint8_t*)(&_sk) , sizeof(rainbow_key) );
 
-	mpkc_interpolate_gf16( pk , rainbow_pubmap_wrapper , (const void*) &_pk );
+	rainbow_pubkey( pk , &_pk );
 
 	pk[_PUB_KEY_LEN-1] = _SALT_BYTE;
 	sk[_SEC_KEY_LEN-1] = _SALT_BYTE;
@@ -262,53 +327,70 @@ return 1;
 #include "hash_utils.h"
 
 
-/// algorithm 7
-int rainbow_sign( uint8_t * signature , const uint8_t * _sk , const uint8_t * _digest )
+/// line 8 - 10: y = S( H( digest || salt ) )
+static inline
+void rainbow_salted_y( uint8_t * y , const rainbow_key * sk , const uint8_t * digest_salt )
+{
+	uint8_t _z[_PUB_M_BYTE] ;
+	sha2_chain_msg( _z , _PUB_M_BYTE , digest_salt , _HASH_LEN+_SALT_BYTE ); /// line 9
+
+	gf256v_add(_z,sk->vec_s,_PUB_M_BYTE);
+	gf16mat_prod(y,sk->mat_s,_PUB_M_BYTE,_PUB_M,_z); /// line 10
+}
+
+/// algorithm 7, with the first vinegar and salt given in rand ( _V1_BYTE + _SALT_BYTE bytes )
+/// and fresh ones drawn for the retries. the first salt is known before the vinegar, so the
+/// layer 1 system is solved once for both its check and its oil variables.
+static int rainbow_sign_rand( uint8_t * signature , const rainbow_key * sk , const uint8_t * _digest , const uint8_t * rand )
 {
-	const rainbow_key * sk = (const rainbow_key *)_sk;
 	const rainbow_ckey * k = &( sk->ckey);
+	uint8_t y[_PUB_M_BYTE] ;
+	uint8_t x[_PUB_N_BYTE] ;
+	uint8_t w[_PUB_N_BYTE] ;
+	uint8_t digest_salt[_HASH_LEN + _SALT_BYTE] = {0};
+	uint8_t * salt = digest_salt + _HASH_LEN;
+	memcpy( digest_salt , _digest , _HASH_LEN );
+	memcpy( salt , rand + _V1_BYTE , _SALT_BYTE );
+	rainbow_salted_y( y , sk , digest_salt );
+
 //// line 1 - 5
 	uint8_t mat_l1[_O1*_O1_BYTE] ;
 	uint8_t mat_l2[_O2*_O2_BYTE] ;
-	uint8_t temp_o1[_O1_BYTE]  = {0};
+	uint8_t temp_o1[_O1_BYTE] ;
 	uint8_t temp_o2[_O2_BYTE] ;
+	uint8_t temp_vv1[_O1_BYTE] ;
 	uint8_t vinegar[_V1_BYTE] ;
 	unsigned l1_succ = 0;
 	unsigned time = 0;
 	while( !l1_succ ) {
 		if( 512 == time ) break;
-		gf256v_rand( vinegar , _V1_BYTE );
+		if( 0 == time ) memcpy( vinegar , rand , _V1_BYTE );
+		else gf256v_rand( vinegar , _V1_BYTE );
 		gen_l1_mat( mat_l1 , k , vinegar );
+		mpkc_pub_map_gf16_n_m( temp_vv1 , k->l1_vv , vinegar , _V1 , _O1 );
 
-		l1_succ = linear_solver_l1( temp_o1 , mat_l1 , temp_o1 );
+		memcpy( temp_o1 , temp_vv1 , _O1_BYTE );
+		gf256v_add( temp_o1 , y , _O1_BYTE );
+		l1_succ = linear_solver_l1( x + _V1_BYTE , mat_l1 , temp_o1 );
 		time ++;
 	}
-	uint8_t temp_vv1[_O1_BYTE] ;
-	mpkc_pub_map_gf16_n_m( temp_vv1 , k->l1_vv , vinegar , _V1 , _O1 );
 
 	//// line 7 - 14
-	uint8_t _z[_PUB_M_BYTE] ;
-	uint8_t y[_PUB_M_BYTE] ;
-	uint8_t x[_PUB_N_BYTE] ;
-	uint8_t w[_PUB_N_BYTE] ;
-	uint8_t digest_salt[_HASH_LEN + _SALT_BYTE] = {0};
-	uint8_t * salt = digest_salt + _HASH_LEN;
-	memcpy( digest_salt , _digest , _HASH_LEN );
-
 	memcpy( x , vinegar , _V1_BYTE );
 	unsigned succ = 0;
+	unsigned first = 1;
 	while( !succ ) {
 		if( 512 == time ) break;
 
-		gf256v_rand( salt , _SALT_BYTE );  /// line 8
-		sha2_chain_msg( _z , _PUB_M_BYTE , digest_salt , _HASH_LEN+_SALT_BYTE ); /// line 9
-
-		gf256v_add(_z,sk->vec_s,_PUB_M_BYTE);
-		gf16mat_prod(y,sk->mat_s,_PUB_M_BYTE,_PUB_M,_z); /// line 10
+		if( !first ) {
+			gf256v_rand( salt , _SALT_BYTE );  /// line 8
+			rainbow_salted_y( y , sk , digest_salt );
 
-		memcpy( temp_o1 , temp_vv1 , _O1_BYTE );
-		gf256v_add( temp_o1 , y , _O1_BYTE );
-		linear_solver_l1( x + _V1_BYTE , mat_l1 , temp_o1 );
+			memcpy( temp_o1 , temp_vv1 , _O1_BYTE );
+			gf256v_add( temp_o1 , y , _O1_BYTE );
+			linear_solver_l1( x + _V1_BYTE , mat_l1 , temp_o1 );
+		}
+		first = 0;
 
 		gen_l2_mat( mat_l2 , k , x );
 		mpkc_pub_map_gf16_n_m( temp_o2 , k->l2_vv , x , V2 , _O2 );
@@ -328,12 +410,30 @@ int rainbow_sign( uint8_t * signature , const uint8_t * _sk , const uint8_t * _d
 	return 0;
 }
 
-/// algorithm 8
-int rainbow_verify( const uint8_t * digest , const uint8_t * signature , const uint8_t * pk )
+/// algorithm 7
+int rainbow_sign( uint8_t * signature , const uint8_t * _sk , const uint8_t * _digest )
 {
-	unsigned char digest_ck[_PUB_M_BYTE];
-	rainbow_pubmap( digest_ck , pk , signature );
+	uint8_t rand[_V1_BYTE + _SALT_BYTE];
+	gf256v_rand( rand , sizeof(rand) );
+	return rainbow_sign_rand( signature , (const rainbow_key *)_sk , _digest , rand );
+}
 
+int rainbow_sign_batch( uint8_t * signatures , const uint8_t * _sk , const uint8_t * const * digests , unsigned n )
+{
+	uint8_t rand[RAINBOW_SIGN_BATCH_MAX * (_V1_BYTE + _SALT_BYTE)];
+	int r = 0;
+	for(unsigned i=0;i<n;i+=RAINBOW_SIGN_BATCH_MAX) {
+		unsigned n_batch = (n-i < RAINBOW_SIGN_BATCH_MAX)? n-i : RAINBOW_SIGN_BATCH_MAX;
+		gf256v_rand( rand , n_batch * (_V1_BYTE + _SALT_BYTE) );
+		for(unsigned k=0;k<n_batch;k++) {
+			if( 0 != rainbow_sign_rand( signatures + (i+k)*_SIGNATURE_BYTE , (const rainbow_key *)_sk , digests[i+k] , rand + k*(_V1_BYTE + _SALT_BYTE) ) ) r = -1;
+		}
+	}
+	return r;
+}
+
+static int rainbow_verify_digest( const uint8_t * digest , const uint8_t * signature , const uint8_t * digest_ck )
+{
 	unsigned char correct[_PUB_M_BYTE];
 	unsigned char digest_salt[_HASH_LEN + _SALT_BYTE];
 	memcpy( digest_salt , digest , _HASH_LEN );
@@ -347,5 +447,28 @@ int rainbow_verify( const uint8_t * digest , const uint8_t * signature , const u
 	return (0==cc)? 0: -1;
 }
 
+/// algorithm 8
+int rainbow_verify( const uint8_t * digest , const uint8_t * signature , const uint8_t * pk )
+{
+	unsigned char digest_ck[_PUB_M_BYTE];
+	rainbow_pubmap( digest_ck , pk , signature );
+
+	return rainbow_verify_digest( digest , signature , digest_ck );
+}
+
+int rainbow_verify_batch( const uint8_t * pk , const uint8_t * const * digests , const uint8_t * const * signatures , unsigned n )
+{
+	unsigned char digest_ck[MPKC_BATCH_MAX*_PUB_M_BYTE];
+	int r = 0;
+	for(unsigned i=0;i<n;i+=MPKC_BATCH_MAX) {
+		unsigned n_batch = (n-i < MPKC_BATCH_MAX)? n-i : MPKC_BATCH_MAX;
+		mpkc_pub_map_gf16_batch( digest_ck , pk , signatures+i , n_batch );
+		for(unsigned k=0;k<n_batch;k++) {
+			if( 0 != rainbow_verify_digest( digests[i+k] , signatures[i+k] , digest_ck+k*_PUB_M_BYTE ) ) r = -1;
+		}
+	}
+	return r;
+}
+
 
 #endif  /// _RAINBOW_16
@@ -46,6 +46,9 @@ typedef struct _rainbow_key rainbow_key;
 /// algorithm 6
 void rainbow_genkey( uint8_t * pk , uint8_t * sk );
 
+/// the public key of rainbow_genkey_debug(), composed from its matrices. pk is _PUB_KEY_LEN-1 bytes.
+void rainbow_pubkey( uint8_t * pk , const rainbow_key * pk_key );
+
 
 #include "mpkc.h"
 
@@ -69,6 +72,9 @@ void rainbow_pubmap_seckey( uint8_t * z , const rainbow_key * sk , const uint8_t
 
 void rainbow_genkey_debug( rainbow_key * pk , rainbow_key * sk );
 
+/// rainbow_pubkey() by interpolation of rainbow_pubmap_seckey(), the reference for the tests
+void rainbow_pubkey_interpolate( uint8_t * pk , const rainbow_key * pk_key );
+
 #endif
 
 
@@ -76,9 +82,21 @@ void rainbow_genkey_debug( rainbow_key * pk , rainbow_key * sk );
 /// algorithm 7
 int rainbow_sign( uint8_t * signature , const uint8_t * sk , const uint8_t * digest );
 
+/// signatures drawing their random vinegars and salts together
+#define RAINBOW_SIGN_BATCH_MAX 64
+
+/// algorithm 7 for n digests, signatures[i*_SIGNATURE_BYTE] is the signature of digests[i].
+/// the randomness of every RAINBOW_SIGN_BATCH_MAX of them is drawn at once. returns 0 if
+/// all of them are signed.
+int rainbow_sign_batch( uint8_t * signatures , const uint8_t * sk , const uint8_t * const * digests , unsigned n );
+
 /// algorithm 8
 int rainbow_verify( const uint8_t * digest , const uint8_t * signature , const uint8_t * pk );
 
+/// algorithm 8 for n signatures of the same public key, with one pass over pk
+/// for every MPKC_BATCH_MAX of them. returns 0 if all of them are valid.
+int rainbow_verify_batch( const uint8_t * pk , const uint8_t * const * digests , const uint8_t * const * signatures , unsigned n );
+
 
 #ifdef  __cplusplus
 }
@@ -15,15 +15,16 @@
 #define Gamma0(x)       (S(x, 7) ^ S(x, 18) ^ R(x, 3))
 #define Gamma1(x)       (S(x, 17) ^ S(x, 19) ^ R(x, 10))
 
-/* compress 512-bits */
+/* compress 512-bits blocks, the portable kernel of sha256Transform() */
 
-static int  sha256Compress(Sha256 * md, unsigned char *buf) {
+void sha256TransformGeneric(ulong32 *state, const unsigned char *buf, unsigned long blocks) {
+  for (; blocks > 0; blocks--, buf += 64) {
     ulong32 S[8], W[64], t0, t1;
     int i;
 
     /* copy state into S */
     for (i = 0; i < 8; i++) {
-        S[i] = md->state[i];
+        S[i] = state[i];
     }
 
     /* copy the state into 512-bits into W[0..15] */
@@ -112,11 +113,80 @@ static int  sha256Compress(Sha256 * md, unsigned char *buf) {
 
     /* feedback */
     for (i = 0; i < 8; i++) {
-        md->state[i] = md->state[i] + S[i];
+        state[i] = state[i] + S[i];
     }
+  }
+}
+
+static int  sha256Compress(Sha256 * md, unsigned char *buf) {
+    sha256Transform(md->state, buf, 1);
     return PQCRYPT_OK;
 }
 
+static const ulong32 sha256IV[8] = {
+    0x6A09E667UL, 0xBB67AE85UL, 0x3C6EF372UL, 0xA54FF53AUL,
+    0x510E527FUL, 0x9B05688CUL, 0x1F83D9ABUL, 0x5BE0CD19UL
+};
+
+/* the padding block of a 64 byte message */
+static const unsigned char sha256Pad64[64] = {
+    0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x02, 0x00
+};
+
+/* a 32 byte message is a single block */
+static void sha256Hash32(const unsigned char *in, unsigned char *out) {
+    ulong32 state[8];
+    unsigned char buf[64];
+    int i;
+
+    XMEMCPY(buf, in, 32);
+    XMEMCPY(buf + 32, sha256Pad64, 32);
+    buf[62] = 0x01;
+    for (i = 0; i < 8; i++) {
+        state[i] = sha256IV[i];
+    }
+    sha256Transform(state, buf, 1);
+    for (i = 0; i < 8; i++) {
+        STORE32H(state[i], out+(4*i));
+    }
+}
+
+void sha256D64Serial(unsigned char *out, const unsigned char *in, unsigned long blocks) {
+    ulong32 state[8];
+    int i;
+
+    for (; blocks > 0; blocks--, in += 64, out += 32) {
+        for (i = 0; i < 8; i++) {
+            state[i] = sha256IV[i];
+        }
+        sha256Transform(state, in, 1);
+        sha256Transform(state, sha256Pad64, 1);
+        for (i = 0; i < 8; i++) {
+            STORE32H(state[i], out+(4*i));
+        }
+        sha256Hash32(out, out);
+    }
+}
+
+#ifndef _SHA256_SIMD_
+unsigned sha256SimdSupported(void) { return 0; }
+
+unsigned sha256SimdFlags(void) { return 0; }
+
+unsigned sha256SimdSetFlags(unsigned flags) { return 0; }
+
+void sha256Transform(ulong32 *state, const unsigned char *in, unsigned long blocks) {
+    sha256TransformGeneric(state, in, blocks);
+}
+
+void sha256D64(unsigned char *out, const unsigned char *in, unsigned long blocks) {
+    sha256D64Serial(out, in, blocks);
+}
+#endif
+
 /**
    Initialize the hash state
    @param md   The hash state you wish to initialize
@@ -158,13 +228,13 @@ int sha256Process(Sha256 * md, const unsigned char *in, unsigned long inlen) {
 	  return PQCRYPT_HASH_OVERFLOW; 														  
 	}																					
 	while (inlen > 0) { 																	
-		if (md->curlen == 0 && inlen >= 64) {							
-		   if ((err = sha256Compress(md, const_cast<unsigned char *>(in))) != PQCRYPT_OK) { 			
-			  return err;																	
-		   }																				
-		   md->length	  += 64 * 8;										
-		   in			  += 64;													
-		   inlen		  -= 64;													
+		if (md->curlen == 0 && inlen >= 64) {
+		   /* all the full blocks in one call, the SHA-NI kernel keeps its state in registers */
+		   n = inlen / 64;
+		   sha256Transform(md->state, in, n);
+		   md->length	  += 64 * 8 * n;
+		   in			  += 64 * n;
+		   inlen		  -= 64 * n;
 		} else {																			
 		   n = MIN(inlen, (64 - md->curlen));							
 		   XMEMCPY(md->buf + md->curlen, in, (size_t)n);			 
@@ -239,6 +309,11 @@ int sha256Done(Sha256 * md, unsigned char *out) {
 int pqcSha256(const unsigned char * in, unsigned long inlen, unsigned char * out) {
 	  Sha256 md;
 	  int status;
+	  /* the second hash of Hash() and the coefficient chains of the miner */
+	  if (inlen == 32) {
+	      sha256Hash32(in, out);
+	      return PQCRYPT_OK;
+	  }
       status = sha256Init(&md);
       status = sha256Process(&md, in, inlen);
       status = sha256Done(&md, out);
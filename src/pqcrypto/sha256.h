@@ -14,4 +14,31 @@ int sha256Done(Sha256 * md, unsigned char *hash);
 int pqcSha256(const unsigned char *in, unsigned long inlen, unsigned char *out);
 
 
+/* SHA-NI and multi-buffer SSE4.1/AVX2 kernels of sha256_simd.cpp, chosen at runtime
+   from cpuid. Without them everything goes through sha256TransformGeneric(). */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define _SHA256_SIMD_
+#endif
+
+#define SHA256_SIMD_SSE41  1   /* 4 messages at a time */
+#define SHA256_SIMD_AVX2   2   /* 8 messages at a time */
+#define SHA256_SIMD_SHANI  4   /* SHA extensions, one message */
+
+/* kernels supported by the cpu */
+unsigned sha256SimdSupported(void);
+/* kernels in use */
+unsigned sha256SimdFlags(void);
+/* restrict the kernels in use ( for tests and benchmarks ), returns the ones in use */
+unsigned sha256SimdSetFlags(unsigned flags);
+
+/* compress blocks 64 byte blocks into state */
+void sha256Transform(ulong32 *state, const unsigned char *in, unsigned long blocks);
+void sha256TransformGeneric(ulong32 *state, const unsigned char *in, unsigned long blocks);
+
+/* out + 32*i = SHA256(SHA256(in + 64*i)) for i < blocks, the nodes of a merkle tree */
+void sha256D64(unsigned char *out, const unsigned char *in, unsigned long blocks);
+/* sha256D64() one message at a time */
+void sha256D64Serial(unsigned char *out, const unsigned char *in, unsigned long blocks);
+
+
 #endif
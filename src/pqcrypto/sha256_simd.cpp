@@ -0,0 +1,211 @@
+#include "pqcrypto.h"
+
+#ifdef _SHA256_SIMD_
+
+#include <immintrin.h>
+#include <cpuid.h>
+
+
+static const ulong32 sha256K[64] __attribute__((aligned(16))) = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const ulong32 sha256IV[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+
+static unsigned sha256SimdDetect(void)
+{
+    unsigned eax, ebx, ecx, edx, flags = 0;
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.1")) flags |= SHA256_SIMD_SSE41;
+    if (__builtin_cpu_supports("avx2")) flags |= SHA256_SIMD_AVX2;
+    /* cpuid leaf 7, ebx bit 29 */
+    if ((flags & SHA256_SIMD_SSE41) && __get_cpuid_max(0, NULL) >= 7) {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        if (ebx & (1u << 29)) flags |= SHA256_SIMD_SHANI;
+    }
+    return flags;
+}
+
+/* zero ( the portable kernel ) until the static initialization ran */
+static unsigned _sha256SimdSupported = sha256SimdDetect();
+static unsigned _sha256SimdFlags = _sha256SimdSupported;
+
+unsigned sha256SimdSupported(void) { return _sha256SimdSupported; }
+
+unsigned sha256SimdFlags(void) { return _sha256SimdFlags; }
+
+unsigned sha256SimdSetFlags(unsigned flags)
+{
+    _sha256SimdFlags = flags & _sha256SimdSupported;
+    return _sha256SimdFlags;
+}
+
+
+
+/*
+ * SHA-NI, one message. The state is kept as ABEF/CDGH, each group of four
+ * rounds takes the next four schedule words and extends the schedule with
+ * sha256msg1/sha256msg2 four groups ahead.
+ */
+__attribute__((target("sha,sse4.1")))
+static void sha256TransformShani(ulong32 *state, const unsigned char *in, unsigned long blocks)
+{
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i tmp = _mm_loadu_si128((const __m128i *)&state[0]);
+    __m128i state1 = _mm_loadu_si128((const __m128i *)&state[4]);
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);                 /* CDAB */
+    state1 = _mm_shuffle_epi32(state1, 0x1B);           /* EFGH */
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);   /* ABEF */
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);        /* CDGH */
+
+    for (; blocks > 0; blocks--, in += 64) {
+        __m128i abef = state0, cdgh = state1, msg, m[4];
+
+#pragma GCC unroll 16
+        for (int g = 0; g < 16; g++) {
+            if (g < 4)
+                m[g] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + 16*g)), mask);
+            msg = _mm_add_epi32(m[g&3], _mm_load_si128((const __m128i *)&sha256K[4*g]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            if (g >= 3 && g <= 14) {
+                tmp = _mm_alignr_epi8(m[g&3], m[(g+3)&3], 4);
+                m[(g+1)&3] = _mm_sha256msg2_epu32(_mm_add_epi32(m[(g+1)&3], tmp), m[g&3]);
+            }
+            msg = _mm_shuffle_epi32(msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+            if (g >= 1 && g <= 12)
+                m[(g+3)&3] = _mm_sha256msg1_epu32(m[(g+3)&3], m[g&3]);
+        }
+
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);              /* FEBA */
+    state1 = _mm_shuffle_epi32(state1, 0xB1);           /* DCHG */
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);        /* DCBA */
+    state1 = _mm_alignr_epi8(state1, tmp, 8);           /* HGFE */
+    _mm_storeu_si128((__m128i *)&state[0], state0);
+    _mm_storeu_si128((__m128i *)&state[4], state1);
+}
+
+
+
+/*
+ * Multi-buffer: lane k of every vector belongs to message k. Written once
+ * with the vector extensions of gcc and inlined into the SSE4.1 ( 4 lanes )
+ * and AVX2 ( 8 lanes ) kernels.
+ */
+typedef uint32_t sha256X4 __attribute__((vector_size(16)));
+typedef uint32_t sha256X8 __attribute__((vector_size(32)));
+
+#define SHA256_ROTR(x, n)  (((x) >> (n)) | ((x) << (32 - (n))))
+#define SHA256_SIGMA0(x)   (SHA256_ROTR(x, 2) ^ SHA256_ROTR(x, 13) ^ SHA256_ROTR(x, 22))
+#define SHA256_SIGMA1(x)   (SHA256_ROTR(x, 6) ^ SHA256_ROTR(x, 11) ^ SHA256_ROTR(x, 25))
+#define SHA256_GAMMA0(x)   (SHA256_ROTR(x, 7) ^ SHA256_ROTR(x, 18) ^ ((x) >> 3))
+#define SHA256_GAMMA1(x)   (SHA256_ROTR(x, 17) ^ SHA256_ROTR(x, 19) ^ ((x) >> 10))
+
+/* s += the compression of the block w, w is overwritten by the schedule */
+template<typename V>
+static inline __attribute__((always_inline))
+void sha256CompressX(V *s, V *w)
+{
+    V a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+    for (int i = 0; i < 64; i++) {
+        if (i >= 16)
+            w[i&15] += SHA256_GAMMA1(w[(i-2)&15]) + w[(i-7)&15] + SHA256_GAMMA0(w[(i-15)&15]);
+        V t0 = h + SHA256_SIGMA1(e) + (g ^ (e & (f ^ g))) + sha256K[i] + w[i&15];
+        V t1 = SHA256_SIGMA0(a) + (((a | b) & c) | (a & b));
+        h = g; g = f; f = e; e = d + t0;
+        d = c; c = b; b = a; a = t0 + t1;
+    }
+    s[0] += a; s[1] += b; s[2] += c; s[3] += d;
+    s[4] += e; s[5] += f; s[6] += g; s[7] += h;
+}
+
+/* sha256D64() of the N messages of in */
+template<typename V, int N>
+static inline __attribute__((always_inline))
+void sha256D64X(unsigned char *out, const unsigned char *in)
+{
+    V s[8], w[16];
+    for (int i = 0; i < 8; i++)
+        s[i] = (V){} + sha256IV[i];
+    for (int i = 0; i < 16; i++)
+        for (int k = 0; k < N; k++) {
+            ulong32 x;
+            LOAD32H(x, in + 64*k + 4*i);
+            w[i][k] = x;
+        }
+    sha256CompressX(s, w);
+
+    /* the padding block of a 64 byte message */
+    w[0] = (V){} + 0x80000000;
+    for (int i = 1; i < 15; i++)
+        w[i] = (V){};
+    w[15] = (V){} + 512;
+    sha256CompressX(s, w);
+
+    /* the second hash, of the 32 byte digest */
+    for (int i = 0; i < 8; i++) {
+        w[i] = s[i];
+        s[i] = (V){} + sha256IV[i];
+    }
+    w[8] = (V){} + 0x80000000;
+    for (int i = 9; i < 15; i++)
+        w[i] = (V){};
+    w[15] = (V){} + 256;
+    sha256CompressX(s, w);
+
+    for (int i = 0; i < 8; i++)
+        for (int k = 0; k < N; k++)
+            STORE32H((ulong32)s[i][k], out + 32*k + 4*i);
+}
+
+__attribute__((target("sse4.1")))
+static void sha256D64Sse41(unsigned char *out, const unsigned char *in)
+{
+    sha256D64X<sha256X4, 4>(out, in);
+}
+
+__attribute__((target("avx2")))
+static void sha256D64Avx2(unsigned char *out, const unsigned char *in)
+{
+    sha256D64X<sha256X8, 8>(out, in);
+}
+
+
+
+void sha256Transform(ulong32 *state, const unsigned char *in, unsigned long blocks)
+{
+    if (_sha256SimdFlags & SHA256_SIMD_SHANI)
+        sha256TransformShani(state, in, blocks);
+    else
+        sha256TransformGeneric(state, in, blocks);
+}
+
+void sha256D64(unsigned char *out, const unsigned char *in, unsigned long blocks)
+{
+    /* one message at a time with SHA-NI still beats eight AVX2 lanes */
+    if (!(_sha256SimdFlags & SHA256_SIMD_SHANI) && (_sha256SimdFlags & SHA256_SIMD_AVX2)) {
+        for (; blocks >= 8; blocks -= 8, in += 64*8, out += 32*8)
+            sha256D64Avx2(out, in);
+    }
+    if (!(_sha256SimdFlags & SHA256_SIMD_SHANI) && (_sha256SimdFlags & SHA256_SIMD_SSE41)) {
+        for (; blocks >= 4; blocks -= 4, in += 64*4, out += 32*4)
+            sha256D64Sse41(out, in);
+    }
+    sha256D64Serial(out, in, blocks);
+}
+
+#endif
@@ -56,9 +56,48 @@ Value gethashespersec(const Array& params, bool fHelp)
             "gethashespersec\n"
             "Returns a recent hashes per second performance measurement while generating.");
 
-    if (GetTimeMillis() - nHPSTimerStart > 8000)
-        return (boost::int64_t)0;
-    return (boost::int64_t)dHashesPerSec;
+    return (boost::int64_t)GetHashesPerSec();
+}
+
+static Object MinerStatsToJSON(const CMinerStats& stats)
+{
+    Object obj;
+    obj.push_back(Pair("threads",       stats.nThreads));
+    obj.push_back(Pair("candidates",    stats.nCandidates));
+    obj.push_back(Pair("subproblems",   stats.nSubProblems));
+    obj.push_back(Pair("tested",        stats.nTested));
+    obj.push_back(Pair("restarts",      stats.nRestarts));
+    obj.push_back(Pair("cyclespercandidate", stats.nCandidates ? (double)stats.nCycles / stats.nCandidates : 0.0));
+
+    Object templateswitch;
+    templateswitch.push_back(Pair("count",     stats.nSwitches));
+    templateswitch.push_back(Pair("lastms",    stats.nSwitchMicrosLast / 1000.0));
+    templateswitch.push_back(Pair("averagems", stats.nSwitches ? stats.nSwitchMicrosTotal / 1000.0 / stats.nSwitches : 0.0));
+    templateswitch.push_back(Pair("maxms",     stats.nSwitchMicrosMax / 1000.0));
+    obj.push_back(Pair("templateswitch", templateswitch));
+    return obj;
+}
+
+Value getminingstats(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getminingstats\n"
+            "Returns the counters of the built-in miner since the node started:\n"
+            "  \"threads\" : number of miner threads running\n"
+            "  \"candidates\" : candidate solutions enumerated\n"
+            "  \"subproblems\" : exfes sub-problems searched to the end\n"
+            "  \"tested\" : candidates checked against the equations not enumerated\n"
+            "  \"restarts\" : searches abandoned for a new best block, per thread\n"
+            "  \"cyclespercandidate\" : CPU cycles spent per candidate\n"
+            "  \"templateswitch\" : time from a new best block until all the miner threads work on its template\n"
+            "  \"hashespersec\" : candidates per second over the last seconds");
+
+    CMinerStats stats;
+    GetMinerStats(stats);
+    Object obj = MinerStatsToJSON(stats);
+    obj.push_back(Pair("hashespersec",  gethashespersec(params, false)));
+    return obj;
 }
 
 
@@ -80,6 +119,18 @@ Value getmininginfo(const Array& params, bool fHelp)
     obj.push_back(Pair("hashespersec",  gethashespersec(params, false)));
     obj.push_back(Pair("pooledtx",      (uint64_t)mempool.size()));
     obj.push_back(Pair("testnet",       fTestNet));
+
+    CMinerStats stats;
+    GetMinerStats(stats);
+    obj.push_back(Pair("minerstats",    MinerStatsToJSON(stats)));
+
+    uint64_t nSize, nHits, nMisses;
+    GetPoWCacheStats(nSize, nHits, nMisses);
+    Object powcache;
+    powcache.push_back(Pair("size",     nSize));
+    powcache.push_back(Pair("hits",     nHits));
+    powcache.push_back(Pair("misses",   nMisses));
+    obj.push_back(Pair("powcache",      powcache));
     return obj;
 }
 
@@ -198,6 +249,229 @@ Value getwork(const Array& params, bool fHelp)
 }
 
 
+// Wait until the best block is no longer hashWatched or the node shuts down.
+// With fTransactions, also return once the memory pool changed since
+// nTransactionsUpdatedWatched, which is checked after a minute and then every
+// 10 seconds.
+static void WaitForNewWork(const uint256& hashWatched, bool fTransactions, unsigned int nTransactionsUpdatedWatched)
+{
+    boost::system_time checktxtime = boost::get_system_time() + boost::posix_time::minutes(1);
+    boost::unique_lock<boost::mutex> lock(csBestBlock);
+    while (hashBestChain == hashWatched && !ShutdownRequested())
+    {
+        if (!fTransactions)
+            cvBlockChange.wait(lock);
+        else if (!cvBlockChange.timed_wait(lock, checktxtime))
+        {
+            // Timeout: Check transactions for update
+            if (nTransactionsUpdated != nTransactionsUpdatedWatched)
+                break;
+            checktxtime += boost::posix_time::seconds(10);
+        }
+    }
+}
+
+/** A job of the MQ work protocol. All the external solvers share the equation
+ *  system of its block, each getmqjob call hands out the next range of its
+ *  exfes sub-problems.
+ */
+struct CMQJob
+{
+    int nId;
+    CBlock block;
+    CBlockIndex* pindexPrev;
+    uint256 seedHash;
+    bool fNewCoeffMatrix;       // so that checking a solution needs no index lookup
+    uint256 startPoint;
+    int nSearchVariables;
+    uint64_t nNextSubProblem;
+};
+
+// Sub-problems of a job, so that a farm of solver processes can share it
+static const uint64_t nMQJobSubProblems = 1024;
+static const unsigned int nMaxMQJobs = 1000;
+
+static CCriticalSection cs_mqJobs;
+static std::map<int, boost::shared_ptr<CMQJob> > mapMQJobs; // the jobs on the current best block
+static boost::shared_ptr<CMQJob> pmqJob;                    // the job getmqjob is handing out
+
+static boost::shared_ptr<CMQJob> NewMQJob(CBlockTemplate* pblocktemplate, CBlockIndex* pindexPrev)
+{
+    static int nJobId = 0;
+    static unsigned int nExtraNonce = 0;
+
+    boost::shared_ptr<CMQJob> pjob(new CMQJob());
+    pjob->nId = ++nJobId;
+    pjob->block = pblocktemplate->block;
+    pjob->pindexPrev = pindexPrev;
+    IncrementExtraNonce(&pjob->block, pindexPrev, nExtraNonce);
+
+    uint256 tempHash = pjob->block.hashPrevBlock ^ pjob->block.hashMerkleRoot;
+    pjob->seedHash = Hash(BEGIN(tempHash), END(tempHash));
+    pjob->fNewCoeffMatrix = UseNewCoeffMatrix(pindexPrev->nHeight+1);
+    pjob->startPoint = GetRandHash();
+    pjob->nSearchVariables = MQSearchVariables(pjob->block.nBits + 8, nMQJobSubProblems);
+    pjob->nNextSubProblem = 0;
+
+    mapMQJobs[pjob->nId] = pjob;
+    if (mapMQJobs.size() > nMaxMQJobs)
+        mapMQJobs.erase(mapMQJobs.begin());
+    return pjob;
+}
+
+Value getmqjob(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getmqjob [params]\n"
+            "Returns a job for an external MQ solver:\n"
+            "  \"jobid\" : id to submit solutions of this job with submitmqsolution\n"
+            "  \"previousblockhash\" : hash of the current highest block\n"
+            "  \"height\" : height of the next block\n"
+            "  \"seedhash\" : hash the equation system is generated from\n"
+            "  \"nbits\" : number of equations, the system has nbits + 8 unknowns\n"
+            "  \"newcoeffmatrix\" : whether the coefficients come from NewGenCoeffMatrix\n"
+            "  \"unknowns\" : number of unknowns\n"
+            "  \"startpoint\" : mask of the sub-problems\n"
+            "  \"searchvariables\" : sub-problem s covers the nonces whose first searchvariables bits, xor startpoint, are s\n"
+            "  \"subproblems\" : [begin, end) suggested range of sub-problems for this solver\n"
+            "  \"longpollid\" : pass it back in params to wait for a new best block\n"
+            "[params] is an object with the optional keys \"longpollid\" and \"subproblems\", the size of the range to get.");
+
+    std::string strLongPollId;
+    uint64_t nSubProblems = 0;
+    if (params.size() > 0)
+    {
+        const Object& oparam = params[0].get_obj();
+        const Value& lpval = find_value(oparam, "longpollid");
+        if (lpval.type() == str_type)
+            strLongPollId = lpval.get_str();
+        const Value& subval = find_value(oparam, "subproblems");
+        if (subval.type() == int_type && subval.get_int64() > 0)
+            nSubProblems = subval.get_int64();
+    }
+
+    if (vNodes.empty())
+        throw JSONRPCError(RPC_CLIENT_NOT_CONNECTED, "Abcmint is not connected!");
+
+    if (IsInitialBlockDownload())
+        throw JSONRPCError(RPC_CLIENT_IN_INITIAL_DOWNLOAD, "Abcmint is downloading blocks...");
+
+    if (!strLongPollId.empty())
+    {
+        WaitForNewWork(uint256(strLongPollId), false, 0);
+        if (ShutdownRequested())
+            throw JSONRPCError(RPC_CLIENT_NOT_CONNECTED, "Shutting down");
+    }
+
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+    LOCK(cs_mqJobs);
+
+    // Update block
+    static unsigned int nTransactionsUpdatedLast;
+    static CBlockIndex* pindexPrev;
+    static int64 nStart;
+    static std::unique_ptr<CBlockTemplate> pblocktemplate;
+    if (pindexPrev != pindexBest ||
+        (nTransactionsUpdated != nTransactionsUpdatedLast && GetTime() - nStart > 60))
+    {
+        // the solutions of the jobs on an older block are stale
+        if (pindexPrev != pindexBest)
+            mapMQJobs.clear();
+        pmqJob.reset();
+
+        // Clear pindexPrev so future calls make a new block, despite any failures from here on
+        pindexPrev = NULL;
+
+        nTransactionsUpdatedLast = nTransactionsUpdated;
+        CBlockIndex* pindexPrevNew = pindexBest;
+        nStart = GetTime();
+
+        if(!pMiningKey)
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "not in server mode");
+
+        pblocktemplate.reset(CreateNewBlock(*pMiningKey));
+        if (!pblocktemplate.get())
+            throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
+
+        // Need to update only after we know CreateNewBlock succeeded
+        pindexPrev = pindexPrevNew;
+    }
+
+    // a new equation system once every sub-problem of the current one was handed out
+    uint64_t nJobSubProblems = pmqJob ? (uint64_t)1 << pmqJob->nSearchVariables : 0;
+    if (!pmqJob || pmqJob->nNextSubProblem >= nJobSubProblems)
+    {
+        pmqJob = NewMQJob(pblocktemplate.get(), pindexPrev);
+        nJobSubProblems = (uint64_t)1 << pmqJob->nSearchVariables;
+    }
+    if (nSubProblems == 0)
+        nSubProblems = std::max(nJobSubProblems / 16, (uint64_t)1);
+    uint64_t nBegin = pmqJob->nNextSubProblem;
+    uint64_t nEnd = std::min(nBegin + nSubProblems, nJobSubProblems);
+    pmqJob->nNextSubProblem = nEnd;
+
+    const CMQJob& job = *pmqJob;
+    Array subproblems;
+    subproblems.push_back((boost::int64_t)nBegin);
+    subproblems.push_back((boost::int64_t)nEnd);
+
+    Object result;
+    result.push_back(Pair("jobid", job.nId));
+    result.push_back(Pair("previousblockhash", job.block.hashPrevBlock.GetHex()));
+    result.push_back(Pair("height", (int64_t)(job.pindexPrev->nHeight+1)));
+    result.push_back(Pair("seedhash", job.seedHash.GetHex()));
+    result.push_back(Pair("nbits", (int)job.block.nBits));
+    result.push_back(Pair("newcoeffmatrix", job.fNewCoeffMatrix));
+    result.push_back(Pair("unknowns", (int)job.block.nBits + 8));
+    result.push_back(Pair("startpoint", job.startPoint.GetHex()));
+    result.push_back(Pair("searchvariables", job.nSearchVariables));
+    result.push_back(Pair("subproblems", subproblems));
+    result.push_back(Pair("longpollid", job.block.hashPrevBlock.GetHex()));
+    return result;
+}
+
+Value submitmqsolution(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 2)
+        throw runtime_error(
+            "submitmqsolution <jobid> <nonce>\n"
+            "Submits the solution <nonce> of the getmqjob job <jobid>.\n"
+            "Returns true if it was a solution and the block was accepted.");
+
+    int nJobId = params[0].get_int();
+    uint256 nNonce(params[1].get_str());
+
+    if(!pMiningKey)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "not in server mode");
+
+    CBlock block;
+    CBlockIndex* pindexPrev;
+    uint256 seedHash;
+    bool fNewCoeffMatrix;
+    {
+        LOCK(cs_mqJobs);
+        std::map<int, boost::shared_ptr<CMQJob> >::iterator mi = mapMQJobs.find(nJobId);
+        if (mi == mapMQJobs.end())
+            return false;
+        const CMQJob& job = *mi->second;
+        block = job.block;
+        pindexPrev = job.pindexPrev;
+        seedHash = job.seedHash;
+        fNewCoeffMatrix = job.fNewCoeffMatrix;
+    }
+
+    // the expensive check runs without any lock, solvers may submit concurrently
+    if (!CheckSolution(seedHash, block.nBits, fNewCoeffMatrix, nNonce))
+        return false;
+
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+    block.nNonce = nNonce;
+    block.UpdateTime(pindexPrev);
+    return CheckWork(&block, *pwalletMain, *pMiningKey);
+}
+
+
 Value getblocktemplate(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() > 1)
@@ -217,9 +491,11 @@ Value getblocktemplate(const Array& params, bool fHelp)
             "  \"sizelimit\" : limit of block size\n"
             "  \"bits\" : compressed target of next block\n"
             "  \"height\" : height of the next block\n"
+            "  \"longpollid\" : pass it back in [params] to wait for a new best block or new transactions\n"
             "See https://en.abcmint.it/wiki/BIP_0022 for full specification.");
 
     std::string strMode = "template";
+    Value lpval;
     if (params.size() > 0)
     {
         const Object& oparam = params[0].get_obj();
@@ -232,11 +508,26 @@ Value getblocktemplate(const Array& params, bool fHelp)
         }
         else
             throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid mode");
+        lpval = find_value(oparam, "longpollid");
     }
 
     if (strMode != "template")
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid mode");
 
+    if (lpval.type() == str_type)
+    {
+        // Format: <hashBestChain><nTransactionsUpdated>
+        std::string lpstr = lpval.get_str();
+        if (lpstr.size() < 64)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid longpollid");
+        WaitForNewWork(uint256(lpstr.substr(0, 64)), true, atoi64(lpstr.substr(64)));
+        if (ShutdownRequested())
+            throw JSONRPCError(RPC_CLIENT_NOT_CONNECTED, "Shutting down");
+    }
+
+    // the locks are only taken now, not to hold them while long-polling
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+
     if (vNodes.empty())
         throw JSONRPCError(RPC_CLIENT_NOT_CONNECTED, "Abcmint is not connected!");
 
@@ -338,6 +629,7 @@ Value getblocktemplate(const Array& params, bool fHelp)
     result.push_back(Pair("curtime", (int64_t)pblock->nTime));
     result.push_back(Pair("bits", (int)(pblock->nBits)));
     result.push_back(Pair("height", (int64_t)(pindexPrev->nHeight+1)));
+    result.push_back(Pair("longpollid", pindexPrev->GetBlockHash().GetHex() + i64tostr(nTransactionsUpdatedLast)));
 
     return result;
 }
@@ -86,6 +86,15 @@ Value getinfo(const Array& params, bool fHelp)
     if (pwalletMain->IsCrypted())
         obj.push_back(Pair("unlocked_until", (boost::int64_t)nWalletUnlockTime / 1000));
     obj.push_back(Pair("errors",        GetWarnings("statusbar")));
+
+    uint64_t nSize, nHits, nMisses, nEvictions;
+    GetSignatureCacheStats(nSize, nHits, nMisses, nEvictions);
+    Object sigcache;
+    sigcache.push_back(Pair("size",     nSize));
+    sigcache.push_back(Pair("hits",     nHits));
+    sigcache.push_back(Pair("misses",   nMisses));
+    sigcache.push_back(Pair("evictions", nEvictions));
+    obj.push_back(Pair("sigcache",      sigcache));
     return obj;
 }
 
@@ -2,6 +2,8 @@
 // Copyright (c) 2009-2012 The Bitcoin developers
 // Copyright (c) 2018 The Abcmint developers
 
+#include <atomic>
+#include <mutex>
 #include <boost/foreach.hpp>
 #include <boost/tuple/tuple.hpp>
 
@@ -18,8 +20,8 @@ using namespace boost;
 #include "init.h"
 
 
-bool CheckSig(vector<unsigned char> vchSig, vector<unsigned char> vchPubKey, CScript scriptCode,
-                  const CTransaction& txTo, unsigned int nIn, int nHashType, int flags);
+bool CheckSig(vector<unsigned char> vchSig, const vector<unsigned char>& vchPubKey, CScript scriptCode,
+                  const CTransaction& txTo, unsigned int nIn, int nHashType, int flags, CSignatureBatch *pbatch = NULL);
 
 
 
@@ -249,7 +251,7 @@ bool static CheckSignatureEncoding(const valtype &vchSig, unsigned int flags) {
 }
 
 bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, CTransaction& txTo,
-    unsigned int nIn, unsigned int flags, int nHashType, bool isSignCheck)
+    unsigned int nIn, unsigned int flags, int nHashType, bool isSignCheck, CSignatureBatch *pbatch)
 {
 
     static const CScriptNum bnZero(0);
@@ -765,7 +767,11 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, CT
                     if (stack.size() < 1)
                         return false;
                     valtype& vch = stacktop(-1);
-                    CPubKey pubKey;
+                    // public keys given by index or position are hashed where they are, not copied
+                    // on the stack, and the hash of a cached key is not computed again
+                    const unsigned char* pbegin = vch.empty() ? NULL : &vch[0];
+                    size_t nSize = vch.size();
+                    CSharedPubKeyRef pubkey;
                     if (vch.size() == RAINBOW_PUBLIC_KEY_REUSED_SIZE) {
                         unsigned int cursor0 = ((unsigned char)vch[0]) & 0xff;
                         unsigned int cursor1 = ((unsigned char)vch[1]) & 0xff;
@@ -774,7 +780,11 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, CT
                         unsigned int index = cursor0 + (cursor1<<8) + (cursor2<<16) + (cursor3<<24);
 
                         if (txTo.vPubKeys.size() > index) {
-                            vch = txTo.vPubKeys.at(index);
+                            const valtype& vchPubKey = txTo.vPubKeys.at(index);
+                            pbegin = vchPubKey.empty() ? NULL : &vchPubKey[0];
+                            nSize = vchPubKey.size();
+                            if (opcode == OP_HASH256)
+                                pubkey = pubKeyCache.Add(vchPubKey);
                         } else {
                             printf("signature can't find public key in vPubKeys, index=%u\n", index);
                             return false;
@@ -783,25 +793,31 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, CT
                         if (vch.size() == RAINBOW_PUBLIC_KEY_POS_SIZE) {
                             CDiskPubKeyPos pos;
                             pos << vch;
-                            if (GetPubKeyByPos(pos, pubKey)) {
-                                vch = pubKey.vchPubKey;
+                            pubkey = pubKeyCache.GetByPos(pos);
+                            if (pubkey) {
+                                pbegin = pubkey->begin();
+                                nSize = RAINBOW_PUBLIC_KEY_SIZE;
                             } else {
                                 printf("signature can't find public key at height=%u, offset=%u, maybe not public key position\n",
                                     pos.nHeight, pos.nPubKeyOffset);
                                 return false;
                             }
-                        } else if (!isSignCheck) {
-                            //only push for P2PKH, vch is the public key，don't push public key position
-                            //for signature check by oneself, the transaction already has the public keys when solver
-                            txTo.vPubKeys.push_back(vch);
+                        } else {
+                            if (!isSignCheck) {
+                                //only push for P2PKH, vch is the public key，don't push public key position
+                                //for signature check by oneself, the transaction already has the public keys when solver
+                                txTo.vPubKeys.push_back(vch);
+                            }
+                            if (opcode == OP_HASH256)
+                                pubkey = pubKeyCache.Add(vch);
                         }
                     }
                     valtype vchHash(32);
                     if (opcode == OP_SHA256)
-                        pqcSha256(&vch[0], vch.size(), &vchHash[0]);
+                        pqcSha256((unsigned char*)pbegin, nSize, &vchHash[0]);
                     else if (opcode == OP_HASH256)
                     {
-                        uint256 hash = Hash(vch.begin(), vch.end());
+                        uint256 hash = pubkey ? (uint256)pubkey->GetID() : Hash(pbegin, pbegin + nSize);
                         memcpy(&vchHash[0], &hash, sizeof(hash));
                     }
                     popstack(stack);
@@ -843,7 +859,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, CT
                     bool fSuccess = (!fStrictEncodings || IsCanonicalPubKey(vchPubKey));
                     if (fSuccess)
                         fSuccess = CheckSig(vchSig, vchPubKey, scriptCode, txTo, nIn,
-                                            nHashType, flags);
+                                            nHashType, flags, pbatch);
 
                     popstack(stack);
                     popstack(stack);
@@ -1034,78 +1050,150 @@ uint256 SignatureHash(CScript scriptCode, const CTransaction& txTo, unsigned int
 // twice for every transaction (once when accepted into memory pool, and
 // again when accepted into the block chain)
 
+/** Valid signatures, so that the signatures of a transaction accepted to the
+ *  memory pool are not verified again in its block. An entry is a salted
+ *  digest of (signature hash, signature, public key id), in a table of fixed
+ *  size split into shards of their own lock. A digest has a few slots of its
+ *  shard, and evicts one of them at random when they are all taken.
+ */
 class CSignatureCache
 {
 private:
-     // sigdata_type is (signature hash, signature, public key):
-    typedef boost::tuple<uint256, std::vector<unsigned char>, std::vector<unsigned char> > sigdata_type;
-    std::set< sigdata_type> setValid;
-    boost::shared_mutex cs_sigcache;
+    static const unsigned int nShards = 16;
+    static const unsigned int nProbes = 8;
 
-public:
-    bool
-    Get(uint256 hash, const std::vector<unsigned char>& vchSig, const std::vector<unsigned char>& pubKey)
+    struct CShard
     {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        boost::shared_mutex cs;
+        std::vector<uint256> vSlots;    // zero when free
+        uint32_t nRand;                 // eviction choices, under cs
+    };
 
-        sigdata_type k(hash, vchSig, pubKey);
-        std::set<sigdata_type>::iterator mi = setValid.find(k);
-        if (mi != setValid.end())
-            return true;
-        return false;
-    }
+    CShard shards[nShards];
+    uint256 salt;
+    std::once_flag fInit;
 
-    void Set(uint256 hash, const std::vector<unsigned char>& vchSig, const std::vector<unsigned char>& pubKey)
+    void Init()
     {
-        // DoS prevention: limit cache size to less than 10MB
-        // (~200 bytes per cache entry times 50,000 entries)
-        // Since there are a maximum of 20,000 signature operations per block
-        // 50,000 is a reasonable default.
-        int64 nMaxCacheSize = GetArg("-maxsigcachesize", 500000);
-        if (nMaxCacheSize <= 0) return;
+        // 32 bytes per entry, so that no public key is kept in memory: the
+        // default of 500,000 signatures takes 16 MB. Capped at 16 GB
+        int64 nMaxCacheSize = std::max(std::min(GetArg("-maxsigcachesize", 500000), (int64)1 << 29), (int64)0);
+        uint64 nSlots = (uint64)nMaxCacheSize / nShards;
+        salt = GetRandHash();
+        for (unsigned int i = 0; i < nShards; i++) {
+            shards[i].vSlots.assign(nSlots < nProbes ? 0 : nSlots, uint256(0));
+            shards[i].nRand = (uint32_t)(salt.Get64(i % 4) >> (i / 4 * 8)) | 1;
+        }
+    }
 
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+    uint256 GetDigest(uint256 hash, const std::vector<unsigned char>& vchSig, const CKeyID& keyID)
+    {
+        std::call_once(fInit, &CSignatureCache::Init, this);
+        CHashWriter ss(SER_GETHASH, 0);
+        ss << salt << hash << vchSig << keyID;
+        return ss.GetHash();
+    }
 
-        while (static_cast<int64>(setValid.size()) > nMaxCacheSize)
-        {
-            // Evict a random entry. Random because that helps
-            // foil would-be DoS attackers who might try to pre-generate
-            // and re-use a set of valid signatures just-slightly-greater
-            // than our cache size.
-            uint256 randomHash = GetRandHash();
-            std::vector<unsigned char> unused;
-            std::set<sigdata_type>::iterator it =
-                setValid.lower_bound(sigdata_type(randomHash, unused, unused));
-            if (it == setValid.end())
-                it = setValid.begin();
-            setValid.erase(*it);
-        }
+    CShard& GetShard(const uint256& digest)
+    {
+        return shards[*digest.begin() % nShards];
+    }
 
-        sigdata_type k(hash, vchSig, pubKey);
-        setValid.insert(k);
+    // The first slot of digest, its probes follow it
+    size_t GetSlot(const CShard& shard, const uint256& digest)
+    {
+        return digest.Get64(1) % (shard.vSlots.size() - nProbes + 1);
     }
-};
 
-bool CheckSig(vector<unsigned char> vchSig, vector<unsigned char> vchPubKey, CScript scriptCode,
-              const CTransaction& txTo, unsigned int nIn, int nHashType, int flags)
-{
-    static CSignatureCache signatureCache;
+public:
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
+    std::atomic<uint64_t> nInserts;
+    std::atomic<uint64_t> nEvictions;
 
-    // Hash type is one byte tacked on to the end of the signature
-    if (vchSig.empty())
-        return false;
-    if (nHashType == 0)
-        nHashType = vchSig.back();
-    else if (nHashType != vchSig.back())
+    CSignatureCache() : nHits(0), nMisses(0), nInserts(0), nEvictions(0) {}
+
+    bool Get(uint256 hash, const std::vector<unsigned char>& vchSig, const CKeyID& keyID)
+    {
+        uint256 digest = GetDigest(hash, vchSig, keyID);
+        CShard& shard = GetShard(digest);
+        boost::shared_lock<boost::shared_mutex> lock(shard.cs);
+
+        if (!shard.vSlots.empty()) {
+            size_t nSlot = GetSlot(shard, digest);
+            for (unsigned int i = 0; i < nProbes; i++) {
+                if (shard.vSlots[nSlot + i] == digest) {
+                    nHits++;
+                    return true;
+                }
+            }
+        }
+        nMisses++;
         return false;
-    vchSig.pop_back();
+    }
 
-    uint256 sighash = SignatureHash(scriptCode, txTo, nIn, nHashType);
+    void Set(uint256 hash, const std::vector<unsigned char>& vchSig, const CKeyID& keyID)
+    {
+        uint256 digest = GetDigest(hash, vchSig, keyID);
+        CShard& shard = GetShard(digest);
+        boost::unique_lock<boost::shared_mutex> lock(shard.cs);
+        if (shard.vSlots.empty())
+            return;
+
+        size_t nSlot = GetSlot(shard, digest);
+        for (unsigned int i = 0; i < nProbes; i++) {
+            uint256& slot = shard.vSlots[nSlot + i];
+            if (slot == digest)
+                return;
+            if (slot == 0) {
+                slot = digest;
+                nInserts++;
+                return;
+            }
+        }
 
-    if (signatureCache.Get(sighash, vchSig, vchPubKey))
-        return true;
+        // Evict a random entry. Random because that helps
+        // foil would-be DoS attackers who might try to pre-generate
+        // and re-use a set of valid signatures just-slightly-greater
+        // than our cache size.
+        shard.nRand ^= shard.nRand << 13;
+        shard.nRand ^= shard.nRand >> 17;
+        shard.nRand ^= shard.nRand << 5;
+        shard.vSlots[nSlot + shard.nRand % nProbes] = digest;
+        nInserts++;
+        nEvictions++;
+    }
+
+    uint64_t Size()
+    {
+        uint64_t nSize = 0;
+        for (unsigned int i = 0; i < nShards; i++) {
+            boost::shared_lock<boost::shared_mutex> lock(shards[i].cs);
+            BOOST_FOREACH(const uint256& slot, shards[i].vSlots)
+                if (slot != 0)
+                    nSize++;
+        }
+        return nSize;
+    }
+};
 
-    CPubKey pubkey;
+static CSignatureCache signatureCache;
+
+void GetSignatureCacheStats(uint64_t& nSize, uint64_t& nHits, uint64_t& nMisses, uint64_t& nEvictions)
+{
+    nSize = signatureCache.Size();
+    nHits = signatureCache.nHits;
+    nMisses = signatureCache.nMisses;
+    nEvictions = signatureCache.nEvictions;
+}
+
+// Public key of a script, given in full, by its position on disk or by its
+// index in the public keys of the spending transaction, with its id. NULL if
+// not valid. With fCachedOnly, NULL as well if the public key cache does not
+// hold it: the key is neither hashed nor read from disk
+static CSharedPubKeyRef ResolvePubKey(const vector<unsigned char>& vchPubKey, const CTransaction& txTo, bool fCachedOnly = false)
+{
+    CSharedPubKeyRef pubkey;
     if (vchPubKey.size() == RAINBOW_PUBLIC_KEY_REUSED_SIZE) {
         unsigned int cursor0 = ((unsigned char)vchPubKey[0]) & 0xff;
         unsigned int cursor1 = ((unsigned char)vchPubKey[1]) & 0xff;
@@ -1114,34 +1202,132 @@ bool CheckSig(vector<unsigned char> vchSig, vector<unsigned char> vchPubKey, CSc
         unsigned int index = cursor0 + (cursor1<<8) + (cursor2<<16) + (cursor3<<24);
 
         if (txTo.vPubKeys.size() > index) {
-            pubkey.vchPubKey = txTo.vPubKeys.at(index);
+            if (fCachedOnly)
+                pubkey = pubKeyCache.Find(txTo.vPubKeys.at(index));
+            else
+                pubkey = pubKeyCache.Add(txTo.vPubKeys.at(index));
         } else {
-            printf("CheckSig can't find public key in vPubKeys, index=%u\n", index);
-            return false;
+            if (!fCachedOnly)
+                printf("CheckSig can't find public key in vPubKeys, index=%u\n", index);
+            return CSharedPubKeyRef();
         }
     } else if (vchPubKey.size() == RAINBOW_PUBLIC_KEY_POS_SIZE) {
         CDiskPubKeyPos pos;
         pos << vchPubKey;
-        if(!GetPubKeyByPos(pos, pubkey)){
-            return false;
-        }
+        if (fCachedOnly)
+            pubkey = pubKeyCache.FindByPos(pos);
+        else
+            pubkey = pubKeyCache.GetByPos(pos);
     } else if (vchPubKey.size() == RAINBOW_PUBLIC_KEY_SIZE) {
-        pubkey.vchPubKey = vchPubKey;
-    } else
-        return false;
+        if (fCachedOnly)
+            pubkey = pubKeyCache.Find(vchPubKey);
+        else
+            pubkey = pubKeyCache.Add(vchPubKey);
+    }
+
+    if (!pubkey || !pubkey->IsValid())
+        return CSharedPubKeyRef();
+    return pubkey;
+}
 
-    if (!pubkey.IsValid())
+bool CheckSig(vector<unsigned char> vchSig, const vector<unsigned char>& vchPubKey, CScript scriptCode,
+              const CTransaction& txTo, unsigned int nIn, int nHashType, int flags, CSignatureBatch *pbatch)
+{
+    // Hash type is one byte tacked on to the end of the signature
+    if (vchSig.empty())
         return false;
+    if (nHashType == 0)
+        nHashType = vchSig.back();
+    else if (nHashType != vchSig.back())
+        return false;
+    vchSig.pop_back();
+
+    uint256 sighash = SignatureHash(scriptCode, txTo, nIn, nHashType);
+
+    // A signature cache hit must not pay for hashing a key or reading it from
+    // disk: look the signature up with the id of a key the public key cache
+    // already holds, and resolve the key only when it has to be verified
+    CSharedPubKeyRef pubkey = ResolvePubKey(vchPubKey, txTo, true);
+    if (pubkey && signatureCache.Get(sighash, vchSig, pubkey->GetID()))
+        return true;
+    if (!pubkey) {
+        pubkey = ResolvePubKey(vchPubKey, txTo);
+        if (!pubkey)
+            return false;
+        if (signatureCache.Get(sighash, vchSig, pubkey->GetID()))
+            return true;
+    }
 
-    if (!pubkey.Verify(sighash, vchSig))
+    if (pbatch) {
+        bool fValid;
+        if (!pbatch->IsVerified()) {
+            pbatch->Add(pubkey, sighash, vchSig, flags);
+            return true;
+        }
+        if (pbatch->Lookup(sighash, vchSig, pubkey->GetID(), fValid))
+            return fValid;
+    }
+
+    if (!pubkey->Verify(sighash, vchSig))
         return false;
 
     if (!(flags & SCRIPT_VERIFY_NOCACHE))
-        signatureCache.Set(sighash, vchSig, vchPubKey);
+        signatureCache.Set(sighash, vchSig, pubkey->GetID());
+    return true;
+}
+
+uint256 CSignatureBatch::GetDigest(uint256 sighash, const vector<unsigned char>& vchSig, const CKeyID& keyID)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << sighash << vchSig << keyID;
+    return ss.GetHash();
+}
+
+void CSignatureBatch::Add(const CSharedPubKeyRef& pubkey, uint256 sighash, const vector<unsigned char>& vchSig, int flags)
+{
+    assert(!fVerified);
+    CGroup& group = mapGroups[pubkey->GetID()];
+    group.pubkey = pubkey;
+    group.vHash.push_back(sighash);
+    group.vvchSig.push_back(vchSig);
+    group.vfCache.push_back(!(flags & SCRIPT_VERIFY_NOCACHE));
+}
+
+bool CSignatureBatch::Verify()
+{
+    bool fOk = true;
+    for (map<CKeyID, CGroup>::iterator mi = mapGroups.begin(); mi != mapGroups.end(); ++mi) {
+        CGroup& group = mi->second;
+        bool fGroupOk = group.pubkey->VerifyBatch(group.vHash, group.vvchSig);
+        fOk &= fGroupOk;
+        for (unsigned int i = 0; i < group.vHash.size(); i++) {
+            bool fValid = fGroupOk || group.pubkey->Verify(group.vHash[i], group.vvchSig[i]);
+            mapResults[GetDigest(group.vHash[i], group.vvchSig[i], mi->first)] = fValid;
+            if (fValid && group.vfCache[i])
+                signatureCache.Set(group.vHash[i], group.vvchSig[i], mi->first);
+        }
+    }
+    fVerified = true;
+    return fOk;
+}
 
+bool CSignatureBatch::Lookup(uint256 sighash, const vector<unsigned char>& vchSig, const CKeyID& keyID, bool& fValid) const
+{
+    map<uint256, bool>::const_iterator mi = mapResults.find(GetDigest(sighash, vchSig, keyID));
+    if (mi == mapResults.end())
+        return false;
+    fValid = mi->second;
     return true;
 }
 
+unsigned int CSignatureBatch::size() const
+{
+    unsigned int nSize = 0;
+    for (map<CKeyID, CGroup>::const_iterator mi = mapGroups.begin(); mi != mapGroups.end(); ++mi)
+        nSize += mi->second.vHash.size();
+    return nSize;
+}
+
 
 
 
@@ -1548,15 +1734,15 @@ bool ExtractDestinations(const CScript& scriptPubKey, txnouttype& typeRet, vecto
 }
 
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, CTransaction& txTo,
-    unsigned int nIn, unsigned int flags, int nHashType, bool isSignCheck)
+    unsigned int nIn, unsigned int flags, int nHashType, bool isSignCheck, CSignatureBatch *pbatch)
 {
     vector<vector<unsigned char> > stack, stackCopy;
-    if (!EvalScript(stack, scriptSig, txTo, nIn, flags, nHashType, isSignCheck))
+    if (!EvalScript(stack, scriptSig, txTo, nIn, flags, nHashType, isSignCheck, pbatch))
         return false;
 
     if (flags & SCRIPT_VERIFY_P2SH)
         stackCopy = stack;
-    if (!EvalScript(stack, scriptPubKey, txTo, nIn, flags, nHashType, isSignCheck))
+    if (!EvalScript(stack, scriptPubKey, txTo, nIn, flags, nHashType, isSignCheck, pbatch))
         return false;
 
     if (stack.empty())
@@ -1579,7 +1765,7 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, CTransa
         CScript pubKey2(pubKeySerialized.begin(), pubKeySerialized.end());
         popstack(stackCopy);
 
-        if (!EvalScript(stackCopy, pubKey2, txTo, nIn, flags, nHashType, isSignCheck))
+        if (!EvalScript(stackCopy, pubKey2, txTo, nIn, flags, nHashType, isSignCheck, pbatch))
             return false;
 
         if (stackCopy.empty())
@@ -5,6 +5,7 @@
 #ifndef H_ABCMINT_SCRIPT
 #define H_ABCMINT_SCRIPT
 
+#include <map>
 #include <string>
 #include <vector>
 
@@ -799,8 +800,55 @@ public:
 bool IsCanonicalPubKey(const std::vector<unsigned char> &vchPubKey);
 bool IsCanonicalSignature(const std::vector<unsigned char> &vchSig);
 
+/** OP_CHECKSIG checks deferred by EvalScript and verified together: the
+ *  signatures of one public key take a single pass over the key. A script
+ *  evaluated with a batch assumes its deferred signatures are valid, so it
+ *  is only known to pass once Verify() succeeded too. Scripts evaluated
+ *  again with the batch once verified reuse its results instead of
+ *  deferring their signatures.
+ */
+class CSignatureBatch
+{
+private:
+    struct CGroup
+    {
+        CSharedPubKeyRef pubkey;
+        std::vector<uint256> vHash;
+        std::vector<std::vector<unsigned char> > vvchSig;
+        std::vector<bool> vfCache;
+    };
+
+    std::map<CKeyID, CGroup> mapGroups;
+
+    // Result of each deferred signature, by GetDigest(), once verified
+    std::map<uint256, bool> mapResults;
+    bool fVerified;
+
+    static uint256 GetDigest(uint256 sighash, const std::vector<unsigned char>& vchSig, const CKeyID& keyID);
+
+public:
+    CSignatureBatch() : fVerified(false) {}
+
+    // Defer the check of vchSig by pubkey
+    void Add(const CSharedPubKeyRef& pubkey, uint256 sighash, const std::vector<unsigned char>& vchSig, int flags);
+
+    // Verify the deferred signatures, true if all of them are valid. The
+    // signatures of a failed group are verified one by one, for Lookup()
+    bool Verify();
+
+    bool IsVerified() const { return fVerified; }
+
+    // Result Verify() found for vchSig by keyID, false if not in the batch
+    bool Lookup(uint256 sighash, const std::vector<unsigned char>& vchSig, const CKeyID& keyID, bool& fValid) const;
+
+    unsigned int size() const;
+};
+
+/** Number of entries, hits, misses and evictions of the signature cache */
+void GetSignatureCacheStats(uint64_t& nSize, uint64_t& nHits, uint64_t& nMisses, uint64_t& nEvictions);
+
 bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript& script, CTransaction& txTo,
-    unsigned int nIn, unsigned int flags, int nHashType, bool isSignCheck = false);
+    unsigned int nIn, unsigned int flags, int nHashType, bool isSignCheck = false, CSignatureBatch *pbatch = NULL);
 bool Solver(const CScript& scriptPubKey, txnouttype& typeRet, std::vector<std::vector<unsigned char> >& vSolutionsRet);
 int ScriptSigArgsExpected(txnouttype t, const std::vector<std::vector<unsigned char> >& vSolutions);
 bool IsStandard(const CScript& scriptPubKey);
@@ -813,7 +861,7 @@ bool SignSignature(const CKeyStore& keystore, const CScript& fromPubKey, CTransa
 bool SignSignature(const CKeyStore& keystore, const CTransaction& txFrom, CTransaction& txTo,
     unsigned int nIn, int nHashType=SIGHASH_ALL);
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, CTransaction& txTo,
-    unsigned int nIn, unsigned int flags, int nHashType, bool isSignCheck = false);
+    unsigned int nIn, unsigned int flags, int nHashType, bool isSignCheck = false, CSignatureBatch *pbatch = NULL);
 
 // Given two sets of signatures for scriptPubKey, possibly with OP_0 placeholders,
 // combine them intelligently and return the result.
@@ -0,0 +1,223 @@
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "pqcrypto/blas.h"
+#include "pqcrypto/rainbow_16.h"
+#include "pqcrypto/hash_len_config.h"
+
+#ifdef _BLAS_SIMD_
+
+static void randBytes(uint8_t *buf, unsigned size) {
+    for (unsigned i = 0; i < size; i++)
+        buf[i] = rand() & 0xff;
+}
+
+static void refMatProd(uint8_t *c, const uint8_t *matA, unsigned nVecByte, unsigned nWidth, const uint8_t *b) {
+    memset(c, 0, nVecByte);
+    for (unsigned i = 0; i < nWidth; i++)
+        _gf16v_madd_u64(c, matA + i * nVecByte, gf16v_get_ele(b, i), nVecByte);
+}
+
+// every level available on this cpu must give the same result as the u64 library
+TEST(blasTest, simdMatchesU64) {
+    unsigned nSupported = gf16_simd_supported();
+    srand(1);
+    for (unsigned level = GF16_SIMD_NONE; level <= nSupported; level++) {
+        EXPECT_EQ(level, gf16_simd_set_level(level));
+
+        for (unsigned len = 0; len <= 100; len++) {
+            for (unsigned b = 0; b < 16; b++) {
+                uint8_t a[101], c[101], ref[101];
+                randBytes(a, sizeof(a));
+                randBytes(c, sizeof(c));
+                memcpy(ref, c, sizeof(c));
+                gf16v_madd_simd(c + 1, a + 1, b, len);
+                _gf16v_madd_u64(ref + 1, a + 1, b, len);
+                EXPECT_EQ(0, memcmp(c, ref, sizeof(c))) << "level " << level << " len " << len << " b " << b;
+            }
+        }
+
+        unsigned nVecBytes[] = {8, 16, 24, 32, 48, 64, 72};
+        for (unsigned k = 0; k < sizeof(nVecBytes) / sizeof(nVecBytes[0]); k++) {
+            unsigned nVecByte = nVecBytes[k], nWidth = 96;
+            std::vector<uint8_t> mat(nVecByte * nWidth), b(nWidth / 2), c(nVecByte), ref(nVecByte);
+            randBytes(&mat[0], mat.size());
+            randBytes(&b[0], b.size());
+            gf16mat_prod_simd(&c[0], &mat[0], nVecByte, nWidth, &b[0]);
+            refMatProd(&ref[0], &mat[0], nVecByte, nWidth, &b[0]);
+            EXPECT_TRUE(c == ref) << "level " << level << " vector bytes " << nVecByte;
+        }
+    }
+
+    // the public map of every level against the u64 one
+    std::vector<uint8_t> pk(_PUB_KEY_LEN);
+    randBytes(&pk[0], pk.size());
+    for (int n = 0; n < 8; n++) {
+        uint8_t w[_PUB_N_BYTE], z[_PUB_M_BYTE], ref[_PUB_M_BYTE];
+        randBytes(w, sizeof(w));
+        gf16_simd_set_level(GF16_SIMD_NONE);
+        mpkc_pub_map_gf16_n_m(ref, &pk[0], w, _PUB_N, _PUB_M);
+        for (unsigned level = GF16_SIMD_NONE; level <= nSupported; level++) {
+            gf16_simd_set_level(level);
+            mpkc_pub_map_gf16(z, &pk[0], w);
+            EXPECT_EQ(0, memcmp(z, ref, sizeof(z))) << "level " << level;
+        }
+    }
+    gf16_simd_set_level(nSupported);
+}
+
+// signatures made with one level verify with the others
+TEST(blasTest, simdSignAndVerify) {
+    unsigned nSupported = gf16_simd_supported();
+    std::vector<uint8_t> pk(_PUB_KEY_LEN), sk(_SEC_KEY_LEN);
+    rainbow_genkey(&pk[0], &sk[0]);
+    for (unsigned level = GF16_SIMD_NONE; level <= nSupported; level++) {
+        gf16_simd_set_level(level);
+        uint8_t digest[_HASH_LEN], sig[_SIGNATURE_BYTE];
+        randBytes(digest, sizeof(digest));
+        EXPECT_EQ(0, rainbow_sign(sig, &sk[0], digest));
+        for (unsigned verifyLevel = GF16_SIMD_NONE; verifyLevel <= nSupported; verifyLevel++) {
+            gf16_simd_set_level(verifyLevel);
+            EXPECT_EQ(0, rainbow_verify(digest, sig, &pk[0])) << "signed " << level << " verified " << verifyLevel;
+            digest[0] ^= 1;
+            EXPECT_EQ(-1, rainbow_verify(digest, sig, &pk[0]));
+            digest[0] ^= 1;
+        }
+    }
+    gf16_simd_set_level(nSupported);
+}
+
+// one pass over the public key for several signatures, across a chunk boundary
+TEST(blasTest, verifyBatch) {
+    unsigned nSupported = gf16_simd_supported();
+    std::vector<uint8_t> pk(_PUB_KEY_LEN), sk(_SEC_KEY_LEN);
+    rainbow_genkey(&pk[0], &sk[0]);
+
+    const unsigned n = MPKC_BATCH_MAX + 3;
+    std::vector<uint8_t> digest(n * _HASH_LEN), sig(n * _SIGNATURE_BYTE);
+    std::vector<const uint8_t*> vDigest(n), vSig(n);
+    for (unsigned i = 0; i < n; i++) {
+        vDigest[i] = &digest[i * _HASH_LEN];
+        vSig[i] = &sig[i * _SIGNATURE_BYTE];
+        randBytes(&digest[i * _HASH_LEN], _HASH_LEN);
+        EXPECT_EQ(0, rainbow_sign(&sig[i * _SIGNATURE_BYTE], &sk[0], vDigest[i]));
+    }
+
+    for (unsigned level = GF16_SIMD_NONE; level <= nSupported; level++) {
+        gf16_simd_set_level(level);
+        std::vector<uint8_t> z(MPKC_BATCH_MAX * _PUB_M_BYTE);
+        mpkc_pub_map_gf16_batch(&z[0], &pk[0], &vSig[0], MPKC_BATCH_MAX);
+        for (unsigned k = 0; k < MPKC_BATCH_MAX; k++) {
+            uint8_t ref[_PUB_M_BYTE];
+            mpkc_pub_map_gf16(ref, &pk[0], vSig[k]);
+            EXPECT_EQ(0, memcmp(&z[k * _PUB_M_BYTE], ref, _PUB_M_BYTE)) << "level " << level << " signature " << k;
+        }
+
+        EXPECT_EQ(0, rainbow_verify_batch(&pk[0], &vDigest[0], &vSig[0], n)) << "level " << level;
+        EXPECT_EQ(0, rainbow_verify_batch(&pk[0], &vDigest[0], &vSig[0], 0));
+        EXPECT_EQ(0, rainbow_verify_batch(&pk[0], &vDigest[0], &vSig[0], 1));
+
+        // a bad signature in the first and in the last chunk
+        unsigned bad[] = {0, n - 1};
+        for (unsigned k = 0; k < 2; k++) {
+            digest[bad[k] * _HASH_LEN] ^= 1;
+            EXPECT_EQ(-1, rainbow_verify_batch(&pk[0], &vDigest[0], &vSig[0], n)) << "level " << level << " bad " << bad[k];
+            digest[bad[k] * _HASH_LEN] ^= 1;
+        }
+    }
+    gf16_simd_set_level(nSupported);
+}
+
+// the vectorized elimination against the constant time one, singular systems included
+TEST(blasTest, gaussElim) {
+    unsigned nSupported = gf16_simd_supported();
+    srand(3);
+    unsigned nWidths[] = {34, 64};
+    for (unsigned level = GF16_SIMD_NONE; level <= nSupported; level++) {
+        gf16_simd_set_level(level);
+        for (unsigned k = 0; k < sizeof(nWidths) / sizeof(nWidths[0]); k++) {
+            unsigned h = 32, w = nWidths[k];
+            for (int n = 0; n < 32; n++) {
+                std::vector<uint8_t> mat(h * w / 2), ref;
+                randBytes(&mat[0], mat.size());
+                // a repeated row makes the system singular
+                if (n % 4 == 0)
+                    memcpy(&mat[(n / 4 + 1) * w / 2], &mat[0], w / 2);
+                ref = mat;
+                unsigned r = gf16mat_gauss_elim_simd(&mat[0], h, w);
+                unsigned rRef = _gf16mat_gauss_elim(&ref[0], h, w);
+                EXPECT_EQ(rRef, r) << "level " << level << " width " << w;
+                EXPECT_TRUE(mat == ref) << "level " << level << " width " << w;
+                if (n % 4 == 0) {
+                    EXPECT_EQ(0u, r);
+                }
+            }
+        }
+
+        unsigned nSizes[][2] = {{32, 32}, {64, 32}, {32, 64}, {64, 64}};
+        for (unsigned k = 0; k < sizeof(nSizes) / sizeof(nSizes[0]); k++) {
+            unsigned nVar = nSizes[k][0], nEq = nSizes[k][1];
+            std::vector<uint8_t> pk(nEq / 2 * (nVar + nVar * (nVar + 1) / 2 + 1)), x(nVar / 2), z(nEq / 2), ref(nEq / 2);
+            randBytes(&pk[0], pk.size());
+            randBytes(&x[0], x.size());
+            mpkc_pub_map_gf16_n_m_simd(&z[0], &pk[0], &x[0], nVar, nEq);
+            _mpkc_pub_map_gf16_n_m(&ref[0], &pk[0], &x[0], nVar, nEq);
+            EXPECT_TRUE(z == ref) << "level " << level << " n " << nVar << " m " << nEq;
+        }
+    }
+    gf16_simd_set_level(nSupported);
+}
+
+// signatures sharing one random draw, across a chunk boundary
+TEST(blasTest, signBatch) {
+    unsigned nSupported = gf16_simd_supported();
+    std::vector<uint8_t> pk(_PUB_KEY_LEN), sk(_SEC_KEY_LEN);
+    rainbow_genkey(&pk[0], &sk[0]);
+
+    const unsigned n = RAINBOW_SIGN_BATCH_MAX + 3;
+    std::vector<uint8_t> digest(n * _HASH_LEN);
+    std::vector<const uint8_t*> vDigest(n), vSig(n);
+    for (unsigned i = 0; i < n; i++) {
+        vDigest[i] = &digest[i * _HASH_LEN];
+        randBytes(&digest[i * _HASH_LEN], _HASH_LEN);
+    }
+    for (unsigned level = GF16_SIMD_NONE; level <= nSupported; level++) {
+        gf16_simd_set_level(level);
+        std::vector<uint8_t> sig(n * _SIGNATURE_BYTE);
+        EXPECT_EQ(0, rainbow_sign_batch(&sig[0], &sk[0], &vDigest[0], n)) << "level " << level;
+        for (unsigned i = 0; i < n; i++) {
+            vSig[i] = &sig[i * _SIGNATURE_BYTE];
+            EXPECT_EQ(0, rainbow_verify(vDigest[i], vSig[i], &pk[0])) << "level " << level << " signature " << i;
+        }
+        // the salts are not shared
+        EXPECT_NE(0, memcmp(&sig[_PUB_N_BYTE], &sig[_SIGNATURE_BYTE + _PUB_N_BYTE], _SALT_BYTE));
+        EXPECT_EQ(0, rainbow_verify_batch(&pk[0], &vDigest[0], &vSig[0], n));
+    }
+    gf16_simd_set_level(nSupported);
+}
+
+// the composed public key against the interpolated one
+TEST(blasTest, pubkeyCompose) {
+    unsigned nSupported = gf16_simd_supported();
+    for (unsigned level = GF16_SIMD_NONE; level <= nSupported; level++) {
+        gf16_simd_set_level(level);
+        rainbow_key pkKey, skKey;
+        rainbow_genkey_debug(&pkKey, &skKey);
+        std::vector<uint8_t> pk(_PUB_KEY_LEN - 1), ref(_PUB_KEY_LEN - 1);
+        rainbow_pubkey(&pk[0], &pkKey);
+        rainbow_pubkey_interpolate(&ref[0], &pkKey);
+        EXPECT_TRUE(pk == ref) << "level " << level;
+    }
+    gf16_simd_set_level(nSupported);
+
+    // and a key of rainbow_genkey() signs
+    std::vector<uint8_t> pk(_PUB_KEY_LEN), sk(_SEC_KEY_LEN);
+    rainbow_genkey(&pk[0], &sk[0]);
+    uint8_t digest[_HASH_LEN], sig[_SIGNATURE_BYTE];
+    randBytes(digest, sizeof(digest));
+    EXPECT_EQ(0, rainbow_sign(sig, &sk[0], digest));
+    EXPECT_EQ(0, rainbow_verify(digest, sig, &pk[0]));
+}
+
+#endif
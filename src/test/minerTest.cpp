@@ -1,5 +1,9 @@
 #include <bitset>
+#include <algorithm>
 #include <math.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
 #include <gtest/gtest.h>
 #include "util.h"
 #include "uint256.h"
@@ -281,3 +285,487 @@ TEST(mineTest, initBlockIndex) {
 #endif
 
 
+static int CollectCandidates(void *state, uint64_t count, uint64_t *candidates) {
+    std::vector<uint64_t> *v = (std::vector<uint64_t> *)state;
+    v->insert(v->end(), candidates, candidates + count);
+    return 0;
+}
+
+static void RandomPackedSystem(int n, unsigned int seed, std::vector<pck_vector_t> &F) {
+    F.resize(n_monomials(n, 2));
+    srand(seed);
+    // only 12 of the 16 equations are used so that there are some candidates
+    for (unsigned int i = 0; i < F.size(); i++)
+        F[i] = rand() & 0x0fff;
+}
+
+#ifdef HAVE_SSE2
+TEST(mineTest, simdEnumerationKernels) {
+    CMQCancelToken cancel;
+    for (int n = 12; n <= 22; n += 5) {
+        const idx_lut_t *idx_LUT = init_deginvlex_LUT(n, 2);
+        std::vector<pck_vector_t> F, G;
+        RandomPackedSystem(n, n, F);
+
+        std::vector<uint64_t> scalar, sse2, avx2;
+        G = F;
+        exhaustive_ia32_deg_2(idx_LUT->LUT, n, G.data(), CollectCandidates, &scalar, 0, &cancel);
+        G = F;
+        exhaustive_sse2_deg_2_T_3_el_0(idx_LUT->LUT, n, G.data(), CollectCandidates, &sse2, 0, &cancel);
+        std::sort(scalar.begin(), scalar.end());
+        std::sort(sse2.begin(), sse2.end());
+        EXPECT_TRUE(scalar == sse2);
+        for (unsigned int i = 0; i < scalar.size(); i++)
+            EXPECT_EQ(packed_eval_deg_2(idx_LUT->LUT, n, F.data(), scalar[i]), 0u);
+
+        if (__builtin_cpu_supports("avx2")) {
+            G = F;
+            exhaustive_avx2_deg_2_T_4_el_0(idx_LUT->LUT, n, G.data(), CollectCandidates, &avx2, 0, &cancel);
+            std::sort(avx2.begin(), avx2.end());
+            EXPECT_TRUE(scalar == avx2);
+        }
+        free_LUT(idx_LUT);
+    }
+}
+
+TEST(mineTest, wideEnumerationKernels) {
+    CMQCancelToken cancel;
+    const int n = 20;
+    const idx_lut_t *idx_LUT = init_deginvlex_LUT(n, 2);
+    for (int nWordSize = 32; nWordSize <= 64; nWordSize *= 2) {
+        // the 12 equations used are the highest ones of the word
+        std::vector<pck_vector_t> F, G;
+        RandomPackedSystem(n, nWordSize, F);
+        for (unsigned int i = 0; i < F.size(); i++)
+            F[i] <<= nWordSize - 12;
+
+        std::vector<uint64_t> scalar, sse2, avx2;
+        G = F;
+        exhaustive_ia32_deg_2(idx_LUT->LUT, n, G.data(), CollectCandidates, &scalar, 0, &cancel);
+        G = F;
+        if (nWordSize == 32)
+            exhaustive_sse2_deg_2_T_2_w32(idx_LUT->LUT, n, G.data(), CollectCandidates, &sse2, 0, &cancel);
+        else
+            exhaustive_sse2_deg_2_T_1_w64(idx_LUT->LUT, n, G.data(), CollectCandidates, &sse2, 0, &cancel);
+        std::sort(scalar.begin(), scalar.end());
+        std::sort(sse2.begin(), sse2.end());
+        EXPECT_FALSE(scalar.empty());
+        EXPECT_TRUE(scalar == sse2);
+
+        if (__builtin_cpu_supports("avx2")) {
+            G = F;
+            if (nWordSize == 32)
+                exhaustive_avx2_deg_2_T_3_w32(idx_LUT->LUT, n, G.data(), CollectCandidates, &avx2, 0, &cancel);
+            else
+                exhaustive_avx2_deg_2_T_2_w64(idx_LUT->LUT, n, G.data(), CollectCandidates, &avx2, 0, &cancel);
+            std::sort(avx2.begin(), avx2.end());
+            EXPECT_TRUE(scalar == avx2);
+        }
+    }
+    free_LUT(idx_LUT);
+}
+#endif
+
+TEST(mineTest, moebiusTransform) {
+    CMQCancelToken cancel;
+    // 17 and 22 variables take tile passes after the blocks of 2^12 words
+    const int sizes[] = { 5, 12, 17, 22 };
+    for (int s = 0; s < 4; s++) {
+        const int n = sizes[s];
+        const idx_lut_t *idx_LUT = init_deginvlex_LUT(n, 2);
+        std::vector<pck_vector_t> F, G;
+        RandomPackedSystem(n, n, F);
+
+        std::vector<uint64_t> expected;
+        if (n <= 12) {
+            for (uint64_t i = 0; i < ((uint64_t)1 << n); i++)
+                if (packed_eval_deg_2(idx_LUT->LUT, n, F.data(), i) == 0)
+                    expected.push_back(i);
+        } else {
+            G = F;
+            exhaustive_ia32_deg_2(idx_LUT->LUT, n, G.data(), CollectCandidates, &expected, 0, &cancel);
+            std::sort(expected.begin(), expected.end());
+        }
+        if (n >= 12) {
+            EXPECT_FALSE(expected.empty());
+        }
+
+        std::vector<pck_vector_t> A((uint64_t)1 << n);
+        for (int nThreads = 1; nThreads <= 3; nThreads += 2) {
+            for (int fAVX2 = 0; fAVX2 <= 1; fAVX2++) {
+                wrapper_settings_t settings;
+                init_settings(&settings);
+                if (fAVX2 && !settings.algo_enum_use_avx2)
+                    continue;
+                settings.algo_enum_use_avx2 = fAVX2;
+                settings.fft_threads = nThreads;
+
+                std::vector<uint64_t> zeros;
+                moebius_load_deg_2(idx_LUT->LUT, n, F.data(), A.data());
+                moebius_transform(n, A.data(), CollectCandidates, &zeros, &settings, &cancel);
+                std::sort(zeros.begin(), zeros.end());
+                EXPECT_TRUE(zeros == expected) << n << " variables, " << nThreads << " threads";
+                if (n <= 12) {
+                    for (uint64_t i = 0; i < A.size(); i++)
+                        ASSERT_EQ(A[i], packed_eval_deg_2(idx_LUT->LUT, n, F.data(), i));
+                }
+            }
+        }
+        free_LUT(idx_LUT);
+    }
+}
+
+static void PinThread(int nCpu, bool *fPinned) {
+    *fPinned = SetThreadAffinity(nCpu);
+}
+
+TEST(mineTest, threadPlacementAndPages) {
+    std::vector<std::vector<int> > vNodes = GetNumaNodes();
+    for (unsigned int i = 0; i < vNodes.size(); i++)
+        EXPECT_FALSE(vNodes[i].empty());
+
+#ifdef __linux__
+    // only the cpus of the affinity of the process, at least one
+    ASSERT_FALSE(vNodes.empty());
+    cpu_set_t allowed;
+    ASSERT_EQ(sched_getaffinity(0, sizeof(allowed), &allowed), 0);
+    for (unsigned int i = 0; i < vNodes.size(); i++)
+        for (unsigned int j = 0; j < vNodes[i].size(); j++)
+            EXPECT_TRUE(CPU_ISSET(vNodes[i][j], &allowed));
+
+    bool fPinned = false;
+    boost::thread thread(boost::bind(&PinThread, vNodes[0][0], &fPinned));
+    thread.join();
+    EXPECT_TRUE(fPinned);
+#endif
+
+    // with or without huge pages, the pages are zeroed and writable
+    for (int fHugePages = 0; fHugePages <= 1; fHugePages++) {
+        const size_t nSize = 1 << 21;
+        uint64_t *p = (uint64_t *)AllocPages(nSize, fHugePages);
+        ASSERT_TRUE(p != NULL);
+        EXPECT_EQ(p[0], 0u);
+        EXPECT_EQ(p[nSize / sizeof(uint64_t) - 1], 0u);
+        memset(p, 0xa5, nSize);
+        EXPECT_EQ(p[nSize / sizeof(uint64_t) - 1], 0xa5a5a5a5a5a5a5a5ULL);
+        FreePages(p, nSize);
+    }
+}
+
+TEST(mineTest, batchedSolutionTester) {
+    const int n = 37, nBatches = 3;
+    const idx_lut_t *idx_LUT = init_deginvlex_LUT(n, 2);
+    std::vector<pck_vector_t> F[nBatches];
+    pck_vector_t *G[nBatches];
+    for (int j = 0; j < nBatches; j++) {
+        RandomPackedSystem(n, 100 + j, F[j]);
+        G[j] = F[j].data();
+    }
+
+    std::vector<uint64_t> candidates(1024);
+    srand(7);
+    for (unsigned int i = 0; i < candidates.size(); i++)
+        candidates[i] = (((uint64_t)rand() << 31) ^ rand()) & ((1ll << n) - 1);
+
+    wrapper_settings_t scalar, sse2, avx2;
+    init_settings(&scalar);
+    scalar.algo_enum_use_sse = 0;
+    init_settings(&sse2);
+    sse2.algo_enum_use_avx2 = 0;
+    init_settings(&avx2);
+
+    // make some candidates solutions of all the batches but the last one,
+    // and then two of them solutions of all the batches
+    const uint64_t vFirst[] = { 1023, 500, 17, 0 };
+    for (int k = 0; k < 4; k++) {
+        uint64_t x = candidates[vFirst[k]];
+        for (int j = 0; j < nBatches; j++) {
+            pck_vector_t y = packed_eval_deg_2(idx_LUT->LUT, n, G[j], x);
+            if (j < nBatches - 1 || k >= 2)
+                G[j][0] ^= y;
+        }
+        uint64_t nExpected = k < 2 ? candidates.size() : vFirst[k];
+        const uint64_t vSizes[] = { 1, 5, 16, 17, 100, 501, 1024 };
+        BOOST_FOREACH(uint64_t size, vSizes) {
+            uint64_t nScalar = packed_test_candidates_deg_2(idx_LUT->LUT, n, nBatches, G, candidates.data(), size, &scalar);
+            EXPECT_EQ(nScalar, std::min(nExpected, size));
+            for (int nWordSize = 16; nWordSize <= 64; nWordSize *= 2) {
+                sse2.word_size = avx2.word_size = nWordSize;
+                EXPECT_EQ(packed_test_candidates_deg_2(idx_LUT->LUT, n, nBatches, G, candidates.data(), size, &sse2), nScalar);
+                if (avx2.algo_enum_use_avx2) {
+                    EXPECT_EQ(packed_test_candidates_deg_2(idx_LUT->LUT, n, nBatches, G, candidates.data(), size, &avx2), nScalar);
+                }
+            }
+        }
+    }
+    free_LUT(idx_LUT);
+}
+
+static int EvaluateEquation(int n, int **Eq, uint64_t x) {
+    int y = Eq[0][0];
+    int offset = 0;
+    for (int j = 0; j < n; j++)
+        y ^= Eq[1][j] & (x >> j) & 1;
+    for (int j = 0; j < n-1; j++)
+        for (int k = j+1; k < n; k++)
+            y ^= Eq[2][offset++] & (x >> j) & (x >> k) & 1;
+    return y;
+}
+
+TEST(mineTest, exfesSubProblems) {
+    CMQCancelToken cancel;
+    // 20 equations span two batches of the packed equations of the enumeration,
+    // the FFT packs 64 equations per batch
+    const int algorithms[] = { ALGO_ENUMERATION, ALGO_FFT };
+    for (int a = 0; a < 2; a++)
+    for (int e = 16; e <= 20; e += 4) {
+        SetMQSolver(algorithms[a]);
+        const int n = 24, m = 4;
+        int ***Eqs = CreateEquations(n, e);
+        int ***EqsMasked = CreateEquations(n, e);
+        srand(e);
+        for (int i = 0; i < e; i++)
+            for (int j = 0; j < 3; j++)
+                for (int k = 0; k < (j == 0 ? 1 : j == 1 ? n : n*(n-1)/2); k++)
+                    EqsMasked[i][j][k] = Eqs[i][j][k] = rand() & 1;
+        uint64_t Mask[4] = {0x00a5c3f0, 0, 0, 0};
+        exfes_mask(n, e, Mask, EqsMasked);
+
+        // every sub-problem solution must solve the original system and
+        // have its first m variables (relative to the mask) fixed to solm
+        packed_system_t *sys = exfes_packed_system(m, n, e, Eqs);
+        ASSERT_TRUE(sys != NULL);
+        EXPECT_EQ(sys->settings.algorithm, algorithms[a]);
+        std::vector<pck_vector_t> F(sys->scratch_words);
+        exfes_packed_eqs_t *eqs = exfes_pack_equations(m, n, e, EqsMasked, sys);
+        ASSERT_TRUE(eqs != NULL);
+        uint64_t **SolArray = CreateArray(1);
+        uint64_t nSubProblems = mqSolverStats.nSubProblems, nCandidates = mqSolverStats.nCandidates;
+        int nSolved = 0;
+        for (uint64_t solm = 0; solm < (1u << m); solm++) {
+            if (exfes_subproblem(m, n, Mask, solm, eqs, sys, F.data(), SolArray, &cancel) != 1)
+                continue;
+            nSolved++;
+            uint64_t x = SolArray[0][0];
+            EXPECT_EQ((x ^ Mask[0]) & ((1u << m) - 1), solm);
+            for (int i = 0; i < e; i++)
+                EXPECT_EQ(EvaluateEquation(n, Eqs[i], x), 0);
+        }
+        EXPECT_GT(nSolved, 0);
+        // the sub-problems without solution are enumerated to the end
+        EXPECT_EQ(mqSolverStats.nSubProblems - nSubProblems, 1u << m);
+        EXPECT_GE(mqSolverStats.nCandidates - nCandidates, ((1u << m) - nSolved) << (n - m));
+        EXPECT_LE(mqSolverStats.nCandidates - nCandidates, 1u << n);
+
+        FreeArray(1, SolArray);
+        free_exfes_packed_eqs(eqs);
+        free_packed_system(sys);
+        FreeEquations(e, EqsMasked);
+        FreeEquations(e, Eqs);
+    }
+    SetMQSolver(ALGO_AUTO);
+}
+
+TEST(mineTest, solverTuning) {
+    SetMQSolver(ALGO_AUTO);
+    // nothing is measured on the way of a solver context, only by MQTuneSolver()
+    EXPECT_EQ(MQSolver(15, 16), ALGO_ENUMERATION);
+    MQTuneSolver(15, 16);
+    int nAlgorithm = MQSolver(15, 16);
+    EXPECT_TRUE(nAlgorithm == ALGO_ENUMERATION || nAlgorithm == ALGO_FFT);
+    MQTuneSolver(15, 16);
+    EXPECT_EQ(MQSolver(15, 16), nAlgorithm);
+    // too large for the table of the transform
+    MQTuneSolver(MQ_FFT_MAX_VARIABLES + 1, 16);
+    EXPECT_EQ(MQSolver(MQ_FFT_MAX_VARIABLES + 1, 16), ALGO_ENUMERATION);
+}
+
+TEST(mineTest, solverCancellation) {
+    std::atomic<uint64_t> nEpoch(7);
+    CMQCancelToken cancel(nEpoch);
+    EXPECT_FALSE(cancel.IsCancelled());
+    EXPECT_EQ(cancel.Epoch(), 7u);
+
+    const int n = 24, e = 16, m = 4;
+    int ***Eqs = CreateEquations(n, e);
+    srand(e);
+    for (int i = 0; i < e; i++)
+        for (int j = 0; j < 3; j++)
+            for (int k = 0; k < (j == 0 ? 1 : j == 1 ? n : n*(n-1)/2); k++)
+                Eqs[i][j][k] = rand() & 1;
+    packed_system_t *sys = exfes_packed_system(m, n, e, Eqs);
+    ASSERT_TRUE(sys != NULL);
+    std::vector<pck_vector_t> F(sys->scratch_words);
+    exfes_packed_eqs_t *eqs = exfes_pack_equations(m, n, e, Eqs, sys);
+    ASSERT_TRUE(eqs != NULL);
+    uint64_t **SolArray = CreateArray(1);
+    uint64_t Mask[4] = {0, 0, 0, 0};
+
+    // a new epoch ends the work of every token taken before it
+    nEpoch++;
+    EXPECT_TRUE(cancel.IsCancelled());
+    EXPECT_TRUE(cancel.IsCancelled(0));
+    uint64_t nCandidates = mqSolverStats.nCandidates, nSubProblems = mqSolverStats.nSubProblems;
+    EXPECT_EQ(exfes_subproblem(m, n, Mask, 0, eqs, sys, F.data(), SolArray, &cancel), -1);
+    EXPECT_EQ(mqSolverStats.nCandidates - nCandidates, 0u);
+    EXPECT_EQ(mqSolverStats.nSubProblems - nSubProblems, 0u);
+
+    CMQCancelToken renewed(nEpoch);
+    EXPECT_FALSE(renewed.IsCancelled());
+    EXPECT_NE(exfes_subproblem(m, n, Mask, 0, eqs, sys, F.data(), SolArray, &renewed), -1);
+    EXPECT_EQ(mqSolverStats.nSubProblems - nSubProblems, 1u);
+
+    FreeArray(1, SolArray);
+    free_exfes_packed_eqs(eqs);
+    free_packed_system(sys);
+    FreeEquations(e, Eqs);
+}
+
+TEST(mineTest, solverContextCache) {
+    const unsigned int nBits = 20;
+    uint256 seedHash("0x5f3c8e0ab1d4e2f60718293a4b5c6d7e8f9012a3b4c5d6e7f8091a2b3c4d5e6f");
+    boost::shared_ptr<const CMQSolverContext> pcontext = GetMQSolverContext(seedHash, nBits, 30000, 2);
+    ASSERT_TRUE(pcontext.get() != NULL);
+    EXPECT_TRUE(pcontext == GetMQSolverContext(seedHash, nBits, 30001, 2));
+    EXPECT_TRUE(pcontext != GetMQSolverContext(seedHash, nBits, 100, 2));
+    EXPECT_TRUE(pcontext != GetMQSolverContext(seedHash, nBits, 30000, 3));
+    EXPECT_TRUE(UseNewCoeffMatrix(25217));
+    EXPECT_FALSE(UseNewCoeffMatrix(25216));
+
+    // solutions from different start points on the cached system are all valid
+    CMQCancelToken cancel;
+    int nFound = 0;
+    for (int i = 0; i < 4; i++) {
+        uint64_t startPoint[4] = {random_uint64_t(), 0, 0, 0};
+        int ***Eqs = pcontext->MaskedEquations(startPoint);
+        uint64_t **SolArray = CreateArray(1);
+        exfes_search(2, pcontext->nUnknowns, pcontext->mEquations, startPoint, Eqs, pcontext->PackedSystem(), SolArray, &cancel);
+        uint256 nonce = 0;
+        for (int j = 3; j >= 0; j--) {
+            nonce = nonce << 64;
+            nonce ^= SolArray[0][j];
+        }
+        if (nonce != 0) {
+            nFound++;
+            EXPECT_TRUE(CheckSolution(seedHash, nBits, 1, 2, nonce));
+        }
+        FreeArray(1, SolArray);
+        FreeEquations(pcontext->mEquations, Eqs);
+    }
+    EXPECT_GT(nFound, 0);
+}
+
+static uint256 RandomUint256() {
+    uint256 r;
+    for (unsigned char *p = r.begin(); p != r.end(); p += sizeof(uint64_t)) {
+        uint64_t word = random_uint64_t();
+        memcpy(p, &word, sizeof(word));
+    }
+    return r;
+}
+
+TEST(mineTest, packedCheckSolution) {
+    // genesis block
+    uint256 tempHash = uint256("0xaef6a6cb3767fa5d965b10f9d1e3e183ddea21a5f7ffce9bd7a86c065e7c6865");
+    uint256 seedHash = Hash(BEGIN(tempHash), END(tempHash));
+    uint256 nNonce("0x0000000000000000000000000000000000000000000000000001ee7340a9a1d6");
+    EXPECT_TRUE(CheckSolution(seedHash, 41, 0, 1, nNonce));
+    EXPECT_TRUE(CheckSolutionBytewise(seedHash, 41, 0, 1, nNonce));
+    EXPECT_FALSE(CheckSolution(seedHash, 41, 0, 1, nNonce ^ 1));
+
+    // a null preblockhash selects GenCoeffMatrix, an unknown one of a version 2
+    // block NewGenCoeffMatrix
+    const uint256 preblockhash[2] = {0, 1};
+    const int nHeight[2] = {100, 30000};
+
+    // few equations, so that random nonces are often solutions
+    const unsigned int nSmallBits[] = {1, 2, 3, 5, 8, 56, 120, 248, 256};
+    for (unsigned int b = 0; b < sizeof(nSmallBits) / sizeof(nSmallBits[0]); b++) {
+        for (int rule = 0; rule < 2; rule++) {
+            uint256 hash = RandomUint256();
+            for (int i = 0; i < (nSmallBits[b] < 64 ? 64 : 4); i++) {
+                uint256 nonce = RandomUint256();
+                EXPECT_EQ(CheckSolution(hash, nSmallBits[b], preblockhash[rule], 2, nonce),
+                          CheckSolutionBytewise(hash, nSmallBits[b], preblockhash[rule], 2, nonce));
+            }
+        }
+    }
+
+    // solutions found by the miner, and their neighbours
+    CBlockIndex index;
+    for (unsigned int nBits = 16; nBits <= 28; nBits += 4) {
+        for (int rule = 0; rule < 2; rule++) {
+            index.nHeight = nHeight[rule] - 1;
+            uint256 hash = RandomUint256();
+            uint256 nonce = SerchSolution(hash, nBits, random_uint64_t(), &index);
+            EXPECT_TRUE(CheckSolution(hash, nBits, preblockhash[rule], 2, nonce));
+            EXPECT_TRUE(CheckSolutionBytewise(hash, nBits, preblockhash[rule], 2, nonce));
+            for (unsigned int i = 0; i < nBits + 8; i++) {
+                uint256 neighbour = nonce ^ (uint256(1) << i);
+                EXPECT_EQ(CheckSolution(hash, nBits, preblockhash[rule], 2, neighbour),
+                          CheckSolutionBytewise(hash, nBits, preblockhash[rule], 2, neighbour));
+            }
+        }
+    }
+}
+
+// the rule is picked from the height of the previous block in the index, on
+// both sides of the switch to NewGenCoeffMatrix at 25217
+TEST(mineTest, packedCheckSolutionAtSwitch) {
+    const int nHeight[2] = {25216, 25217};
+    CBlockIndex index[2];
+    uint256 preblockhash[2];
+    for (int side = 0; side < 2; side++) {
+        index[side].nHeight = nHeight[side] - 1;
+        preblockhash[side] = RandomUint256();
+        mapBlockIndex[preblockhash[side]] = &index[side];
+    }
+    EXPECT_FALSE(UseNewCoeffMatrix(index[0].nHeight + 1));
+    EXPECT_TRUE(UseNewCoeffMatrix(index[1].nHeight + 1));
+
+    for (unsigned int nBits = 16; nBits <= 24; nBits += 8) {
+        for (int side = 0; side < 2; side++) {
+            uint256 hash = RandomUint256();
+            uint256 nonce = SerchSolution(hash, nBits, random_uint64_t(), &index[side]);
+            // both block versions, the index decides
+            for (int nVersion = 1; nVersion <= 2; nVersion++) {
+                EXPECT_TRUE(CheckSolution(hash, nBits, preblockhash[side], nVersion, nonce));
+                EXPECT_TRUE(CheckSolutionBytewise(hash, nBits, preblockhash[side], nVersion, nonce));
+            }
+            EXPECT_EQ(CheckSolution(hash, nBits, preblockhash[side], 2, nonce),
+                      CheckSolution(hash, nBits, (bool)side, nonce));
+
+            // corrupted nonces, and the solution checked under the rule of the other side
+            for (unsigned int i = 0; i < nBits + 8; i++) {
+                uint256 corrupted = nonce ^ (uint256(1) << i);
+                EXPECT_EQ(CheckSolution(hash, nBits, preblockhash[side], 2, corrupted),
+                          CheckSolutionBytewise(hash, nBits, preblockhash[side], 2, corrupted));
+            }
+            EXPECT_EQ(CheckSolution(hash, nBits, preblockhash[1 - side], 2, nonce),
+                      CheckSolutionBytewise(hash, nBits, preblockhash[1 - side], 2, nonce));
+        }
+    }
+
+    for (int side = 0; side < 2; side++)
+        mapBlockIndex.erase(preblockhash[side]);
+}
+
+TEST(mineTest, powCache) {
+    uint256 tempHash = uint256("0xaef6a6cb3767fa5d965b10f9d1e3e183ddea21a5f7ffce9bd7a86c065e7c6865");
+    uint256 seedHash = Hash(BEGIN(tempHash), END(tempHash));
+    uint256 nNonce("0x0000000000000000000000000000000000000000000000000001ee7340a9a1d6");
+
+    uint64_t nSize, nHits, nMisses;
+    GetPoWCacheStats(nSize, nHits, nMisses);
+    EXPECT_TRUE(CheckProofOfWork(seedHash, 41, 0, 1, nNonce));
+    EXPECT_TRUE(CheckProofOfWork(seedHash, 41, 0, 1, nNonce));
+    // invalid proofs are not cached
+    EXPECT_FALSE(CheckProofOfWork(seedHash, 41, 0, 1, nNonce ^ 1));
+    EXPECT_FALSE(CheckProofOfWork(seedHash, 41, 0, 1, nNonce ^ 1));
+
+    uint64_t nSizeAfter, nHitsAfter, nMissesAfter;
+    GetPoWCacheStats(nSizeAfter, nHitsAfter, nMissesAfter);
+    EXPECT_EQ(nSizeAfter, nSize + 1);
+    EXPECT_EQ(nHitsAfter, nHits + 1);
+    EXPECT_EQ(nMissesAfter, nMisses + 3);
+}
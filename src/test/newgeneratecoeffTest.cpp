@@ -105,3 +105,73 @@ TEST(newgenratecoeff, NewGenerateCoeff) {
 
 	TNewGenCoeffMatrix(seedHash, mEquations, coeffMatrix);
 }
+
+static void  TGenCoeffMatrix(uint256 hash, unsigned int nBits, std::vector<uint8_t> &coeffM) {
+    unsigned int mEquations = nBits;
+    unsigned int nUnknowns = nBits+8;
+    unsigned int nTerms = 1 + (nUnknowns+1)*(nUnknowns)/2;
+
+    //generate the first polynomial coefficients.
+    unsigned char in[32], out[32];
+    unsigned int count = 0, i, j ,k;
+    uint8_t g[nTerms];
+    std::bitset<256> bits;
+    pqcSha256(hash.begin(),32,in);
+    do {
+         pqcSha256(in,32,out);
+         Uint256ToBits(out, bits);
+         for (k = 0; k < 256; k++) {
+             if(count < nTerms) {
+                 g[count++] = (uint8_t)bits[k];
+              } else {
+                  break;
+              }
+          }
+         for (j = 0; j < 32; j++) {
+             in[j] = out[j];
+         }
+    } while(count < nTerms);
+
+    //generate the rest polynomials coefficients by shiftint f[0] one bit
+    for (i = 0; i < mEquations ; i++) {
+        ArrayShiftRight(g, nTerms, 1);
+        for (j = 0; j < nTerms; j++)
+            coeffM[i*nTerms+j] = g[j];
+    }
+}
+
+// CMQCoeffGenerator gives the rows of the byte matrices, on both sides of the
+// height where NewGenCoeffMatrix starts
+TEST(newgenratecoeff, PackedGeneratorMatchesMatrix) {
+    const int heights[] = { 25216, 25217 };
+    const unsigned int bits[] = { 1, 8, 20, 41, 64 };
+    for (int h = 0; h < 2; h++) {
+        bool fNewCoeffMatrix = UseNewCoeffMatrix(heights[h]);
+        EXPECT_EQ(h == 1, fNewCoeffMatrix);
+        for (int b = 0; b < 5; b++) {
+            unsigned int nBits = bits[b];
+            unsigned int nUnknowns = nBits + addN;
+            unsigned int nTerms = 1 + (nUnknowns+1)*(nUnknowns)/2;
+            uint256 seedHash = GetRandHash();
+
+            std::vector<uint8_t> coeffMatrix(nBits*nTerms);
+            if (fNewCoeffMatrix)
+                TNewGenCoeffMatrix(seedHash, nBits, coeffMatrix);
+            else
+                TGenCoeffMatrix(seedHash, nBits, coeffMatrix);
+
+            CMQCoeffGenerator generator(seedHash, nBits, fNewCoeffMatrix);
+            ASSERT_EQ(nTerms, generator.Terms());
+            ASSERT_EQ((nTerms+63)/64, generator.Words());
+            std::vector<uint64_t> row(generator.RowWords());
+            for (unsigned int i = 0; i < nBits; i++) {
+                generator.Next(&row[0]);
+                for (unsigned int t = 0; t < nTerms; t++)
+                    ASSERT_EQ(coeffMatrix[i*nTerms+t], (row[t/64] >> (t%64)) & 1)
+                        << "height " << heights[h] << " nBits " << nBits << " row " << i << " term " << t;
+                for (unsigned int t = nTerms; t < 64*generator.Words(); t++)
+                    ASSERT_EQ(0U, (row[t/64] >> (t%64)) & 1);
+            }
+        }
+    }
+}
@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+#include <string.h>
+#include <stdlib.h>
+#include "../pqcrypto/pqcrypto.h"
+
+/* every subset of the kernels the cpu supports, the portable one first */
+static std::vector<unsigned> sha256FlagSets(void)
+{
+    std::vector<unsigned> sets;
+    unsigned supported = sha256SimdSupported();
+    for (unsigned flags = 0; flags <= supported; flags++)
+        if ((flags & supported) == flags)
+            sets.push_back(flags);
+    return sets;
+}
+
+static void sha256Reference(const unsigned char *in, unsigned long inlen, unsigned char *out)
+{
+    Sha256 md;
+    sha256Init(&md);
+    /* a byte at a time never hands full blocks to sha256Transform() */
+    for (unsigned long i = 0; i < inlen; i++)
+        sha256Process(&md, in + i, 1);
+    sha256Done(&md, out);
+}
+
+TEST(sha256Test, knownAnswer) {
+    static const struct {
+        const char *msg;
+        unsigned char hash[32];
+    } tests[] = {
+        { "abc",
+          { 0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea,
+            0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+            0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c,
+            0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad }
+        },
+        { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+          { 0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8,
+            0xe5, 0xc0, 0x26, 0x93, 0x0c, 0x3e, 0x60, 0x39,
+            0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff, 0x21, 0x67,
+            0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1 }
+        },
+    };
+    unsigned saved = sha256SimdFlags();
+    std::vector<unsigned> sets = sha256FlagSets();
+    unsigned char out[32];
+
+    for (size_t s = 0; s < sets.size(); s++) {
+        sha256SimdSetFlags(sets[s]);
+        for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+            pqcSha256((const unsigned char *)tests[i].msg, strlen(tests[i].msg), out);
+            EXPECT_EQ(0, memcmp(out, tests[i].hash, 32)) << "flags " << sets[s] << " test " << i;
+        }
+    }
+    sha256SimdSetFlags(saved);
+}
+
+TEST(sha256Test, transform) {
+    unsigned char in[64 * 17 + 3];
+    unsigned char out[32], expect[32];
+    unsigned saved = sha256SimdFlags();
+    std::vector<unsigned> sets = sha256FlagSets();
+
+    srand(25);
+    for (size_t i = 0; i < sizeof(in); i++)
+        in[i] = rand();
+
+    for (size_t s = 0; s < sets.size(); s++) {
+        sha256SimdSetFlags(sets[s]);
+        for (unsigned long len = 0; len <= sizeof(in); len += 13) {
+            sha256Reference(in, len, expect);
+            pqcSha256(in, len, out);
+            EXPECT_EQ(0, memcmp(out, expect, 32)) << "flags " << sets[s] << " len " << len;
+        }
+        /* the single block path of 32 byte messages */
+        sha256Reference(in + 1, 32, expect);
+        pqcSha256(in + 1, 32, out);
+        EXPECT_EQ(0, memcmp(out, expect, 32)) << "flags " << sets[s];
+
+        ulong32 state[8], ref[8];
+        for (int i = 0; i < 8; i++)
+            state[i] = ref[i] = rand();
+        sha256Transform(state, in + 1, 17);
+        sha256TransformGeneric(ref, in + 1, 17);
+        EXPECT_EQ(0, memcmp(state, ref, sizeof(state))) << "flags " << sets[s];
+    }
+    sha256SimdSetFlags(saved);
+}
+
+TEST(sha256Test, d64) {
+    const unsigned long maxBlocks = 21;
+    unsigned char in[64 * maxBlocks];
+    unsigned char out[32 * maxBlocks + 1], expect[32 * maxBlocks], hash[32];
+    unsigned saved = sha256SimdFlags();
+    std::vector<unsigned> sets = sha256FlagSets();
+
+    srand(64);
+    for (size_t i = 0; i < sizeof(in); i++)
+        in[i] = rand();
+    for (unsigned long i = 0; i < maxBlocks; i++) {
+        sha256Reference(in + 64 * i, 64, hash);
+        sha256Reference(hash, 32, expect + 32 * i);
+    }
+
+    for (size_t s = 0; s < sets.size(); s++) {
+        sha256SimdSetFlags(sets[s]);
+        for (unsigned long blocks = 0; blocks <= maxBlocks; blocks++) {
+            memset(out, 0xa5, sizeof(out));
+            sha256D64(out, in, blocks);
+            EXPECT_EQ(0, memcmp(out, expect, 32 * blocks)) << "flags " << sets[s] << " blocks " << blocks;
+            EXPECT_EQ(0xa5, out[32 * blocks]) << "flags " << sets[s] << " blocks " << blocks;
+        }
+        sha256D64Serial(out, in, maxBlocks);
+        EXPECT_EQ(0, memcmp(out, expect, 32 * maxBlocks)) << "flags " << sets[s];
+    }
+    sha256SimdSetFlags(saved);
+}
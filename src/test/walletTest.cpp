@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+#include "wallet.h"
+
+// the keys generated without the wallet lock all end up in the pool and the keystore
+TEST(walletTest, topUpKeyPool) {
+    mapArgs["-keypool"] = "6";
+    mapArgs["-keypoolmin"] = "3";
+
+    CWallet wallet;
+    EXPECT_TRUE(wallet.IsKeyPoolLow());
+    EXPECT_TRUE(wallet.TopUpKeyPool(false));
+    EXPECT_EQ(7, wallet.GetKeyPoolSize());
+    EXPECT_FALSE(wallet.IsKeyPoolLow());
+
+    // already full
+    EXPECT_TRUE(wallet.TopUpKeyPool(false));
+    EXPECT_EQ(7, wallet.GetKeyPoolSize());
+
+    EXPECT_TRUE(wallet.TopUpKeyPool(true));
+    EXPECT_EQ(8, wallet.GetKeyPoolSize());
+    EXPECT_EQ(1, *wallet.setKeyPool.begin());
+    EXPECT_EQ(8, *wallet.setKeyPool.rbegin());
+
+    std::set<CKeyID> setKeys;
+    wallet.GetKeys(setKeys);
+    EXPECT_EQ(8u, setKeys.size());
+
+    mapArgs.erase("-keypool");
+    mapArgs.erase("-keypoolmin");
+}
+
+// two full top ups at once do not both add the keys missing
+TEST(walletTest, concurrentTopUpKeyPool) {
+    mapArgs["-keypool"] = "4";
+
+    CWallet wallet;
+    boost::thread_group threads;
+    for (int i = 0; i < 2; i++)
+        threads.create_thread(boost::bind(&CWallet::TopUpKeyPool, &wallet, false));
+    threads.join_all();
+    EXPECT_TRUE(wallet.TopUpKeyPool(false));
+    EXPECT_EQ(5, wallet.GetKeyPoolSize());
+
+    std::set<CKeyID> setKeys;
+    wallet.GetKeys(setKeys);
+    EXPECT_EQ(5u, setKeys.size());
+
+    mapArgs.erase("-keypool");
+}
+
+TEST(walletTest, keyPoolLowSignal) {
+    CWallet wallet;
+
+    // a notification before the wait is not lost
+    wallet.NotifyKeyPoolLow();
+    int64 nStart = GetTimeMillis();
+    wallet.WaitForKeyPoolLow(10 * 1000);
+    EXPECT_LT(GetTimeMillis() - nStart, 5 * 1000);
+
+    // and is consumed by it
+    nStart = GetTimeMillis();
+    wallet.WaitForKeyPoolLow(50);
+    EXPECT_GE(GetTimeMillis() - nStart, 40);
+}
@@ -6,6 +6,10 @@
 #include "txdb.h"
 #include "main.h"
 #include "hash.h"
+#include "miner.h"
+#include "checkqueue.h"
+
+#include <boost/thread.hpp>
 
 using namespace std;
 
@@ -185,10 +189,64 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
+/** Proof of work check of a block index entry. The coefficient rule is found
+ *  while the entry is linked, so the check does not read mapBlockIndex. An
+ *  entry which passes is marked BLOCK_POW_VERIFIED.
+ */
+class CBlockIndexCheck
+{
+private:
+    CBlockIndex *pindex;
+    bool fNewCoeffMatrix;
+
+public:
+    CBlockIndexCheck() : pindex(NULL), fNewCoeffMatrix(false) {}
+    CBlockIndexCheck(CBlockIndex *pindexIn, bool fNewCoeffMatrixIn) :
+        pindex(pindexIn), fNewCoeffMatrix(fNewCoeffMatrixIn) {}
+
+    bool operator()() {
+        if (!pindex->CheckIndex(fNewCoeffMatrix))
+            return error("LoadBlockIndex() : CheckIndex failed: %s", pindex->GetBlockHash().ToString().c_str());
+        // only this check touches the status of the entry once it is queued
+        pindex->nStatus |= BLOCK_POW_VERIFIED;
+        return true;
+    }
+
+    void swap(CBlockIndexCheck &check) {
+        std::swap(pindex, check.pindex);
+        std::swap(fNewCoeffMatrix, check.fNewCoeffMatrix);
+    }
+};
+
+/** Worker threads checking block index entries while the cursor moves on */
+class CBlockIndexCheckPool
+{
+public:
+    CCheckQueue<CBlockIndexCheck> queue;
+    boost::thread_group threadGroup;
+
+    CBlockIndexCheckPool(int nThreads) : queue(128) {
+        for (int i=0; i<nThreads; i++)
+            threadGroup.create_thread(boost::bind(&CCheckQueue<CBlockIndexCheck>::Thread, &queue));
+    }
+
+    ~CBlockIndexCheckPool() {
+        queue.Wait();
+        threadGroup.interrupt_all();
+        threadGroup.join_all();
+    }
+};
+
 bool CBlockTreeDB::LoadBlockIndexGuts()
 {
     leveldb::Iterator *pcursor = NewIterator();
 
+    // -checkindexpow=0 trusts the entries whose PoW was already verified
+    bool fCheckVerified = GetBoolArg("-checkindexpow", true);
+    CBlockIndexCheckPool pool(nScriptCheckThreads > 1 ? nScriptCheckThreads - 1 : 0);
+    std::vector<CBlockIndexCheck> vChecks;
+    vChecks.reserve(128);
+
     CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
     ssKeySet << make_pair('b', uint256(0));
     pcursor->Seek(ssKeySet.str());
@@ -232,8 +290,13 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
                 if (pindexGenesisBlock == NULL && diskindex.GetBlockHash() == hashGenesisBlock)
                     pindexGenesisBlock = pindexNew;
 
-                if (!pindexNew->CheckIndex())
-                    return error("LoadBlockIndex() : CheckIndex failed: %s", pindexNew->ToString().c_str());
+                if (fCheckVerified || !(pindexNew->nStatus & BLOCK_POW_VERIFIED)) {
+                    vChecks.push_back(CBlockIndexCheck(pindexNew, UseNewCoeffMatrix(pindexNew->pprev ? pindexNew->pprev->nHeight+1 : 0)));
+                    if (vChecks.size() == 128) {
+                        pool.queue.Add(vChecks);
+                        vChecks.clear();
+                    }
+                }
 
                 pcursor->Next();
             } else {
@@ -245,5 +308,9 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
     }
     delete pcursor;
 
+    pool.queue.Add(vChecks);
+    if (!pool.queue.Wait())
+        return false;
+
     return true;
 }
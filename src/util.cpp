@@ -20,6 +20,8 @@
 #include <boost/algorithm/string/join.hpp>
 #include <boost/algorithm/string/case_conv.hpp> // for to_lower()
 #include <boost/algorithm/string/predicate.hpp> // for startswith() and endswith()
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
 
 // Work around clang compilation problem in Boost 1.46:
 // /usr/include/boost/program_options/detail/config_file.hpp:163:17: error: call to function 'to_internal' that is neither visible in the template definition nor found by argument-dependent lookup
@@ -67,6 +69,12 @@ namespace boost {
 # include <sys/prctl.h>
 #endif
 
+#ifndef WIN32
+#include <sys/mman.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 using namespace std;
 
 map<string, string> mapArgs;
@@ -1374,6 +1382,118 @@ void runCommand(std::string strCommand)
         printf("runCommand error: system(%s) returned %d\n", strCommand.c_str(), nErr);
 }
 
+bool SetThreadAffinity(int nCpu)
+{
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(nCpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(WIN32)
+    if (nCpu >= (int)(8 * sizeof(DWORD_PTR)))
+        return false;
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << nCpu) != 0;
+#else
+    (void)nCpu;
+    return false;
+#endif
+}
+
+// Parse a cpu list of sysfs such as "0-3,8-11"
+static void ParseCpuList(const std::string& str, std::vector<int>& vCpus)
+{
+    std::vector<std::string> vRanges;
+    boost::split(vRanges, str, boost::is_any_of(","));
+    BOOST_FOREACH(const std::string& strRange, vRanges) {
+        if (strRange.find_first_of("0123456789") == std::string::npos)
+            continue;
+        size_t nDash = strRange.find('-');
+        int nFirst = atoi(strRange.substr(0, nDash).c_str());
+        int nLast = nDash == std::string::npos ? nFirst : atoi(strRange.substr(nDash + 1).c_str());
+        for (int nCpu = nFirst; nCpu <= nLast; nCpu++)
+            vCpus.push_back(nCpu);
+    }
+}
+
+std::vector<std::vector<int> > GetNumaNodes()
+{
+    std::vector<std::vector<int> > vNodes;
+#if defined(__linux__)
+    // only the cpus the process may run on, under taskset, cgroups or in a container
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        CPU_ZERO(&allowed);
+    for (int nNode = 0; ; nNode++) {
+        boost::filesystem::ifstream file(strprintf("/sys/devices/system/node/node%d/cpulist", nNode));
+        if (!file)
+            break;
+        std::string strCpus;
+        std::getline(file, strCpus);
+        std::vector<int> vCpus, vAllowed;
+        ParseCpuList(strCpus, vCpus);
+        BOOST_FOREACH(int nCpu, vCpus)
+            if (nCpu < CPU_SETSIZE && CPU_ISSET(nCpu, &allowed))
+                vAllowed.push_back(nCpu);
+        if (!vAllowed.empty())
+            vNodes.push_back(vAllowed);
+    }
+    if (vNodes.empty()) {
+        std::vector<int> vCpus;
+        for (int nCpu = 0; nCpu < CPU_SETSIZE; nCpu++)
+            if (CPU_ISSET(nCpu, &allowed))
+                vCpus.push_back(nCpu);
+        if (!vCpus.empty())
+            vNodes.push_back(vCpus);
+    }
+#endif
+    if (vNodes.empty()) {
+        std::vector<int> vCpus;
+        for (int nCpu = 0; nCpu < (int)boost::thread::hardware_concurrency(); nCpu++)
+            vCpus.push_back(nCpu);
+        if (!vCpus.empty())
+            vNodes.push_back(vCpus);
+    }
+    return vNodes;
+}
+
+void *AllocPages(size_t nSize, bool fHugePages)
+{
+#ifdef WIN32
+    (void)fHugePages;
+    return VirtualAlloc(NULL, nSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+    void *p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    // reserved huge pages (vm.nr_hugepages), nSize must be a multiple of their size
+    if (fHugePages)
+        p = mmap(NULL, nSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (p == MAP_FAILED) {
+        p = mmap(NULL, nSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return NULL;
+#ifdef MADV_HUGEPAGE
+        // otherwise transparent huge pages, when the kernel has some
+        if (fHugePages)
+            madvise(p, nSize, MADV_HUGEPAGE);
+#endif
+    }
+    return p;
+#endif
+}
+
+void FreePages(void *p, size_t nSize)
+{
+    if (p == NULL)
+        return;
+#ifdef WIN32
+    (void)nSize;
+    VirtualFree(p, 0, MEM_RELEASE);
+#else
+    munmap(p, nSize);
+#endif
+}
+
 void RenameThread(const char* name)
 {
 #if defined(PR_SET_NAME)
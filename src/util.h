@@ -542,6 +542,19 @@ inline void ExitThread(size_t nExitCode)
 
 void RenameThread(const char* name);
 
+/** Pin the calling thread to cpu nCpu. Returns false where it is not supported. */
+bool SetThreadAffinity(int nCpu);
+
+/** The cpus of each NUMA node the process may run on, a single node with all of
+ *  them when the nodes are unknown, or no node when the cpus are unknown too */
+std::vector<std::vector<int> > GetNumaNodes();
+
+/** Allocate nSize bytes of zeroed pages, backed by huge pages when fHugePages and
+ *  the system has some. The pages are placed on the NUMA node of the thread
+ *  that first writes them. Free them with FreePages(p, nSize). */
+void *AllocPages(size_t nSize, bool fHugePages);
+void FreePages(void *p, size_t nSize);
+
 inline uint32_t ByteReverse(uint32_t value)
 {
     value = ((value & 0xFF00FF00) >> 8) | ((value & 0x00FF00FF) << 8);
@@ -42,8 +42,13 @@ bool CWallet::AddKey(const CKey& key)
         return false;
     if (!fFileBacked)
         return true;
-    if (!IsCrypted())
-        return CWalletDB(strWalletFile).WriteKey(key.GetPubKey(), key.GetPrivKey());
+    if (!IsCrypted()) {
+        LOCK(cs_wallet);
+        if (pwalletdbEncryption)
+            return pwalletdbEncryption->WriteKey(key.GetPubKey(), key.GetPrivKey());
+        else
+            return CWalletDB(strWalletFile).WriteKey(key.GetPubKey(), key.GetPrivKey());
+    }
     return true;
 }
 
@@ -1535,42 +1540,140 @@ bool CWallet::NewKeyPool()
     return true;
 }
 
+static void MakeNewKeys(std::vector<CKey>* pvKeys, unsigned int nFirst, unsigned int nStep)
+{
+    for (unsigned int i = nFirst; i < pvKeys->size(); i += nStep) {
+        try {
+            (*pvKeys)[i].MakeNewKey();
+        } catch (key_error& e) {
+            printf("MakeNewKeys() : %s\n", e.what());
+        }
+    }
+}
+
+// Generates nKeys keys with one thread per core. Keys that failed are null.
+static void GenerateNewKeys(std::vector<CKey>& vKeys, unsigned int nKeys)
+{
+    vKeys.resize(nKeys);
+    unsigned int nThreads = std::min(nKeys, std::max(boost::thread::hardware_concurrency(), 1u));
+    if (nThreads <= 1) {
+        MakeNewKeys(&vKeys, 0, 1);
+        return;
+    }
+    boost::thread_group threads;
+    for (unsigned int i = 0; i < nThreads; i++)
+        threads.create_thread(boost::bind(&MakeNewKeys, &vKeys, i, nThreads));
+    threads.join_all();
+}
+
+// Adds one key, or the keys missing up to -keypool + 1 when once is false.
+// The keys are generated without cs_wallet, so that the wallet is not held
+// for the length of the Rainbow key generation, and the keys and their pool
+// entries are written in one transaction. A full top up while another one
+// runs returns at once, the other one fills the pool.
 bool CWallet::TopUpKeyPool(bool once)
 {
+    boost::unique_lock<boost::mutex> lockTopUp(csTopUpKeyPool, boost::defer_lock);
+    if (!once && !lockTopUp.try_lock())
+        return true;
+
+    unsigned int nKeys = 1;
     {
         LOCK(cs_wallet);
 
         if (IsLocked())
             return false;
 
-        CWalletDB walletdb(strWalletFile);
+        if (!once) {
+            unsigned int nTargetSize = GetArg("-keypool", KEY_POOL_SIZE);
+            if (setKeyPool.size() >= nTargetSize + 1)
+                return true;
+            nKeys = nTargetSize + 1 - setKeyPool.size();
+        }
+    }
+
+    std::vector<CKey> vKeys;
+    GenerateNewKeys(vKeys, nKeys);
+
+    {
+        LOCK(cs_wallet);
+
+        if (IsLocked())
+            return false;
+
+        BOOST_FOREACH(const CKey& key, vKeys)
+            if (key.IsNull())
+                throw runtime_error("TopUpKeyPool() : key generation failed");
 
-        // Top up key pool
-        if (once) {
-            int64 nEnd = 1;
-            if (!setKeyPool.empty())
-                nEnd = *(--setKeyPool.end()) + 1;
-            if (!walletdb.WritePool(nEnd, CKeyPool(GenerateNewKey())))
-                throw runtime_error("TopUpKeyPool() : writing generated key failed");
-            setKeyPool.insert(nEnd);
-            printf("keypool added key %" PRI64d ", size=%" PRIszu "\n", nEnd, setKeyPool.size());
-        } else {
+        // single key top ups may have added keys meanwhile, the extra keys are dropped
+        if (!once) {
             unsigned int nTargetSize = GetArg("-keypool", KEY_POOL_SIZE);
-            while (setKeyPool.size() < (nTargetSize + 1))
-            {
-                int64 nEnd = 1;
-                if (!setKeyPool.empty())
-                    nEnd = *(--setKeyPool.end()) + 1;
-                if (!walletdb.WritePool(nEnd, CKeyPool(GenerateNewKey())))
-                    throw runtime_error("TopUpKeyPool() : writing generated key failed");
-                setKeyPool.insert(nEnd);
-                printf("keypool added key %" PRI64d ", size=%" PRIszu "\n", nEnd, setKeyPool.size());
+            if (setKeyPool.size() >= nTargetSize + 1)
+                return true;
+            nKeys = std::min(nKeys, (unsigned int)(nTargetSize + 1 - setKeyPool.size()));
+        }
+
+        int64 nEnd = 1;
+        if (!setKeyPool.empty())
+            nEnd = *(--setKeyPool.end()) + 1;
+
+        CWalletDB* pwalletdb = NULL;
+        if (fFileBacked) {
+            pwalletdb = new CWalletDB(strWalletFile);
+            if (!pwalletdb->TxnBegin()) {
+                delete pwalletdb;
+                throw runtime_error("TopUpKeyPool() : TxnBegin failed");
             }
+            pwalletdbEncryption = pwalletdb;
+        }
+        bool fOk = true;
+        for (unsigned int i = 0; i < nKeys && fOk; i++) {
+            fOk = AddKey(vKeys[i]);
+            if (fOk && pwalletdb)
+                fOk = pwalletdb->WritePool(nEnd + i, CKeyPool(vKeys[i].GetPubKey()));
         }
+        if (pwalletdb) {
+            pwalletdbEncryption = NULL;
+            if (fOk)
+                fOk = pwalletdb->TxnCommit();
+            else
+                pwalletdb->TxnAbort();
+            delete pwalletdb;
+        }
+        if (!fOk)
+            throw runtime_error("TopUpKeyPool() : writing generated keys failed");
+
+        for (unsigned int i = 0; i < nKeys; i++)
+            setKeyPool.insert(nEnd + i);
+        printf("keypool added keys %" PRI64d "-%" PRI64d ", size=%" PRIszu "\n", nEnd, nEnd + nKeys - 1, setKeyPool.size());
     }
     return true;
 }
 
+bool CWallet::IsKeyPoolLow()
+{
+    unsigned int nMinSize = GetArg("-keypoolmin", GetArg("-keypool", KEY_POOL_SIZE) / 2);
+    LOCK(cs_wallet);
+    return setKeyPool.size() < nMinSize;
+}
+
+void CWallet::NotifyKeyPoolLow()
+{
+    boost::lock_guard<boost::mutex> lock(csKeyPoolLow);
+    fKeyPoolLow = true;
+    condKeyPoolLow.notify_all();
+}
+
+void CWallet::WaitForKeyPoolLow(int64 nMilliseconds)
+{
+    boost::system_time timeout = boost::get_system_time() + boost::posix_time::milliseconds(nMilliseconds);
+    boost::unique_lock<boost::mutex> lock(csKeyPoolLow);
+    while (!fKeyPoolLow)
+        if (!condKeyPoolLow.timed_wait(lock, timeout))
+            break;
+    fKeyPoolLow = false;
+}
+
 void CWallet::ReserveKeyFromKeyPool(int64& nIndex, CKeyPool& keypool)
 {
     nIndex = -1;
@@ -1578,7 +1681,8 @@ void CWallet::ReserveKeyFromKeyPool(int64& nIndex, CKeyPool& keypool)
     {
         LOCK(cs_wallet);
 
-        //need to keep the sequence, don't let it empty
+        //need to keep the sequence, don't let it empty. the filler refills the pool
+        //from -keypoolmin, so this only happens when it is emptied faster than that
         if(setKeyPool.size() == 1)
             TopUpKeyPool(true);
 
@@ -1590,6 +1694,8 @@ void CWallet::ReserveKeyFromKeyPool(int64& nIndex, CKeyPool& keypool)
 
         nIndex = *(setKeyPool.begin());
         setKeyPool.erase(setKeyPool.begin());
+        if (IsKeyPoolLow())
+            NotifyKeyPoolLow();
         if (!walletdb.ReadPool(nIndex, keypool))
             throw runtime_error("ReserveKeyFromKeyPool() : read failed");
         if (!HaveKey(keypool.vchPubKey.GetID()))
@@ -1600,6 +1706,26 @@ void CWallet::ReserveKeyFromKeyPool(int64& nIndex, CKeyPool& keypool)
 
 }
 
+void ThreadKeyPoolFiller(CWallet* pwallet)
+{
+    RenameThread("abcmint-keypool");
+    SetThreadPriority(THREAD_PRIORITY_NORMAL);
+
+    while (true) {
+        if (pwallet->IsKeyPoolLow()) {
+            if (pwallet->IsLocked()) {
+                //getnewaddress will return new address, but maybe timeout
+                //consider how to handle this error
+                printf("error: please unlock the wallet for key pool filling!\n");
+            } else
+                pwallet->TopUpKeyPool(false);
+        }
+        //ReserveKeyFromKeyPool wakes us below -keypoolmin, otherwise check again in 10 seconds
+        pwallet->WaitForKeyPoolLow(10*1000);
+        boost::this_thread::interruption_point();
+    }
+}
+
 int64 CWallet::AddReserveKey(const CKeyPool& keypool)
 {
     {
@@ -68,8 +68,18 @@ class CWallet : public CCryptoKeyStore
 private:
     bool SelectCoins(int64 nTargetValue, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64& nValueRet) const;
 
+    // while set, AddKey() and AddCryptedKey() write through it, so that the keys
+    // are committed in the transaction of EncryptWallet() or TopUpKeyPool()
     CWalletDB *pwalletdbEncryption;
 
+    // held by a full TopUpKeyPool(), so that two of them do not both add the keys missing
+    boost::mutex csTopUpKeyPool;
+
+    // signals the key pool filler, see NotifyKeyPoolLow()
+    boost::mutex csKeyPoolLow;
+    boost::condition_variable condKeyPoolLow;
+    bool fKeyPoolLow;
+
     // the current wallet version: clients below this version are not able to load the wallet
     int nWalletVersion;
 
@@ -97,6 +107,7 @@ public:
         nMasterKeyMaxID = 0;
         pwalletdbEncryption = NULL;
         nOrderPosNext = 0;
+        fKeyPoolLow = false;
     }
     CWallet(std::string strWalletFileIn)
     {
@@ -107,6 +118,7 @@ public:
         nMasterKeyMaxID = 0;
         pwalletdbEncryption = NULL;
         nOrderPosNext = 0;
+        fKeyPoolLow = false;
     }
 
     std::map<uint256, CWalletTx> mapWallet;
@@ -186,6 +198,12 @@ public:
 
     bool NewKeyPool();
     bool TopUpKeyPool(bool once);
+    // True when the key pool has less than -keypoolmin keys
+    bool IsKeyPoolLow();
+    // Wakes the thread waiting in WaitForKeyPoolLow()
+    void NotifyKeyPoolLow();
+    // Waits up to nMilliseconds for NotifyKeyPoolLow()
+    void WaitForKeyPoolLow(int64 nMilliseconds);
     int64 AddReserveKey(const CKeyPool& keypool);
     void ReserveKeyFromKeyPool(int64& nIndex, CKeyPool& keypool);
     void KeepKey(int64 nIndex);
@@ -857,4 +875,7 @@ private:
 
 bool GetWalletFile(CWallet* pwallet, std::string &strWalletFileOut);
 
+// Refills the key pool of pwallet whenever it falls below -keypoolmin
+void ThreadKeyPoolFiller(CWallet* pwallet);
+
 #endif